@@ -0,0 +1,139 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   checksum_bench.c                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/18 11:30:08 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/18 11:30:08 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * NOTE:
+ * Banc d'essai des implémentations de la checksum Internet: chaque
+ * implémentation est d'abord comparée à la version portable sur des tailles et
+ * des alignements variés, puis mesurée sur les tailles de paquets usuelles
+ * jusqu'à TR_MAX_PACKET_LEN.
+ * Usage: ./checksum_bench [iterations]
+ */
+
+#include "traceroute.h"
+#include "checksum.h"
+
+struct kernel {
+	const char		*name;
+	tr_csum_kernel	fn;
+	const char		*feature;
+};
+
+static const struct kernel kernels[] = {
+	{"scalar", inet_csum_scalar, NULL},
+#ifdef TR_CSUM_X86
+	{"sse2", inet_csum_sse2, "sse2"},
+	{"avx2", inet_csum_avx2, "avx2"},
+#endif
+};
+
+#define NKERNELS	(sizeof(kernels) / sizeof(kernels[0]))
+
+static int
+kernel_supported(const struct kernel *k)
+{
+	if (k->feature == NULL)
+		return (1);
+#ifdef TR_CSUM_X86
+	if (strcmp(k->feature, "sse2") == 0)
+		return (__builtin_cpu_supports("sse2"));
+	if (strcmp(k->feature, "avx2") == 0)
+		return (__builtin_cpu_supports("avx2"));
+#endif
+	return (0);
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static int
+check_kernels(const uint8_t *buf)
+{
+	int errors = 0;
+
+	for (size_t k = 1; k < NKERNELS; ++k)
+	{
+		if (!kernel_supported(&kernels[k]))
+			continue;
+		for (size_t off = 0; off < 8; ++off)
+		{
+			for (size_t len = 0; len < 1100; ++len)
+			{
+				uint16_t ref = inet_csum_fold(inet_csum_scalar(buf + off, len));
+				uint16_t got = inet_csum_fold(kernels[k].fn(buf + off, len));
+				if (ref != got)
+				{
+					(void)fprintf(stderr, "%s: mismatch at offset %zu length %zu (%04x != %04x)\n", kernels[k].name, off, len, got, ref);
+					errors++;
+				}
+			}
+		}
+	}
+	return (errors);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const size_t sizes[] = {40, 64, 576, 1500, 4096, 9000, TR_MAX_PACKET_LEN};
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	uint8_t *buf = malloc(TR_MAX_PACKET_LEN + 64);
+
+	if (buf == NULL || iterations <= 0)
+		return (1);
+
+	srand(42);
+	for (size_t i = 0; i < TR_MAX_PACKET_LEN + 64; ++i)
+		buf[i] = rand();
+
+	__builtin_cpu_init();
+	if (check_kernels(buf))
+		return (1);
+
+	(void)printf("selected kernel: %s\n", inet_csum_kernel_name());
+	(void)printf("%8s", "bytes");
+	for (size_t k = 0; k < NKERNELS; ++k)
+		(void)printf(" %14s", kernels[k].name);
+	(void)printf("   (GB/s)\n");
+
+	volatile uint64_t sink = 0;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		// Le nombre d'itérations est réduit pour les grands paquets
+		long n = iterations * 64 / (long)(sizes[s] < 64 ? 64 : sizes[s]) + 1;
+
+		(void)printf("%8zu", sizes[s]);
+		for (size_t k = 0; k < NKERNELS; ++k)
+		{
+			if (!kernel_supported(&kernels[k]))
+			{
+				(void)printf(" %14s", "-");
+				continue;
+			}
+			double start = now_sec();
+			for (long i = 0; i < n; ++i)
+				sink += kernels[k].fn(buf + (i & 1), sizes[s]);
+			double elapsed = now_sec() - start;
+			(void)printf(" %14.2f", (double)sizes[s] * n / elapsed / 1e9);
+		}
+		(void)printf("\n");
+	}
+	(void)sink;
+	free(buf);
+	return (0);
+}
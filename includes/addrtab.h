@@ -0,0 +1,58 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   addrtab.h                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/22 10:14:52 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/22 10:14:52 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef ADDRTAB_H
+#define ADDRTAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define TR_ADDRTAB_MIN_SIZE	256
+#define TR_ADDRSTRLEN		INET6_ADDRSTRLEN
+
+/**
+ * Adresse de socket IPv4 ou IPv6, selon la famille de la trace.
+ */
+union tr_sockaddr {
+	struct sockaddr		sa;
+	struct sockaddr_in	sin;
+	struct sockaddr_in6	sin6;
+};
+
+/**
+ * Table des adresses IPv6 rencontrées: chaque adresse y reçoit un identifiant
+ * de 32 bits, non nul, utilisé partout où une adresse IPv4 le serait. Les
+ * adresses sont rangées dans l'ordre d'arrivée, l'identifiant étant leur rang
+ * plus un; `index` est une table à adressage ouvert de ces identifiants.
+ */
+struct tr_addrtab {
+	int				family;
+	struct in6_addr	*addrs;
+	uint32_t		count;
+	uint32_t		capacity;
+	uint32_t		*index;
+	uint32_t		mask;
+};
+
+int						tr_addrtab_init(int family);
+void					tr_addrtab_destroy(void);
+int						tr_addr_family(void);
+uint32_t				tr_addr_intern(const struct in6_addr *addr);
+uint32_t				tr_addr_find(const struct in6_addr *addr);
+const struct in6_addr	*tr_addr_get(uint32_t id);
+const char				*tr_addr_ntop(uint32_t addr, char *buf, size_t len);
+socklen_t				tr_sockaddr_set(union tr_sockaddr *sa, uint32_t addr, uint16_t port);
+uint32_t				tr_sockaddr_addr(const union tr_sockaddr *sa);
+
+#endif /* ADDRTAB_H */
@@ -0,0 +1,167 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   archive.h                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/24 10:02:11 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/24 10:02:11 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Archive binaire des traces d'une exécution (--archive), lue par l'outil
+ * trarchive. Les entiers sont dans l'ordre des octets de la machine qui écrit
+ * l'archive, indiqué par le champ `endian` de l'en-tête.
+ * ┌──────────────────────────────────────────────┐
+ * │ en-tête (tr_archive_header)                  │
+ * ├──────────────────────────────────────────────┤
+ * │ bloc d'une trace (tr_archive_block)          │
+ * │   nom d'hôte, complété à 8 octets            │
+ * │   probes (tr_archive_record), par TTL        │
+ * │   table des adresses du bloc (16 octets)     │
+ * ├──────────────────────────────────────────────┤
+ * │ ... un bloc par trace, dans l'ordre de fin   │
+ * ├──────────────────────────────────────────────┤
+ * │ index des blocs (tr_archive_index)           │
+ * │ fin de fichier (tr_archive_trailer)          │
+ * └──────────────────────────────────────────────┘
+ * L'index n'est écrit qu'à la fermeture: sans lui, les blocs d'une archive
+ * interrompue restent lisibles en les parcourant l'un après l'autre.
+ */
+#define TR_ARCHIVE_MAGIC		"FTTRARC1"
+#define TR_ARCHIVE_VERSION		1
+#define TR_ARCHIVE_ENDIAN		0x0102
+#define TR_ARCHIVE_BLOCK_MAGIC	0x4B425254 /* "TRBK" */
+#define TR_ARCHIVE_INDEX_MAGIC	0x58445254 /* "TRDX" */
+
+/* Adresses IPv4 stockées sous la forme ::ffff:a.b.c.d */
+#define TR_ARCHIVE_ADDRLEN		16
+/* RTT d'une probe sans réponse */
+#define TR_ARCHIVE_NO_RTT		UINT32_MAX
+
+#define TR_ARCHIVE_REPLY		1
+#define TR_ARCHIVE_TIMEOUT		2
+#define TR_ARCHIVE_ERROR		3
+
+/* Taille minimale de la table des adresses d'un bloc, en cours d'écriture */
+#define TR_ARCHIVE_MIN_SLOTS	64
+
+#define tr_archive_pad(n) (((n) + 7) & ~(size_t)7)
+
+/**
+ * Paramètres de l'exécution, communs à toutes les traces de l'archive.
+ */
+struct tr_archive_header {
+	char		magic[8];
+	uint16_t	version;
+	uint16_t	endian;
+	uint8_t		family;
+	uint8_t		protocol;
+	uint8_t		nprobes;
+	uint8_t		reserved;
+	uint16_t	packet_len;
+	int16_t		tos;
+	uint16_t	first_ttl;
+	uint16_t	max_ttl;
+	uint32_t	flags;
+	uint32_t	reserved2;
+	uint64_t	created_us;
+};
+
+/**
+ * Bloc d'une trace. Les heures sont en microsecondes depuis l'époque Unix:
+ * `start_us` est l'heure d'envoi de la première probe enregistrée, chaque probe
+ * portant l'écart avec la précédente.
+ */
+struct tr_archive_block {
+	uint32_t	magic;
+	uint32_t	size;
+	uint64_t	start_us;
+	uint8_t		dst[TR_ARCHIVE_ADDRLEN];
+	uint16_t	naddrs;
+	uint16_t	hostlen;
+	uint32_t	nrecords;
+	uint8_t		stop;
+	uint8_t		reserved[7];
+};
+
+/**
+ * Probe terminée, de taille fixe. `addr` est le rang (à partir de 1) de
+ * l'émetteur de la réponse dans la table du bloc, 0 sans réponse.
+ */
+struct tr_archive_record {
+	int32_t		delta_us;
+	uint32_t	rtt_us;
+	uint16_t	addr;
+	uint8_t		ttl;
+	uint8_t		probe;
+	uint8_t		state;
+	uint8_t		icmp_type;
+	uint8_t		icmp_code;
+	uint8_t		reached;
+};
+
+/**
+ * Entrée de l'index: suffit à filtrer les traces par destination et par date
+ * sans lire les blocs.
+ */
+struct tr_archive_index {
+	uint64_t	offset;
+	uint64_t	start_us;
+	uint64_t	end_us;
+	uint8_t		dst[TR_ARCHIVE_ADDRLEN];
+	uint32_t	size;
+	uint8_t		stop;
+	uint8_t		reserved[3];
+};
+
+struct tr_archive_trailer {
+	uint64_t	index_offset;
+	uint32_t	count;
+	uint32_t	magic;
+};
+
+_Static_assert(sizeof(struct tr_archive_header) == 40, "archive header layout");
+_Static_assert(sizeof(struct tr_archive_block) == 48, "archive block layout");
+_Static_assert(sizeof(struct tr_archive_record) == 16, "archive record layout");
+_Static_assert(sizeof(struct tr_archive_index) == 48, "archive index layout");
+_Static_assert(sizeof(struct tr_archive_trailer) == 16, "archive trailer layout");
+
+struct tr_trace;
+struct tr_params;
+
+/**
+ * Écriture d'une archive: les blocs sont assemblés dans un tampon réutilisé
+ * d'une trace à l'autre, l'index est conservé en mémoire jusqu'à la fermeture.
+ */
+struct tr_archive {
+	FILE					*fp;
+	const char				*path;
+	uint64_t				offset;
+	/* Écart entre CLOCK_REALTIME et CLOCK_MONOTONIC, en microsecondes */
+	int64_t					clock_offset_us;
+	uint8_t					*buf;
+	size_t					bufsize;
+	/* Table des adresses du bloc en cours, indexée par adresse de 32 bits */
+	uint32_t				*keys;
+	uint16_t				*ranks;
+	uint32_t				mask;
+	struct tr_archive_index	*index;
+	uint32_t				count;
+	uint32_t				capacity;
+};
+
+int		tr_archive_open(struct tr_archive *ar, const char *path, const struct tr_params *params);
+int		tr_archive_trace(struct tr_archive *ar, const struct tr_trace *trace);
+void	tr_archive_close(struct tr_archive *ar);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,44 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   checksum.h                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/18 10:02:44 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/18 10:02:44 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TR_CSUM_X86
+#endif
+
+/**
+ * Implémentations du calcul de la somme en complément à un: toutes retournent
+ * la somme non repliée sur 64 bits, repliée ensuite par inet_csum_fold().
+ * Elles sont exposées pour le banc d'essai, le reste du programme passe par
+ * inet_checksum() qui choisit la plus rapide supportée par le processeur.
+ */
+typedef uint64_t	(*tr_csum_kernel)(const void *buf, size_t len);
+
+uint64_t	inet_csum_scalar(const void *buf, size_t len);
+#ifdef TR_CSUM_X86
+uint64_t	inet_csum_sse2(const void *buf, size_t len);
+uint64_t	inet_csum_avx2(const void *buf, size_t len);
+#endif
+
+const char	*inet_csum_kernel_name(void);
+uint16_t	inet_csum_fold(uint64_t sum);
+
+uint16_t	inet_checksum(const void *buf, size_t len);
+int			inet_checksum_verify(const void *buf, size_t len);
+uint16_t	cksum_update(uint16_t cksum, uint16_t old, uint16_t new);
+
+#endif /* CHECKSUM_H */
@@ -0,0 +1,71 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   daemon.h                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/25 10:18:44 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/25 10:18:44 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* Ligne de requête: les options et arguments de la ligne de commande */
+#define TR_DAEMON_LINE_MAX		4096
+#define TR_DAEMON_MAX_ARGS		128
+/* Délai de réception de la ligne de requête (s) */
+#define TR_DAEMON_REQ_TIMEOUT	10
+#define TR_DAEMON_MAX_CLIENTS	256
+#define TR_DAEMON_BACKLOG		64
+#define TR_DAEMON_SOCK_MODE		0660
+
+/**
+ * Paires de sockets inactives conservées par type: famille, probes sans état
+ * (IP_HDRINCL) et protocole, qui déterminent les sockets créés par create_socket().
+ */
+#define TR_POOL_PROTOS			5
+#define TR_POOL_KINDS			(2 * 2 * TR_POOL_PROTOS)
+#define TR_POOL_DEPTH			8
+
+#define tr_pool_kind(params) ((((params)->family == AF_INET6) * 2 + !!((params)->flags & TR_FLAG_STATELESS)) * TR_POOL_PROTOS + (params)->protocol)
+
+struct tr_sockpair {
+	int	send_sock;
+	int	recv_sock;
+};
+
+struct tr_sockpool {
+	pthread_mutex_t		lock;
+	struct tr_sockpair	idle[TR_POOL_KINDS][TR_POOL_DEPTH];
+	uint32_t			count[TR_POOL_KINDS];
+};
+
+/**
+ * Démon: chaque client est servi par son propre thread, qui exécute sa requête
+ * avec son propre moteur sur une paire de sockets prise dans la réserve.
+ */
+struct tr_daemon {
+	int					listen_fd;
+	const char			*path;
+	const char			*name_cache;
+	struct tr_sockpool	pool;
+	pthread_mutex_t		lock;
+	uint32_t			nclients;
+	/* Identifiants de probes des requêtes en cours (voir tr_ident) */
+	uint16_t			next_ident;
+	uint8_t				idents[(UINT16_MAX + 1) / 8];
+};
+
+struct tr_client {
+	struct tr_daemon	*daemon;
+	int					fd;
+	uint16_t			ident;
+};
+
+#endif /* DAEMON_H */
@@ -0,0 +1,54 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   event.h                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/16 14:02:11 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/16 14:02:11 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+/**
+ * La boucle d'événements repose sur epoll, et les sources sur timerfd et
+ * eventfd: ft_traceroute ne fonctionne que sous Linux.
+ */
+#ifndef __linux__
+# error "ft_traceroute requires Linux (epoll, timerfd, eventfd)"
+#endif
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define TR_EV_READ		EPOLLIN
+#define TR_EV_WRITE		EPOLLOUT
+#define TR_EV_ERROR		EPOLLERR
+
+#define TR_EV_MAX_EVENTS	64
+
+/**
+ * Source d'événements surveillée par la boucle: le handler est appelé
+ * avec les événements prêts sur le descripteur.
+ */
+struct tr_evsource {
+	int		fd;
+	void	(*handler)(struct tr_evsource *source, uint32_t events);
+	void	*data;
+};
+
+struct tr_evloop {
+	int		epfd;
+};
+
+int		tr_evloop_init(struct tr_evloop *loop);
+void	tr_evloop_close(struct tr_evloop *loop);
+int		tr_evloop_add(struct tr_evloop *loop, struct tr_evsource *source, uint32_t events);
+int		tr_evloop_mod(struct tr_evloop *loop, struct tr_evsource *source, uint32_t events);
+int		tr_evloop_del(struct tr_evloop *loop, struct tr_evsource *source);
+int		tr_evloop_wait(struct tr_evloop *loop, int timeout_ms);
+
+#endif /* EVENT_H */
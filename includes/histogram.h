@@ -0,0 +1,72 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   histogram.h                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/28 11:02:37 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/28 11:02:37 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Histogramme à échelle logarithmique (à la HDR Histogram) des RTT, en
+ * microsecondes: les valeurs inférieures à 2^TR_HIST_SUB_BITS sont exactes,
+ * chaque puissance de deux au-delà est découpée en 2^TR_HIST_SUB_BITS cases,
+ * soit une erreur relative d'au plus 1/32 (environ 3 %). Les valeurs sont
+ * plafonnées à TR_HIST_MAX, environ 134 s.
+ */
+#define TR_HIST_SUB_BITS	5
+#define TR_HIST_SUB_COUNT	(1u << TR_HIST_SUB_BITS)
+#define TR_HIST_MAX_BITS	27
+#define TR_HIST_MAX			((1u << TR_HIST_MAX_BITS) - 1)
+#define TR_HIST_BUCKETS		((TR_HIST_MAX_BITS - TR_HIST_SUB_BITS + 1) * TR_HIST_SUB_COUNT)
+
+/**
+ * Un histogramme occupe une taille fixe quel que soit le nombre de valeurs.
+ * La gigue est la moyenne des écarts absolus entre valeurs consécutives.
+ */
+struct tr_histogram {
+	uint64_t	count;
+	uint64_t	sum;
+	uint32_t	min;
+	uint32_t	max;
+	uint32_t	last;
+	uint64_t	jitter_sum;
+	uint64_t	jitter_count;
+	uint32_t	counts[TR_HIST_BUCKETS];
+};
+
+/**
+ * Histogrammes des routeurs rencontrés, partagés entre les traces et les
+ * exécutions (--histograms). Au-delà de TR_HISTTAB_MAX routeurs, les nouveaux
+ * routeurs ne sont plus comptés.
+ */
+#define TR_HISTTAB_MAX		4096
+#define TR_HISTTAB_SIZE		(2 * TR_HISTTAB_MAX)
+
+struct tr_histtab {
+	uint32_t			*addrs;
+	struct tr_histogram	**hists;
+	uint32_t			count;
+};
+
+void		tr_histogram_record(struct tr_histogram *hist, uint32_t value);
+void		tr_histogram_merge(struct tr_histogram *dst, const struct tr_histogram *src);
+uint32_t	tr_histogram_percentile(const struct tr_histogram *hist, uint32_t pct);
+uint32_t	tr_histogram_jitter(const struct tr_histogram *hist);
+
+int					tr_histtab_init(struct tr_histtab *tab);
+void				tr_histtab_destroy(struct tr_histtab *tab);
+struct tr_histogram	*tr_histtab_get(struct tr_histtab *tab, uint32_t addr);
+int					tr_histtab_load(struct tr_histtab *tab, const char *path);
+int					tr_histtab_save(const struct tr_histtab *tab, const char *path);
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,45 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   json.h                                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/23 09:12:48 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/23 09:12:48 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Un enregistrement contient au plus un nom d'hôte (NI_MAXHOST octets, six
+ * octets par caractère une fois échappé) et quelques champs numériques.
+ */
+#define TR_JSON_BUFSIZE	8192
+
+/**
+ * Tampon d'un enregistrement NDJSON (un objet par ligne), réutilisé d'un
+ * enregistrement à l'autre: les champs y sont ajoutés sans allocation et la
+ * ligne complète est écrite en un seul appel à fwrite(). Un champ qui ne tient
+ * plus dans le tampon est abandonné, l'objet reste bien formé.
+ */
+struct tr_json {
+	size_t	len;
+	char	buf[TR_JSON_BUFSIZE];
+};
+
+void	tr_json_begin(struct tr_json *json, const char *type);
+void	tr_json_str(struct tr_json *json, const char *key, const char *val);
+void	tr_json_uint(struct tr_json *json, const char *key, uint64_t val);
+void	tr_json_int(struct tr_json *json, const char *key, int64_t val);
+void	tr_json_double(struct tr_json *json, const char *key, double val, int precision);
+void	tr_json_bool(struct tr_json *json, const char *key, int val);
+void	tr_json_end(struct tr_json *json, FILE *out);
+
+#endif /* JSON_H */
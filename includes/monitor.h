@@ -0,0 +1,68 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   monitor.h                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/27 16:40:12 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/27 16:40:12 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stdint.h>
+
+#define TR_MAX_CYCLES			0x7FFFFFFF
+
+/**
+ * Nombre d'échantillons conservés par saut (puissance de deux): les
+ * statistiques portent sur cette fenêtre glissante.
+ */
+#define TR_MONITOR_HISTORY		256
+#define TR_MONITOR_MASK			(TR_MONITOR_HISTORY - 1)
+/* Échantillon d'une probe restée sans réponse */
+#define TR_MONITOR_LOST			UINT32_MAX
+/**
+ * RTT maximal retenu (µs), environ 134 s: la somme des carrés de la fenêtre
+ * tient alors sur 64 bits.
+ */
+#define TR_MONITOR_RTT_MAX		((1u << 27) - 1)
+
+/**
+ * Statistiques glissantes d'un saut. Les sommes sont mises à jour à l'entrée
+ * et à la sortie de chaque échantillon; le meilleur et le pire RTT sont en
+ * tête de deux files monotones de numéros d'échantillons, dont chaque
+ * échantillon entre et sort au plus une fois.
+ */
+struct tr_hopstats {
+	/* Dernier routeur ayant répondu au saut, 0 s'il n'a jamais répondu */
+	uint32_t	addr;
+	/* Probes envoyées depuis le début de la surveillance */
+	uint64_t	sent;
+	/* Nombre d'échantillons reçus, le dernier étant `seq - 1` */
+	uint32_t	seq;
+	uint32_t	count;
+	uint32_t	received;
+	uint64_t	sum;
+	uint64_t	sumsq;
+	uint32_t	min_head;
+	uint32_t	min_tail;
+	uint32_t	max_head;
+	uint32_t	max_tail;
+	uint32_t	samples[TR_MONITOR_HISTORY];
+	uint32_t	minq[TR_MONITOR_HISTORY];
+	uint32_t	maxq[TR_MONITOR_HISTORY];
+};
+
+void		tr_hopstats_push(struct tr_hopstats *stats, uint32_t rtt_us);
+uint32_t	tr_hopstats_last(const struct tr_hopstats *stats);
+uint32_t	tr_hopstats_best(const struct tr_hopstats *stats);
+uint32_t	tr_hopstats_worst(const struct tr_hopstats *stats);
+uint32_t	tr_hopstats_avg(const struct tr_hopstats *stats);
+uint32_t	tr_hopstats_stddev(const struct tr_hopstats *stats);
+double		tr_hopstats_loss(const struct tr_hopstats *stats);
+
+#endif /* MONITOR_H */
@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   namecache.h                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/17 14:20:37 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/17 14:20:37 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef NAMECACHE_H
+#define NAMECACHE_H
+
+#include <stdint.h>
+
+#define TR_NAMECACHE_PATH		"/var/cache/ft_traceroute.names"
+#define TR_NAMECACHE_MAGIC		0x434e5254u /* "TRNC" */
+#define TR_NAMECACHE_VERSION	1
+#define TR_NAMECACHE_SLOTS		16384
+#define TR_NAMECACHE_PROBES		8
+#define TR_NAMECACHE_NAMELEN	238
+
+/**
+ * Durée de validité des entrées, en secondes: les échecs de résolution sont
+ * conservés moins longtemps que les noms.
+ */
+#define TR_NAMECACHE_TTL		86400
+#define TR_NAMECACHE_NEG_TTL	3600
+
+/**
+ * Format du fichier: un en-tête suivi d'une table de hachage de taille fixe.
+ * Chaque entrée est protégée par un compteur de séquence (seqlock): impair
+ * pendant une écriture, il permet aux lecteurs de détecter une lecture
+ * concurrente sans prendre de verrou.
+ */
+struct tr_namecache_header {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	nslots;
+	uint32_t	entry_size;
+};
+
+struct tr_namecache_entry {
+	uint32_t	seq;
+	uint32_t	addr;
+	int64_t		expires;
+	uint8_t		resolved;
+	uint8_t		len;
+	char		name[TR_NAMECACHE_NAMELEN];
+};
+
+struct tr_namecache {
+	struct tr_namecache_header	*header;
+	struct tr_namecache_entry	*entries;
+	size_t						size;
+};
+
+int		tr_namecache_open(struct tr_namecache *cache, const char *path);
+void	tr_namecache_close(struct tr_namecache *cache);
+int		tr_namecache_get(struct tr_namecache *cache, uint32_t addr, char *name, size_t namelen);
+void	tr_namecache_put(struct tr_namecache *cache, uint32_t addr, const char *name);
+
+#endif /* NAMECACHE_H */
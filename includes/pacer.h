@@ -0,0 +1,44 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   pacer.h                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/19 09:12:40 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/19 09:12:40 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TR_DEFAULT_BURST	10
+#define TR_MAX_BURST		65536
+#define TR_MAX_RATE			10000000
+
+/**
+ * Limiteur de débit global des probes (seau à jetons). Un jeton vaut `interval`
+ * nanosecondes de crédit, soit une probe: le seau se remplit avec le temps et
+ * contient au plus `burst` jetons, ce qui borne la rafale envoyée après une
+ * période d'inactivité. Lorsqu'il est vide, un timerfd réveille la boucle
+ * d'événements dès qu'un jeton est disponible.
+ */
+struct tr_pacer {
+	int			tfd;
+	int			armed;
+	uint64_t	interval;
+	uint64_t	capacity;
+	uint64_t	tokens;
+	uint64_t	last;
+};
+
+int		tr_pacer_init(struct tr_pacer *pacer, uint64_t pps, uint64_t bps, uint32_t burst, size_t wire_len);
+void	tr_pacer_destroy(struct tr_pacer *pacer);
+int		tr_pacer_take(struct tr_pacer *pacer);
+void	tr_pacer_ack(struct tr_pacer *pacer);
+
+#endif /* PACER_H */
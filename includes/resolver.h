@@ -0,0 +1,74 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   resolver.h                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/17 09:41:26 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/17 09:41:26 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "namecache.h"
+
+#define TR_RESOLVER_THREADS		4
+#define TR_RESOLVER_MIN_SIZE	256
+
+/**
+ * État d'une entrée du cache de noms.
+ */
+#define TR_NAME_PENDING		0
+#define TR_NAME_RESOLVED	1
+#define TR_NAME_FAILED		2
+
+/**
+ * Entrée du cache, `addr6` étant l'adresse complète d'un identifiant IPv6
+ * (voir addrtab.c). Une fois l'état passé à RESOLVED ou FAILED, l'entrée n'est
+ * plus modifiée et peut être lue sans verrou par le thread principal.
+ */
+struct tr_name {
+	uint32_t		addr;
+	int				family;
+	struct in6_addr	addr6;
+	int				state;
+	char			*name;
+	struct tr_name	*next_job;
+};
+
+/**
+ * Résolveur de noms inverse (rDNS) asynchrone: les requêtes sont traitées par
+ * un groupe de threads et leur fin est signalée par un eventfd, surveillé par
+ * la boucle d'événements.
+ */
+struct tr_resolver {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	pthread_t		threads[TR_RESOLVER_THREADS];
+	int				nthreads;
+	int				stop;
+	int				efd;
+	/* Cache indexé par adresse, accédé uniquement par le thread principal */
+	struct tr_name	**table;
+	uint32_t		size;
+	uint32_t		count;
+	/* File des requêtes en attente d'un thread */
+	struct tr_name	*jobs_head;
+	struct tr_name	*jobs_tail;
+	/* Cache persistant, partagé avec les autres exécutions */
+	struct tr_namecache	cache;
+};
+
+int		tr_resolver_init(struct tr_resolver *resolver, const char *cache_path);
+void	tr_resolver_destroy(struct tr_resolver *resolver);
+int		tr_resolver_lookup(struct tr_resolver *resolver, uint32_t addr, const char **name);
+void	tr_resolver_ack(struct tr_resolver *resolver);
+
+#endif /* RESOLVER_H */
@@ -0,0 +1,41 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   stopset.h                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/21 14:02:51 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/21 14:02:51 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef STOPSET_H
+#define STOPSET_H
+
+#include <stdint.h>
+
+#define TR_STOPSET_MIN_SIZE	1024
+
+/**
+ * Ensemble de couples de 32 bits (adresse, TTL) ou (interface, destination),
+ * rangés dans une table à adressage ouvert de clés de 64 bits: une recherche
+ * parcourt quelques clés contiguës en mémoire, sans indirection. La clé nulle
+ * marque une case vide, les adresses des couples ne sont jamais nulles.
+ */
+struct tr_stopset {
+	uint64_t	*keys;
+	uint32_t	mask;
+	uint32_t	count;
+};
+
+#define tr_stopset_key(a, b) ((uint64_t)(a) << 32 | (uint32_t)(b))
+
+int		tr_stopset_init(struct tr_stopset *set);
+void	tr_stopset_destroy(struct tr_stopset *set);
+int		tr_stopset_add(struct tr_stopset *set, uint64_t key);
+int		tr_stopset_has(const struct tr_stopset *set, uint64_t key);
+int		tr_stopset_load(struct tr_stopset *set, const char *path);
+int		tr_stopset_save(const struct tr_stopset *set, const char *path);
+
+#endif /* STOPSET_H */
@@ -0,0 +1,56 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   timer.h                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/16 14:02:37 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/16 14:02:37 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Roue de timers hiérarchique: 5 niveaux de 64 cases, avec une résolution
+ * d'une milliseconde au premier niveau, soit environ 12 jours au dernier niveau.
+ */
+#define TR_TIMER_LEVELS		5
+#define TR_TIMER_SLOT_BITS	6
+#define TR_TIMER_SLOTS		(1 << TR_TIMER_SLOT_BITS)
+#define TR_TIMER_SLOT_MASK	(TR_TIMER_SLOTS - 1)
+#define TR_TIMER_MAX_DELTA	((1ULL << (TR_TIMER_LEVELS * TR_TIMER_SLOT_BITS)) - 1)
+
+#define tr_container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+struct tr_timer {
+	struct tr_timer	*next;
+	struct tr_timer	*prev;
+	uint64_t		expires;
+	void			(*callback)(struct tr_timer *timer);
+	void			*data;
+};
+
+struct tr_timer_wheel {
+	uint64_t		now;
+	size_t			pending;
+	struct tr_timer	slots[TR_TIMER_LEVELS][TR_TIMER_SLOTS];
+};
+
+uint64_t	tr_now_ms(void);
+
+void	tr_timer_wheel_init(struct tr_timer_wheel *wheel, uint64_t now);
+void	tr_timer_init(struct tr_timer *timer, void (*callback)(struct tr_timer *), void *data);
+void	tr_timer_add(struct tr_timer_wheel *wheel, struct tr_timer *timer, uint64_t expires);
+void	tr_timer_cancel(struct tr_timer_wheel *wheel, struct tr_timer *timer);
+int		tr_timer_pending(struct tr_timer *timer);
+void	tr_timer_advance(struct tr_timer_wheel *wheel, uint64_t now);
+int64_t	tr_timer_next(struct tr_timer_wheel *wheel);
+
+#endif /* TIMER_H */
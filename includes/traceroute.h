@@ -21,6 +21,7 @@
 #include <ctype.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <netdb.h>
 #include <ifaddrs.h>
@@ -36,11 +37,24 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
 #include <netinet/udp.h>
 #include <netinet/tcp.h>
 
 #include "verbose.h"
+#include "event.h"
+#include "timer.h"
+#include "resolver.h"
+#include "checksum.h"
+#include "pacer.h"
+#include "stopset.h"
+#include "json.h"
+#include "archive.h"
+#include "addrtab.h"
+#include "monitor.h"
+#include "histogram.h"
 
 #define TR_PREFIX "ft_traceroute"
 
@@ -51,12 +65,44 @@
 #define TR_MAX_TTL				255
 #define TR_DEFAULT_TOS			-1
 #define TR_MAX_TOS				255
-#define TR_DEFAULT_TIMEOUT		5
-#define TR_MAX_TIMEOUT			86400
+/* Délais d'attente en millisecondes */
+#define TR_DEFAULT_TIMEOUT		5000
+#define TR_MAX_TIMEOUT			86400000
+#define TR_DEFAULT_MIN_WAIT		50
 #define TR_DEFAULT_BASE_PORT	33434
+#define TR_DEFAULT_TCP_PORT		80
 #define TR_MAX_PORT				65535
 #define TR_DEFAULT_PACKET_LEN	40
+#define TR_DEFAULT_SQUERIES		1
+#define TR_MAX_SQUERIES			(TR_MAX_TTL * TR_MAX_PROBES)
+#define TR_DEFAULT_CONCURRENCY	32
+#define TR_MAX_CONCURRENCY		4096
 #define TR_MAX_PACKET_LEN		(2<<14) // 32768 bytes
+#define TR_OUT_BUFSIZE			(1 << 16)
+
+/**
+ * Découverte des chemins multiples: confiance de la règle d'arrêt (%) et
+ * nombre d'interfaces au-delà duquel un saut n'est plus exploré.
+ */
+#define TR_MDA_DEFAULT_CONFIDENCE	95
+#define TR_MDA_MIN_CONFIDENCE		50
+#define TR_MDA_MAX_CONFIDENCE		99
+#define TR_MDA_MAX_NEXTHOPS			16
+
+/**
+ * Raison de la fin d'une trace. Les arrêts anticipés sont signalés par le code
+ * de sortie du programme (TR_EXIT_*), le plus élevé l'emportant en mode
+ * multi-cibles.
+ */
+#define TR_STOP_NONE		0
+#define TR_STOP_REACHED		1
+#define TR_STOP_MAX_TTL		2
+#define TR_STOP_GAP			3
+#define TR_STOP_LOOP		4
+#define TR_STOP_STOP_SET	5
+
+#define TR_EXIT_GAP			2
+#define TR_EXIT_LOOP		3
 
 #define TR_PROTO_UDP	1
 #define TR_PROTO_ICMP	2
@@ -68,26 +114,347 @@
 #define TR_FLAG_DEBUG		0x04
 #define TR_FLAG_NOROUTE		0x08
 #define TR_FLAG_FIXED_PORT	0x10
+#define TR_FLAG_STATELESS	0x20
+#define TR_FLAG_ADAPTIVE	0x40
+#define TR_FLAG_MDA			0x80
+#define TR_FLAG_JSON		0x100
+
+/**
+ * En TCP le port de destination est celui du service visé: les probes sont
+ * identifiées par leur port source, à partir de TR_DEFAULT_BASE_PORT.
+ */
+#define tr_probe_base(params) ((params)->protocol == TR_PROTO_TCP ? TR_DEFAULT_BASE_PORT : (params)->port)
 
 #define verbose(x) ((x & TR_FLAG_VERBOSE) == TR_FLAG_VERBOSE)
 #define summary(x) ((x & TR_FLAG_SUMMARY) == TR_FLAG_SUMMARY)
+#define json_output(x) ((x & TR_FLAG_JSON) == TR_FLAG_JSON)
 
 struct tr_params {
-	uint8_t		flags;
+	uint16_t	flags;
 	uint32_t	first_ttl;
 	uint32_t	max_ttl;
 	uint32_t	port;
+	/**
+	 * Port source des probes UDP, lié au socket d'envoi: les réponses aux
+	 * probes des autres requêtes du démon vers la même cible sont écartées.
+	 * 0 lorsqu'il n'est pas vérifié.
+	 */
+	uint16_t	sport;
 	uint32_t	nprobes;
+	uint32_t	squeries;
+	uint32_t	concurrency;
+	/* Débit maximal des probes, 0 lorsqu'il n'est pas limité */
+	uint32_t	rate;
+	uint64_t	bitrate;
+	uint32_t	burst;
+	/* Délai d'attente d'une probe, plafond du délai adaptatif (ms) */
 	uint32_t	waittime;
+	/* Plancher du délai adaptatif (ms) */
+	uint32_t	min_wait;
+	/* Sauts muets consécutifs et sauts en boucle tolérés, 0 sans limite */
+	uint32_t	gap_limit;
+	uint32_t	loop_limit;
+	uint32_t	mda_confidence;
+	/* Doubletree: TTL de départ (0 sans Doubletree) et ensemble global partagé */
+	uint32_t	doubletree;
+	const char	*stop_set;
+	const char	*name_cache;
+	/* Archive binaire des traces terminées (--archive), NULL sans archive */
+	const char	*archive;
+	/* Surveillance continue (--monitor): intervalle entre deux cycles (ms), 0 sans surveillance */
+	uint32_t	monitor;
+	/* Nombre de cycles de la surveillance, 0 sans limite */
+	uint32_t	cycles;
+	/* Histogrammes des routeurs partagés entre exécutions (--histograms), NULL sinon */
+	const char	*histograms;
 	uint16_t	packet_len;
 	int			protocol;
+	/* Famille d'adresses de l'exécution, AF_INET ou AF_INET6 */
+	int			family;
 	uint32_t	local_addr;
 	int			tos;
 	char		*ifname;
-	char		dest_ip_str[INET_ADDRSTRLEN];
+	char		dest_ip_str[INET6_ADDRSTRLEN];
 	const char	*dest_host;
 };
 
+/**
+ * Exécution demandée sur la ligne de commande ou par un client du démon.
+ */
+struct tr_request {
+	struct tr_params	params;
+	char				*target;
+	const char			*targets_path;
+	/* Cibles déjà ouvertes (connexion d'un client du démon), NULL sinon */
+	FILE				*targets;
+	/* Socket d'écoute du mode démon (--daemon), NULL sinon */
+	const char			*daemon;
+	/* Code de sortie lorsque l'analyse des options arrête l'exécution */
+	int					status;
+};
+
+/**
+ * État d'une probe au sein d'une trace.
+ */
+#define TR_PROBE_IDLE		0
+#define TR_PROBE_SENT		1
+#define TR_PROBE_REPLIED	2
+#define TR_PROBE_TIMEOUT	3
+#define TR_PROBE_FAILED		4
+#define TR_PROBE_CANCELLED	5
+
+/**
+ * Les adresses sont celles de la famille IPv4, ou leur identifiant dans la
+ * table des adresses en IPv6 (voir addrtab.c). Le type de la réponse est
+ * exprimé avec les types ICMP de l'IPv4 quelle que soit la famille.
+ */
+struct tr_probe {
+	uint8_t			state;
+	uint8_t			icmp_type;
+	uint8_t			icmp_code;
+	/* La réponse provient de la destination */
+	uint8_t			reached;
+	uint16_t		port;
+	int				ret;
+	uint32_t		from;
+	struct timespec	start;
+	struct timespec	end;
+	/* Horodatages noyau (CLOCK_REALTIME), nuls lorsqu'ils sont indisponibles */
+	uint32_t		tx_key;
+	struct timespec	tx_ts;
+	struct timespec	rx_ts;
+	struct tr_timer	timer;
+};
+
+/**
+ * Une trace contient une probe par couple (ttl, numéro de probe), rangées
+ * dans l'ordre d'envoi: l'index d'une probe est (ttl - first_ttl) * nprobes + probe.
+ */
+struct tr_trace {
+	struct tr_engine	*engine;
+	struct tr_params	*params;
+	uint32_t			dst_addr;
+	/* Adresse source des probes, nécessaire à la checksum TCP */
+	uint32_t			src_addr;
+	char				*host;
+	/* Sortie de la trace, propre à chaque cible en mode multi-cibles */
+	FILE				*out;
+	char				*outbuf;
+	size_t				outlen;
+	struct tr_trace		*next_dirty;
+	int					dirty;
+	/* En attente d'un jeton du limiteur de débit */
+	struct tr_trace		*next_paced;
+	int					paced;
+	/* Affichage suspendu dans l'attente du nom d'un routeur */
+	int					resolving;
+	struct tr_probe		*probes;
+	uint32_t			nslots;
+	uint32_t			end;
+	uint32_t			next_send;
+	uint32_t			next_print;
+	uint32_t			inflight;
+	uint32_t			window;
+	uint32_t			current_ttl;
+	/* Estimation du RTT du chemin (RFC 6298), en microsecondes */
+	uint32_t			srtt;
+	uint32_t			rttvar;
+	/* État de la ligne en cours d'affichage */
+	int					hop_open;
+	uint32_t			last_addr_reached;
+	uint32_t			losses;
+	/* Arrêt anticipé: sauts muets consécutifs, sauts en boucle */
+	uint32_t			gap;
+	uint32_t			loops;
+	int					stop;
+	uint32_t			stop_addr;
+	/* Doubletree: sauts restant à sonder en arrière, et raison de l'arrêt */
+	uint32_t			back_hops;
+	uint32_t			back_probe;
+	uint32_t			back_skip_ttl;
+	uint32_t			back_stop_ttl;
+	uint32_t			back_stop_addr;
+	/**
+	 * Surveillance continue: statistiques de chaque saut, cycles terminés et
+	 * timer du prochain cycle.
+	 */
+	struct tr_hopstats	*hops;
+	/* Histogramme des RTT de chaque saut (-S, --monitor), NULL sinon */
+	struct tr_histogram	*hists;
+	uint32_t			cycle;
+	uint64_t			cycle_start;
+	struct tr_timer		cycle_timer;
+};
+
+/**
+ * Modèle de probe construit une seule fois: seuls les champs propres à chaque
+ * probe (port de destination, numéro de séquence ICMP) sont modifiés à l'envoi.
+ * Pour ICMP, `packet` contient le message complet avec un numéro de séquence
+ * nul et sa checksum, mise à jour de façon incrémentale pour chaque probe.
+ * Pour TCP, `packet` contient l'en-tête SYN sans port source ni numéro de
+ * séquence, et `tcp_sum` sa somme partielle avec la partie fixe du pseudo-en-tête.
+ */
+struct tr_template {
+	uint8_t		*packet;
+	size_t		len;
+	uint64_t	tcp_sum;
+	/* Mode sans état: somme de la charge utile et de la partie fixe du pseudo-en-tête */
+	uint64_t	payload_sum;
+	/* La checksum ICMP identifie le flux (--mda) au lieu de porter l'heure d'envoi */
+	int			flow_cksum;
+	int			family;
+};
+
+/**
+ * Mode sans état (--stateless): l'en-tête IP est construit par le programme
+ * (IP_HDRINCL). L'identifiant IP porte le TTL et le numéro de probe, la
+ * checksum UDP ou ICMP porte l'heure d'envoi en unités de TR_STATELESS_TICK_NS,
+ * deux octets de la charge utile étant ajustés pour que la checksum reste
+ * valide. Toute réponse citant la probe suffit à retrouver la probe et son RTT.
+ * L'en-tête propre à chaque probe comprend l'en-tête IP, l'en-tête UDP ou ICMP
+ * et ces deux octets.
+ */
+#define TR_STATELESS_TICK_NS	100000
+#define TR_STATELESS_HDRLEN		(sizeof(struct ip) + ICMP_MINLEN + 2)
+#define TR_PROBE_HDRMAX			32
+
+struct tr_stateless_id {
+	uint32_t	dst_addr;
+	uint8_t		ttl;
+	uint8_t		probe;
+	/* L'heure d'envoi n'est pas connue lorsque la checksum identifie le flux */
+	uint8_t		timed;
+	uint16_t	sent;
+};
+
+/**
+ * Lot de probes envoyées en un seul appel à sendmmsg(). Le TTL de chaque probe
+ * est transmis par un message de contrôle IP_TTL (IPV6_HOPLIMIT en IPv6), ce
+ * qui permet de mélanger des probes de TTL différents dans un même lot.
+ */
+#define TR_SEND_BATCH	64
+
+struct tr_sendbatch {
+	size_t				count;
+	int					fallback;
+	int					current_ttl;
+	const struct tr_template	*tmpl;
+	struct mmsghdr		msgs[TR_SEND_BATCH];
+	struct iovec		iov[TR_SEND_BATCH][2];
+	union tr_sockaddr	dst[TR_SEND_BATCH];
+	union {
+		char			buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr	align;
+	}					control[TR_SEND_BATCH];
+	uint8_t				header[TR_SEND_BATCH][TR_PROBE_HDRMAX];
+	uint32_t			tag[TR_SEND_BATCH];
+	int					ret[TR_SEND_BATCH];
+};
+
+/**
+ * Anneau de tampons préalloués dans lequel le socket de réception est vidé par
+ * lots avec recvmmsg().
+ */
+#define TR_RECV_BATCH	64
+#define TR_RECV_BUFLEN	1024
+#define TR_RECV_SOCKBUF	(1 << 20)
+
+struct tr_recvring {
+	uint8_t				*buffers;
+	struct mmsghdr		msgs[TR_RECV_BATCH];
+	struct iovec		iov[TR_RECV_BATCH];
+	union tr_sockaddr	from[TR_RECV_BATCH];
+	union {
+		char			buf[CMSG_SPACE(sizeof(struct timespec))];
+		struct cmsghdr	align;
+	}					control[TR_RECV_BATCH];
+};
+
+/**
+ * Les horodatages d'émission sont remontés par la file d'erreurs du socket
+ * d'envoi, identifiés par un compteur incrémenté à chaque envoi
+ * (SOF_TIMESTAMPING_OPT_ID). Cette table associe ce compteur à la probe.
+ */
+#define TR_TXMAP_SIZE	4096
+#define TR_TXMAP_MASK	(TR_TXMAP_SIZE - 1)
+
+/**
+ * Cible du fichier de cibles déjà en cours de trace, en attente de la fin de
+ * la trace précédente. Au-delà de TR_MAX_PENDING cibles en attente, la lecture
+ * du fichier est suspendue.
+ */
+#define TR_MAX_PENDING	1024
+
+struct tr_target {
+	char				*host;
+	uint32_t			dst_addr;
+	struct tr_target	*next;
+};
+
+/**
+ * Moteur d'envoi et de réception des probes: les réponses sont reçues via la
+ * boucle d'événements et les délais d'attente sont gérés par la roue de timers.
+ */
+struct tr_engine {
+	struct tr_params		*params;
+	int						send_sock;
+	int						recv_sock;
+	struct tr_evloop		loop;
+	struct tr_evsource		recv_source;
+	struct tr_timer_wheel	wheel;
+	/* Traces actives, indexées par adresse de destination */
+	struct tr_trace			**table;
+	uint32_t				table_mask;
+	uint32_t				nactive;
+	uint32_t				concurrency;
+	struct tr_trace			*dirty;
+	FILE					*targets;
+	/* Numéro de la dernière ligne lue du fichier de cibles */
+	uint32_t				target_line;
+	struct tr_target		*pending;
+	struct tr_target		**pending_tail;
+	uint32_t				npending;
+	/* Code de sortie, selon la raison de fin des traces */
+	int						status;
+	/**
+	 * Doubletree: couples (interface, TTL) et (interface, destination) vus par
+	 * les traces terminées.
+	 */
+	struct tr_stopset		local_stop;
+	struct tr_stopset		global_stop;
+	uint64_t				probes_sent;
+	/* Règle d'arrêt du MDA, indexée par le nombre d'interfaces vues */
+	uint32_t				mda_stop[TR_MDA_MAX_NEXTHOPS + 1];
+	struct tr_resolver		resolver;
+	struct tr_evsource		resolver_source;
+	struct tr_template		tmpl;
+	struct tr_pacer			pacer;
+	struct tr_evsource		pacer_source;
+	struct tr_trace			*paced_head;
+	struct tr_trace			*paced_tail;
+	struct tr_sendbatch		batch;
+	int						batching;
+	struct tr_recvring		ring;
+	/* Réponses TCP (SYN-ACK, RST), lues sur le socket d'envoi */
+	struct tr_recvring		tcp_ring;
+	int						tx_stamping;
+	uint32_t				tx_key;
+	struct tr_evsource		err_source;
+	struct tr_probe			*txmap[TR_TXMAP_SIZE];
+	int						filtered;
+	uint64_t				icmp_in;
+	uint64_t				rx_packets;
+	/* Sortie de l'exécution: stdout, ou la connexion d'un client du démon */
+	FILE					*out;
+	/* Sortie vers un terminal: vidée après chaque passe d'affichage */
+	int						tty;
+	struct tr_archive		archive;
+	/* Histogrammes des routeurs (--histograms), alimentés par toutes les traces */
+	struct tr_histtab		histtab;
+	/* Enregistrement --json en cours de construction, commun à toutes les traces */
+	struct tr_json			json;
+};
+
 #ifndef __APPLE__
 #define __unused __attribute__((unused))
 #endif
@@ -99,24 +466,85 @@ void	tr_perr(const char *msg);
 void	tr_warn(const char *msg);
 void	tr_bad_value(const char *key, const char *val);
 
-int		tr_params(const char *key, const char *val, int min, int max);
+int			tr_params(const char *key, const char *val, int min, int max);
+uint64_t	tr_rate_params(const char *key, const char *val);
+uint32_t	tr_time_params(const char *key, const char *val, uint32_t min, uint32_t max);
 
 int			assign_iface(int sock, uint32_t dst_addr, struct tr_params *params);
+uint32_t	get_source_ip_addr(uint32_t dst_addr);
+uint16_t	get_source_port(int sock);
 uint32_t	get_destination_ip_addr(const char *host, struct tr_params *params);
+int			get_destination_family(const char *host);
 int			set_protocol(const char* proto_str);
 int			create_socket(struct tr_params *params);
+int			tr_open_sockets(struct tr_params *params, int *send_sock, int *recv_sock);
+int			tr_set_tos(int send_sock, struct tr_params *params);
+
+void	print_trace_header(FILE *out, const char *host, uint32_t dst_addr, struct tr_params *params);
+void	print_router_name(FILE *out, uint32_t addr, const char *name);
+void	print_router_rtt(FILE *out, struct timespec start, struct timespec end);
+void	print_probe_rtt(FILE *out, struct tr_probe *probe);
+void	print_rtt_summary(FILE *out, const struct tr_histogram *hist);
+double	tr_probe_rtt(const struct tr_probe *probe);
+void	print_verbose_response(FILE *out, uint8_t *packet, size_t packet_size);
+void	print_verbose_response6(FILE *out, const struct in6_addr *from, uint8_t *packet, size_t packet_size);
+
+void	tr_json_trace(struct tr_trace *trace);
+void	tr_json_probe(struct tr_trace *trace, uint32_t ttl, uint32_t index, struct tr_probe *probe, const char *name);
+void	tr_json_hop(struct tr_trace *trace, uint32_t ttl, uint32_t sent, uint32_t lost);
+void	tr_json_skip(struct tr_trace *trace);
+void	tr_json_done(struct tr_trace *trace);
+
+int		tr_template_init(struct tr_template *tmpl, struct tr_params *params);
+void	tr_template_destroy(struct tr_template *tmpl);
+size_t	tr_template_wire_len(const struct tr_template *tmpl, struct tr_params *params);
+void	tr_template_icmp(const struct tr_template *tmpl, struct icmp *icmp_hdr, uint16_t seq);
+void	tr_template_tcp(const struct tr_template *tmpl, struct tcphdr *tcph, uint32_t src_addr, uint32_t dst_addr, uint16_t sport);
+void	tr_template_stateless(const struct tr_template *tmpl, uint8_t *header, uint32_t src_addr, uint32_t dst_addr, uint32_t ttl, uint32_t probe, uint16_t port);
+uint16_t	tr_stateless_ticks(const struct timespec *ts);
+
+void	tr_set_ttl(int sock, int family, int ttl);
+int	send_probe(int send_sock, uint32_t src_addr, uint32_t dst_addr, uint16_t current_port, const struct tr_template *tmpl, struct tr_params *params);
+void	tr_batch_init(struct tr_sendbatch *batch, const struct tr_template *tmpl);
+int		tr_batch_supported(struct tr_params *params);
+void	tr_batch_add(struct tr_sendbatch *batch, uint32_t src_addr, uint32_t dst_addr, uint32_t ttl, uint16_t current_port, uint32_t tag, struct tr_params *params);
+void	tr_batch_flush(struct tr_sendbatch *batch, int send_sock);
+
+int		tr_ring_init(struct tr_recvring *ring, int recv_sock);
+void	tr_ring_destroy(struct tr_recvring *ring);
+int		tr_ring_drain(struct tr_recvring *ring, int recv_sock);
+int		tr_ring_timestamp(struct tr_recvring *ring, int i, struct timespec *ts);
+
+int			tr_filter_attach(int recv_sock, uint32_t dst_addr, struct tr_params *params);
+int			tr_filter_attach_tcp(int tcp_sock, struct tr_params *params);
+uint64_t	tr_filter_icmp_in(int family);
+
+int		tr_timestamping_enable(int send_sock, int recv_sock);
+int		tr_txstamp_read(int send_sock, uint32_t *key, struct timespec *ts);
+int	get_response_port(struct icmp *icmp, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr);
+int	get_response_port6(struct icmp6_hdr *icmp6, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr);
+int	get_tcp_reply_port(struct tcphdr *tcph, size_t tcp_len, struct tr_params *params);
+uint32_t	tr_tcp_seq(uint16_t sport);
+uint16_t	tr_stateless_sport(void);
+int	tr_stateless_decode(struct icmp *icmp, size_t icmp_len, struct tr_params *params, struct tr_stateless_id *id);
 
-void	print_router_name(struct sockaddr *sa);
-void	print_router_rtt(struct timespec start, struct timespec end);
-void	print_verbose_response(uint8_t *packet, size_t packet_size);
+uint32_t	tr_mda_stop(uint32_t k, uint32_t confidence);
 
-uint16_t	tcp_checksum(const void *buf, size_t len);
-uint16_t	icmp_checksum(const void *buf, size_t len);
+int	trace(int send_sock, int recv_sock, uint32_t dst_addr, struct tr_params *params);
+int	trace_targets(int send_sock, int recv_sock, FILE *targets, struct tr_params *params);
 
-int	send_probe(int send_sock, uint32_t dst_addr, uint16_t current_port, struct tr_params *params);
-int	is_valid_response(struct icmp *icmp, uint32_t current_port, struct tr_params *params);
+void	tr_request_init(struct tr_request *req);
+int		tr_request_parse(struct tr_request *req, int argc, char **argv);
+int		tr_request_run(struct tr_request *req, int send_sock, int recv_sock);
+int		tr_daemon_run(struct tr_request *req);
 
 void	check_privileges(void);
+int		tr_user_open(const char *path, int flags, mode_t mode);
+FILE	*tr_user_fopen(const char *path, const char *mode);
 int		get_max_ttl(void);
+void	tr_session_set(FILE *out, FILE *err, uint16_t ident);
+FILE	*tr_out(void);
+FILE	*tr_errout(void);
+uint16_t	tr_ident(void);
 
 #endif /* TRACEROUTE_H */
\ No newline at end of file
@@ -24,7 +24,7 @@ _assign_iface(int sock, struct tr_params *params)
 	(void)getifaddrs(&ifap);
 	for (ifa = ifap; ifa; ifa = ifa->ifa_next)
 	{
-		if (ifa->ifa_addr->sa_family == AF_INET && (ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING) && strcmp(ifa->ifa_name, params->ifname) == 0)
+		if (ifa->ifa_addr && ifa->ifa_addr->sa_family == params->family && (ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING) && strcmp(ifa->ifa_name, params->ifname) == 0)
 		{
 			break;
 		}
@@ -42,13 +42,60 @@ _assign_iface(int sock, struct tr_params *params)
 		return (1);
 	}
 
-	struct sockaddr_in *sa = (struct sockaddr_in *)ifa->ifa_addr;
-	params->local_addr = sa->sin_addr.s_addr;
+	params->local_addr = tr_sockaddr_addr((union tr_sockaddr *)ifa->ifa_addr);
 
 	freeifaddrs(ifap);
 	return (0);
 }
 
+/**
+ * Retourne l'adresse IP locale utilisée pour joindre `dst_addr`, 0 si elle ne
+ * peut être déterminée.
+ */
+uint32_t
+get_source_ip_addr(uint32_t dst_addr)
+{
+	/**
+	 * Notre programme nécessite de connaître l'adresse IP locale utilisée
+	 * pour envoyer des paquets vers la destination, afin de construire
+	 * des en-têtes IP appropriés.
+	 * 
+	 * Pour cela, on crée un socket UDP temporaire et on se connecte
+	 * à l'adresse de destination. Cela permet au système d'exploitation
+	 * de déterminer l'adresse IP locale à utiliser pour l'envoi des paquets
+	 * ainsi que l'interface réseau correspondante.
+	 */
+
+	int sock = socket(tr_addr_family(), SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0)
+	{
+		tr_perr("socket");
+		return (0);
+	}
+
+	union tr_sockaddr dst;
+	socklen_t dst_len = tr_sockaddr_set(&dst, dst_addr, 53);
+
+	if (connect(sock, &dst.sa, dst_len) < 0)
+	{
+		tr_perr("connect");
+		(void)close(sock);
+		return (0);
+	}
+
+	union tr_sockaddr local;
+	socklen_t len = sizeof(local);
+	if (getsockname(sock, &local.sa, &len) < 0)
+	{
+		tr_perr("getsockname");
+		(void)close(sock);
+		return (0);
+	}
+
+	(void)close(sock);
+	return (tr_sockaddr_addr(&local));
+}
+
 int
 assign_iface(int sock, uint32_t dst_addr, struct tr_params *params)
 {
@@ -60,49 +107,7 @@ assign_iface(int sock, uint32_t dst_addr, struct tr_params *params)
 	}
 	else if (!params->ifname)
 	{
-		/**
-		 * Notre programme nécessite de connaître l'adresse IP locale utilisée
-		 * pour envoyer des paquets vers la destination, afin de construire
-		 * des en-têtes IP appropriés.
-		 * 
-		 * Pour cela, on crée un socket UDP temporaire et on se connecte
-		 * à l'adresse de destination. Cela permet au système d'exploitation
-		 * de déterminer l'adresse IP locale à utiliser pour l'envoi des paquets
-		 * ainsi que l'interface réseau correspondante.
-		 */
-
-		int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-		if (sock < 0)
-		{
-			tr_perr("socket");
-			return (0);
-		}
-
-		struct sockaddr_in dst;
-		memset(&dst, 0, sizeof(dst));
-		dst.sin_family = AF_INET;
-		dst.sin_port = htons(53);
-		dst.sin_addr.s_addr = dst_addr;
-
-		if (connect(sock, (struct sockaddr *)&dst, sizeof(dst)) < 0)
-		{
-			tr_perr("connect");
-			(void)close(sock);
-			return (0);
-		}
-
-		struct sockaddr_in local;
-		socklen_t len = sizeof(local);
-		if (getsockname(sock, (struct sockaddr *)&local, &len) < 0)
-		{
-			tr_perr("getsockname");
-			(void)close(sock);
-			return (0);
-		}
-
-		params->local_addr = local.sin_addr.s_addr;
-
-		(void)close(sock);
+		params->local_addr = get_source_ip_addr(dst_addr);
 	}
 
 	/**
@@ -116,12 +121,13 @@ assign_iface(int sock, uint32_t dst_addr, struct tr_params *params)
 		(void)getifaddrs(&ifap);
 		for (ifa = ifap; ifa; ifa = ifa->ifa_next)
 		{
-			if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET)
+			if (ifa->ifa_addr && ifa->ifa_addr->sa_family == params->family)
 			{
-				struct sockaddr_in *sa = (struct sockaddr_in *)ifa->ifa_addr;
-				if (sa->sin_addr.s_addr == params->local_addr)
+				union tr_sockaddr *sa = (union tr_sockaddr *)ifa->ifa_addr;
+				uint32_t addr = params->family == AF_INET6 ? tr_addr_find(&sa->sin6.sin6_addr) : sa->sin.sin_addr.s_addr;
+				if (addr && addr == params->local_addr)
 				{
-					printf("Using interface: %s\n", ifa->ifa_name);
+					(void)fprintf(tr_out(), "Using interface: %s\n", ifa->ifa_name);
 				}
 			}
 		}
@@ -132,46 +138,119 @@ assign_iface(int sock, uint32_t dst_addr, struct tr_params *params)
 	return (0);
 }
 
+/**
+ * Retourne le port source d'un socket UDP, en le liant à un port éphémère s'il
+ * ne l'est pas encore, 0 s'il ne peut être déterminé.
+ */
+uint16_t
+get_source_port(int sock)
+{
+	union tr_sockaddr local;
+	socklen_t len = sizeof(local);
+
+	if (getsockname(sock, &local.sa, &len) < 0)
+	{
+		tr_perr("getsockname");
+		return (0);
+	}
+
+	in_port_t port = local.sa.sa_family == AF_INET6 ? local.sin6.sin6_port : local.sin.sin_port;
+	if (port)
+		return (ntohs(port));
+
+	// Sans bind() explicite, le port ne serait attribué qu'au premier envoi
+	sa_family_t family = local.sa.sa_family;
+	memset(&local, 0, sizeof(local));
+	local.sa.sa_family = family;
+	if (bind(sock, &local.sa, len) < 0 || getsockname(sock, &local.sa, &len) < 0)
+	{
+		tr_perr("bind");
+		return (0);
+	}
+	return (ntohs(family == AF_INET6 ? local.sin6.sin6_port : local.sin.sin_port));
+}
+
+/**
+ * Retourne l'adresse de destination dans la famille de l'exécution (l'adresse
+ * IPv4, ou l'identifiant de l'adresse IPv6), 0 si l'hôte ne peut être résolu.
+ */
 uint32_t
 get_destination_ip_addr(const char *host, struct tr_params *params)
 {
-	(void)params;
-
-	struct in_addr in;
+	struct addrinfo hints;
+	struct addrinfo *res;
+	uint32_t addr;
 
 	// Sauvegarde le nom d'hôte dans les paramètres
 	params->dest_host = host;
 
 	/**
-	 * On tente d'abord de convertir l'hôte en adresse IP directement.
-	 * Si cela échoue, on effectue une résolution DNS sur le nom d'hôte.
+	 * getaddrinfo() convertit directement une adresse littérale et n'effectue
+	 * une résolution DNS que pour un nom d'hôte. Le type de socket évite que
+	 * chaque adresse soit retournée une fois par protocole.
 	 */
-	if (inet_pton(AF_INET, host, &in) == 0)
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = params->family;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, NULL, &hints, &res) != 0)
+		return (0);
+
+	union tr_sockaddr *sa = (union tr_sockaddr *)res->ai_addr;
+	if (params->family == AF_INET6)
 	{
-		struct hostent *hostent = gethostbyname(host);
-		if (hostent == NULL || hostent->h_addr_list[0] == NULL)
-		{
-			return 0;
-		}
+		addr = tr_addr_intern(&sa->sin6.sin6_addr);
+		(void)inet_ntop(AF_INET6, &sa->sin6.sin6_addr, params->dest_ip_str, sizeof(params->dest_ip_str));
+	}
+	else
+	{
+		addr = sa->sin.sin_addr.s_addr;
+		(void)inet_ntop(AF_INET, &sa->sin.sin_addr, params->dest_ip_str, sizeof(params->dest_ip_str));
+	}
 
-		// Conversion de l'adresse IP binaire en chaîne de caractères
-		(void)inet_ntop(AF_INET, hostent->h_addr_list[0], params->dest_ip_str, sizeof(params->dest_ip_str));
+	/**
+	 * L'implémentation de traceroute de BSD avertit lorsque
+	 * plusieurs adresses IP sont associées à un nom d'hôte et
+	 * ne prend que la première adresse.
+	 */
+	if (res->ai_next != NULL)
+	{
+		(void)fprintf(tr_errout(), TR_PREFIX": Warning: %s has multiple addresses; using %s\n", host, params->dest_ip_str);
+	}
+
+	freeaddrinfo(res);
+	return (addr);
+}
+
+/**
+ * Famille d'adresses à utiliser pour tracer `host` lorsqu'elle n'est pas imposée
+ * par -4 ou -6: celle d'une adresse littérale, sinon l'IPv4 dès que le nom en a
+ * une. Retourne AF_UNSPEC si l'hôte ne peut être résolu.
+ */
+int
+get_destination_family(const char *host)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	int family = AF_UNSPEC;
 
-		/**
-		 * L'implémentation de traceroute de BSD avertit lorsque
-		 * plusieurs adresses IP sont associées à un nom d'hôte et
-		 * ne prend que la première adresse.
-		 */
-		if (hostent->h_addr_list[1] != NULL)
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, NULL, &hints, &res) != 0)
+		return (AF_UNSPEC);
+
+	for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+	{
+		if (ai->ai_family == AF_INET)
 		{
-			(void)fprintf(stderr, TR_PREFIX": Warning: %s has multiple addresses; using %s\n", host, params->dest_ip_str);
+			family = AF_INET;
+			break;
 		}
-
-		char **addr = hostent->h_addr_list;
-		memcpy(&in, *addr, sizeof(struct in_addr));
+		if (ai->ai_family == AF_INET6)
+			family = AF_INET6;
 	}
-
-	return (in.s_addr);
+	freeaddrinfo(res);
+	return (family);
 }
 
 int
@@ -182,10 +261,7 @@ set_protocol(const char* proto_str)
 	else if (strcmp(proto_str, "icmp") == 0 || strcmp(proto_str, "ICMP") == 0)
 		return (TR_PROTO_ICMP);
 	else if (strcmp(proto_str, "tcp") == 0 || strcmp(proto_str, "TCP") == 0)
-	{
-		tr_err("TCP protocol not implemented");
-		return (0);
-	}
+		return (TR_PROTO_TCP);
 	else if (strcmp(proto_str, "gre") == 0 || strcmp(proto_str, "GRE") == 0)
 	{
 		tr_err("GRE protocol not implemented");
@@ -206,6 +282,18 @@ create_socket(struct tr_params *params)
 	 * entrantes, y compris celles émises et destinées à d'autres processus, cela
 	 * nécessite des privilèges d'administrateur.
 	 */
+	// IPPROTO_RAW implique IP_HDRINCL: l'en-tête IP est fourni avec chaque probe
+	if (params->flags & TR_FLAG_STATELESS)
+		return (socket(AF_INET, SOCK_RAW, IPPROTO_RAW));
+
+	// Seules les probes UDP et ICMP sont disponibles en IPv6
+	if (params->family == AF_INET6)
+	{
+		if (params->protocol == TR_PROTO_ICMP)
+			return (socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6));
+		return (socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP));
+	}
+
 	switch (params->protocol)
 	{
 	case TR_PROTO_UDP:
@@ -220,3 +308,71 @@ create_socket(struct tr_params *params)
 		return (-1);
 	}
 }
+
+/**
+ * Crée les sockets d'envoi et de réception d'une exécution et leur applique
+ * les options de la ligne de commande (-d, -r, -t).
+ */
+int
+tr_open_sockets(struct tr_params *params, int *send_sock, int *recv_sock)
+{
+	int on = 1;
+
+	*send_sock = create_socket(params);
+	if (*send_sock < 0)
+	{
+		tr_perr("socket");
+		return (-1);
+	}
+	*recv_sock = params->family == AF_INET6 ? socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6) : socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+	if (*recv_sock < 0)
+	{
+		tr_perr("socket");
+		(void)close(*send_sock);
+		return (-1);
+	}
+
+	if (params->flags & TR_FLAG_DEBUG)
+	{
+		(void)setsockopt(*send_sock, SOL_SOCKET, SO_DEBUG, &on, sizeof(on));
+		(void)setsockopt(*recv_sock, SOL_SOCKET, SO_DEBUG, &on, sizeof(on));
+	}
+	if (params->flags & TR_FLAG_NOROUTE)
+	{
+		(void)setsockopt(*send_sock, IPPROTO_IP, SO_DONTROUTE, &on, sizeof(on));
+		(void)setsockopt(*recv_sock, IPPROTO_IP, SO_DONTROUTE, &on, sizeof(on));
+	}
+	if (tr_set_tos(*send_sock, params))
+	{
+		(void)close(*send_sock);
+		(void)close(*recv_sock);
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * Applique la valeur -t au socket d'envoi: l'octet Traffic Class en IPv6 remplace
+ * le champ TOS de l'en-tête IPv4. Sans -t, la valeur par défaut du système (0)
+ * est rétablie, le socket pouvant avoir servi à une requête précédente du démon.
+ */
+int
+tr_set_tos(int send_sock, struct tr_params *params)
+{
+	int tos = params->tos >= 0 ? params->tos : 0;
+
+	if (params->family == AF_INET6)
+	{
+		if (setsockopt(send_sock, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)) < 0)
+		{
+			tr_perr("setsockopt IPV6_TCLASS");
+			return (-1);
+		}
+	}
+	else if (setsockopt(send_sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0)
+	{
+		tr_perr("setsockopt IP_TOS");
+		return (-1);
+	}
+	return (0);
+}
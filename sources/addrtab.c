@@ -0,0 +1,206 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   addrtab.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/22 10:15:37 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/22 10:15:37 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "addrtab.h"
+
+/**
+ * NOTE:
+ * Les traces, les probes, le cache des traces actives, le résolveur et les
+ * ensembles d'arrêt manipulent des adresses de 32 bits. Plutôt que d'élargir
+ * chacune de ces structures à 16 octets, une exécution en IPv6 remplace chaque
+ * adresse par son identifiant dans cette table: les comparaisons, les tables de
+ * hachage et la taille des probes restent celles de l'IPv4, et l'adresse
+ * complète n'est consultée que pour envoyer une probe ou afficher un routeur.
+ * Une exécution ne trace qu'une famille d'adresses, la table est donc unique
+ * pour chaque thread: les requêtes simultanées du démon ont chacune la leur.
+ */
+
+static __thread struct tr_addrtab addrtab = { .family = AF_INET };
+
+static inline uint32_t
+addrtab_hash(const struct in6_addr *addr, uint32_t mask)
+{
+	uint64_t hi, lo;
+
+	memcpy(&hi, addr->s6_addr, sizeof(hi));
+	memcpy(&lo, addr->s6_addr + 8, sizeof(lo));
+	return ((uint32_t)(((hi * 0x9E3779B97F4A7C15ULL) ^ lo) * 0x9E3779B97F4A7C15ULL >> 32) & mask);
+}
+
+/**
+ * Prépare la table pour la famille d'adresses de l'exécution: en IPv4 les
+ * adresses sont utilisées directement et la table reste vide.
+ */
+int
+tr_addrtab_init(int family)
+{
+	tr_addrtab_destroy();
+	addrtab.family = family;
+	if (family != AF_INET6)
+		return (0);
+
+	addrtab.capacity = TR_ADDRTAB_MIN_SIZE / 2;
+	addrtab.mask = TR_ADDRTAB_MIN_SIZE - 1;
+	addrtab.addrs = malloc(addrtab.capacity * sizeof(struct in6_addr));
+	addrtab.index = calloc(TR_ADDRTAB_MIN_SIZE, sizeof(uint32_t));
+	if (addrtab.addrs == NULL || addrtab.index == NULL)
+	{
+		tr_perr("malloc");
+		tr_addrtab_destroy();
+		return (-1);
+	}
+	return (0);
+}
+
+void
+tr_addrtab_destroy(void)
+{
+	free(addrtab.addrs);
+	free(addrtab.index);
+	memset(&addrtab, 0, sizeof(addrtab));
+	addrtab.family = AF_INET;
+}
+
+int
+tr_addr_family(void)
+{
+	return (addrtab.family);
+}
+
+/**
+ * Double la capacité de la table, l'index restant rempli au plus à moitié.
+ */
+static int
+addrtab_grow(void)
+{
+	uint32_t size = (addrtab.mask + 1) * 2;
+	struct in6_addr *addrs = realloc(addrtab.addrs, size / 2 * sizeof(struct in6_addr));
+	if (addrs == NULL)
+		return (-1);
+	addrtab.addrs = addrs;
+
+	uint32_t *index = calloc(size, sizeof(uint32_t));
+	if (index == NULL)
+		return (-1);
+	for (uint32_t id = 1; id <= addrtab.count; ++id)
+	{
+		uint32_t i = addrtab_hash(&addrtab.addrs[id - 1], size - 1);
+		while (index[i])
+			i = (i + 1) & (size - 1);
+		index[i] = id;
+	}
+	free(addrtab.index);
+	addrtab.index = index;
+	addrtab.mask = size - 1;
+	addrtab.capacity = size / 2;
+	return (0);
+}
+
+/**
+ * Retourne l'identifiant d'une adresse, 0 si elle n'a jamais été enregistrée.
+ */
+uint32_t
+tr_addr_find(const struct in6_addr *addr)
+{
+	if (addrtab.index == NULL)
+		return (0);
+
+	uint32_t i = addrtab_hash(addr, addrtab.mask);
+	while (addrtab.index[i])
+	{
+		uint32_t id = addrtab.index[i];
+		if (memcmp(&addrtab.addrs[id - 1], addr, sizeof(*addr)) == 0)
+			return (id);
+		i = (i + 1) & addrtab.mask;
+	}
+	return (0);
+}
+
+/**
+ * Retourne l'identifiant d'une adresse en l'enregistrant au besoin, 0 si la
+ * table ne peut pas être agrandie.
+ */
+uint32_t
+tr_addr_intern(const struct in6_addr *addr)
+{
+	uint32_t id = tr_addr_find(addr);
+	if (id || addrtab.index == NULL)
+		return (id);
+
+	if (addrtab.count == addrtab.capacity && addrtab_grow())
+		return (0);
+
+	addrtab.addrs[addrtab.count] = *addr;
+	id = ++addrtab.count;
+
+	uint32_t i = addrtab_hash(addr, addrtab.mask);
+	while (addrtab.index[i])
+		i = (i + 1) & addrtab.mask;
+	addrtab.index[i] = id;
+	return (id);
+}
+
+/**
+ * Adresse correspondant à un identifiant. Le pointeur n'est valable que jusqu'au
+ * prochain enregistrement, la table pouvant être déplacée en s'agrandissant.
+ */
+const struct in6_addr *
+tr_addr_get(uint32_t id)
+{
+	if (id == 0 || id > addrtab.count)
+		return (&in6addr_any);
+	return (&addrtab.addrs[id - 1]);
+}
+
+/**
+ * Forme textuelle d'une adresse IPv4, ou de l'adresse IPv6 d'un identifiant.
+ */
+const char *
+tr_addr_ntop(uint32_t addr, char *buf, size_t len)
+{
+	if (addrtab.family == AF_INET6)
+		return (inet_ntop(AF_INET6, tr_addr_get(addr), buf, len));
+	return (inet_ntop(AF_INET, &addr, buf, len));
+}
+
+/**
+ * Remplit l'adresse de socket d'une destination et retourne sa taille.
+ */
+socklen_t
+tr_sockaddr_set(union tr_sockaddr *sa, uint32_t addr, uint16_t port)
+{
+	memset(sa, 0, sizeof(*sa));
+	if (addrtab.family == AF_INET6)
+	{
+		sa->sin6.sin6_family = AF_INET6;
+		sa->sin6.sin6_addr = *tr_addr_get(addr);
+		sa->sin6.sin6_port = htons(port);
+		return (sizeof(sa->sin6));
+	}
+	sa->sin.sin_family = AF_INET;
+	sa->sin.sin_addr.s_addr = addr;
+	sa->sin.sin_port = htons(port);
+	return (sizeof(sa->sin));
+}
+
+/**
+ * Adresse de 32 bits de l'émetteur d'une trame: l'adresse IPv4 elle-même, ou
+ * l'identifiant de l'adresse IPv6.
+ */
+uint32_t
+tr_sockaddr_addr(const union tr_sockaddr *sa)
+{
+	if (sa->sa.sa_family == AF_INET6)
+		return (tr_addr_intern(&sa->sin6.sin6_addr));
+	return (sa->sin.sin_addr.s_addr);
+}
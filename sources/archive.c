@@ -0,0 +1,300 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   archive.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/24 10:30:52 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/24 10:30:52 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "archive.h"
+
+static inline uint64_t
+ts_us(const struct timespec *ts)
+{
+	return ((uint64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000);
+}
+
+/**
+ * Adresse sur 16 octets: l'adresse IPv6 d'un identifiant, ou l'adresse IPv4
+ * sous la forme ::ffff:a.b.c.d.
+ */
+static void
+archive_addr(uint8_t *out, uint32_t addr)
+{
+	if (tr_addr_family() == AF_INET6)
+	{
+		memcpy(out, tr_addr_get(addr), TR_ARCHIVE_ADDRLEN);
+		return;
+	}
+	memset(out, 0, 10);
+	out[10] = 0xFF;
+	out[11] = 0xFF;
+	memcpy(out + 12, &addr, sizeof(addr));
+}
+
+int
+tr_archive_open(struct tr_archive *ar, const char *path, const struct tr_params *params)
+{
+	struct tr_archive_header header;
+	struct timespec real, mono;
+
+	memset(ar, 0, sizeof(*ar));
+	ar->path = path;
+	// Un lien symbolique placé à la place de l'archive n'est pas suivi
+	int fd = tr_user_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+	if (fd < 0 || (ar->fp = fdopen(fd, "w")) == NULL)
+	{
+		tr_perr(path);
+		if (fd >= 0)
+			(void)close(fd);
+		return (-1);
+	}
+
+	(void)clock_gettime(CLOCK_REALTIME, &real);
+	(void)clock_gettime(CLOCK_MONOTONIC, &mono);
+	ar->clock_offset_us = (int64_t)(ts_us(&real) - ts_us(&mono));
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TR_ARCHIVE_MAGIC, sizeof(header.magic));
+	header.version = TR_ARCHIVE_VERSION;
+	header.endian = TR_ARCHIVE_ENDIAN;
+	header.family = params->family == AF_INET6 ? 6 : 4;
+	header.protocol = params->protocol;
+	header.nprobes = params->nprobes;
+	header.packet_len = params->packet_len;
+	header.tos = params->tos;
+	header.first_ttl = params->first_ttl;
+	header.max_ttl = params->max_ttl;
+	header.flags = params->flags;
+	header.created_us = ts_us(&real);
+
+	if (fwrite(&header, sizeof(header), 1, ar->fp) != 1)
+	{
+		tr_perr(path);
+		(void)fclose(ar->fp);
+		ar->fp = NULL;
+		return (-1);
+	}
+	ar->offset = sizeof(header);
+	return (0);
+}
+
+/**
+ * Prépare le tampon et la table des adresses pour un bloc de `nrecords` probes.
+ */
+static int
+archive_reserve(struct tr_archive *ar, size_t size, uint32_t nrecords)
+{
+	if (size > ar->bufsize)
+	{
+		uint8_t *buf = realloc(ar->buf, size);
+		if (buf == NULL)
+			return (-1);
+		ar->buf = buf;
+		ar->bufsize = size;
+	}
+
+	uint32_t slots = TR_ARCHIVE_MIN_SLOTS;
+	while (slots < nrecords * 2)
+		slots <<= 1;
+	if (slots > ar->mask + 1)
+	{
+		uint32_t *keys = realloc(ar->keys, slots * sizeof(uint32_t));
+		if (keys == NULL)
+			return (-1);
+		ar->keys = keys;
+		uint16_t *ranks = realloc(ar->ranks, slots * sizeof(uint16_t));
+		if (ranks == NULL)
+			return (-1);
+		ar->ranks = ranks;
+		ar->mask = slots - 1;
+	}
+	memset(ar->keys, 0, (ar->mask + 1) * sizeof(uint32_t));
+	return (0);
+}
+
+/**
+ * Rang de l'adresse dans la table du bloc, ajoutée à la suite de `addrs` lors
+ * de sa première rencontre.
+ */
+static uint16_t
+archive_intern(struct tr_archive *ar, uint32_t addr, uint8_t *addrs, uint16_t *naddrs)
+{
+	uint32_t i = (ntohl(addr) * 2654435761u) & ar->mask;
+
+	while (ar->keys[i] && ar->keys[i] != addr)
+		i = (i + 1) & ar->mask;
+	if (ar->keys[i] == 0)
+	{
+		ar->keys[i] = addr;
+		ar->ranks[i] = ++(*naddrs);
+		archive_addr(addrs + (*naddrs - 1) * TR_ARCHIVE_ADDRLEN, addr);
+	}
+	return (ar->ranks[i]);
+}
+
+static void
+archive_fail(struct tr_archive *ar)
+{
+	tr_perr(ar->path);
+	(void)fclose(ar->fp);
+	ar->fp = NULL;
+}
+
+/**
+ * Ajoute le bloc d'une trace terminée. Les probes sont rangées dans l'ordre des
+ * sauts, comme à l'affichage; leur heure d'envoi est codée par l'écart avec la
+ * probe précédente, qui peut être négatif lorsque les sauts ne sont pas sondés
+ * dans l'ordre (Doubletree).
+ */
+int
+tr_archive_trace(struct tr_archive *ar, const struct tr_trace *trace)
+{
+	uint32_t nrecords = 0;
+
+	if (ar->fp == NULL)
+		return (-1);
+
+	for (uint32_t i = 0; i < trace->end; ++i)
+	{
+		int state = trace->probes[i].state;
+		nrecords += state == TR_PROBE_REPLIED || state == TR_PROBE_TIMEOUT || state == TR_PROBE_FAILED;
+	}
+
+	size_t hostlen = trace->host ? strnlen(trace->host, UINT16_MAX) : 0;
+	size_t records_off = sizeof(struct tr_archive_block) + tr_archive_pad(hostlen);
+	size_t addrs_off = records_off + nrecords * sizeof(struct tr_archive_record);
+	// Au plus une adresse par probe, la table est copiée à la suite des probes
+	size_t size = addrs_off + 2 * (size_t)nrecords * TR_ARCHIVE_ADDRLEN;
+	if (archive_reserve(ar, size, nrecords))
+	{
+		archive_fail(ar);
+		return (-1);
+	}
+
+	if (ar->count == ar->capacity)
+	{
+		uint32_t capacity = ar->capacity ? ar->capacity * 2 : 64;
+		struct tr_archive_index *index = realloc(ar->index, capacity * sizeof(struct tr_archive_index));
+		if (index == NULL)
+		{
+			archive_fail(ar);
+			return (-1);
+		}
+		ar->index = index;
+		ar->capacity = capacity;
+	}
+
+	struct tr_archive_block *block = (struct tr_archive_block *)ar->buf;
+	struct tr_archive_record *record = (struct tr_archive_record *)(ar->buf + records_off);
+	uint8_t *addrs = ar->buf + addrs_off + nrecords * TR_ARCHIVE_ADDRLEN;
+	uint16_t naddrs = 0;
+	uint64_t prev_us = 0;
+	uint64_t end_us = 0;
+	uint32_t n = 0;
+
+	memset(ar->buf, 0, records_off);
+	if (hostlen)
+		memcpy(ar->buf + sizeof(*block), trace->host, hostlen);
+
+	for (uint32_t i = 0; i < trace->end; ++i)
+	{
+		const struct tr_probe *probe = &trace->probes[i];
+		if (probe->state != TR_PROBE_REPLIED && probe->state != TR_PROBE_TIMEOUT && probe->state != TR_PROBE_FAILED)
+			continue;
+
+		uint64_t sent_us = ts_us(&probe->start) + ar->clock_offset_us;
+		if (n++ == 0)
+			block->start_us = prev_us = sent_us;
+
+		int64_t delta = (int64_t)(sent_us - prev_us);
+		record->delta_us = delta > INT32_MAX ? INT32_MAX : delta < INT32_MIN ? INT32_MIN : (int32_t)delta;
+		prev_us += record->delta_us;
+		record->ttl = i / trace->params->nprobes + trace->params->first_ttl;
+		record->probe = i % trace->params->nprobes;
+		record->rtt_us = TR_ARCHIVE_NO_RTT;
+		record->addr = 0;
+		record->icmp_type = probe->icmp_type;
+		record->icmp_code = probe->icmp_code;
+		record->reached = probe->reached;
+		if (probe->state == TR_PROBE_REPLIED)
+		{
+			double rtt = tr_probe_rtt(probe) * 1000.0;
+			record->state = TR_ARCHIVE_REPLY;
+			record->rtt_us = rtt < 0 ? 0 : rtt >= TR_ARCHIVE_NO_RTT ? TR_ARCHIVE_NO_RTT - 1 : (uint32_t)rtt;
+			if (probe->from)
+				record->addr = archive_intern(ar, probe->from, addrs, &naddrs);
+			if (sent_us + record->rtt_us > end_us)
+				end_us = sent_us + record->rtt_us;
+		}
+		else
+			record->state = probe->state == TR_PROBE_TIMEOUT ? TR_ARCHIVE_TIMEOUT : TR_ARCHIVE_ERROR;
+		if (sent_us > end_us)
+			end_us = sent_us;
+		record++;
+	}
+
+	// La table des adresses est rapprochée des probes
+	memmove(ar->buf + addrs_off, addrs, naddrs * TR_ARCHIVE_ADDRLEN);
+	size = addrs_off + naddrs * TR_ARCHIVE_ADDRLEN;
+
+	block->magic = TR_ARCHIVE_BLOCK_MAGIC;
+	block->size = size;
+	archive_addr(block->dst, trace->dst_addr);
+	block->naddrs = naddrs;
+	block->hostlen = hostlen;
+	block->nrecords = nrecords;
+	block->stop = trace->stop;
+
+	if (fwrite(ar->buf, size, 1, ar->fp) != 1)
+	{
+		archive_fail(ar);
+		return (-1);
+	}
+
+	struct tr_archive_index *entry = &ar->index[ar->count++];
+	memset(entry, 0, sizeof(*entry));
+	entry->offset = ar->offset;
+	entry->start_us = block->start_us;
+	entry->end_us = end_us;
+	memcpy(entry->dst, block->dst, TR_ARCHIVE_ADDRLEN);
+	entry->size = size;
+	entry->stop = block->stop;
+	ar->offset += size;
+	return (0);
+}
+
+/**
+ * Écrit l'index des blocs et ferme l'archive.
+ */
+void
+tr_archive_close(struct tr_archive *ar)
+{
+	if (ar->fp)
+	{
+		struct tr_archive_trailer trailer = {
+			.index_offset = ar->offset,
+			.count = ar->count,
+			.magic = TR_ARCHIVE_INDEX_MAGIC,
+		};
+		if ((ar->count && fwrite(ar->index, sizeof(struct tr_archive_index), ar->count, ar->fp) != ar->count)
+			|| fwrite(&trailer, sizeof(trailer), 1, ar->fp) != 1)
+			tr_perr(ar->path);
+		if (fclose(ar->fp) != 0)
+			tr_perr(ar->path);
+		ar->fp = NULL;
+	}
+	free(ar->buf);
+	free(ar->keys);
+	free(ar->ranks);
+	free(ar->index);
+	ar->buf = NULL;
+	ar->keys = NULL;
+	ar->ranks = NULL;
+	ar->index = NULL;
+}
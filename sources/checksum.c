@@ -6,47 +6,194 @@
 /*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/10/19 21:51:42 by mgama             #+#    #+#             */
-/*   Updated: 2025/10/20 11:17:32 by mgama            ###   ########.fr       */
+/*   Updated: 2025/11/18 10:05:19 by mgama            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "traceroute.h"
+#include "checksum.h"
+
+#ifdef TR_CSUM_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * NOTE:
+ * Checksum Internet (RFC 1071), commune à tous les protocoles: la somme en
+ * complément à un des mots de 16 bits du message, complémentée. Cette somme a
+ * deux propriétés utilisées ici:
+ * - elle ne dépend pas de l'ordre des octets, les mots sont donc lus dans
+ *   l'ordre de la machine;
+ * - elle peut être calculée sur des mots plus larges puis repliée: les mots de
+ *   32 bits sont accumulés dans des compteurs de 64 bits, sans retenue à
+ *   propager pendant la boucle. Les versions SSE2 et AVX2 accumulent ainsi 2 ou
+ *   4 mots en parallèle par registre.
+ * L'implémentation est choisie au premier appel selon les capacités du
+ * processeur, la version portable étant utilisée sur les autres architectures.
+ */
 
 uint16_t
-tcp_checksum(const void *buf, size_t len)
+inet_csum_fold(uint64_t sum)
+{
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return ((uint16_t)sum);
+}
+
+uint64_t
+inet_csum_scalar(const void *buf, size_t len)
 {
-	const uint16_t *data = buf;
-	uint32_t sum = 0;
+	const uint8_t *data = buf;
+	uint64_t sum = 0;
+	uint32_t word32;
+	uint16_t word16;
 
-	while (len > 1) {
-		sum += *data++;
+	while (len >= 4)
+	{
+		memcpy(&word32, data, 4);
+		sum += word32;
+		data += 4;
+		len -= 4;
+	}
+	if (len >= 2)
+	{
+		memcpy(&word16, data, 2);
+		sum += word16;
+		data += 2;
 		len -= 2;
 	}
-	if (len == 1) {
-		sum += *(const uint8_t *)data;
+	// Un octet isolé est complété par un octet nul, dans l'ordre du message
+	if (len == 1)
+	{
+		word16 = 0;
+		*(uint8_t *)&word16 = *data;
+		sum += word16;
 	}
-	while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
-	return (uint16_t)(~sum & 0xFFFF);
+	return (sum);
 }
 
-uint16_t
-icmp_checksum(const void *data, size_t len)
+#ifdef TR_CSUM_X86
+
+__attribute__((target("sse2")))
+uint64_t
+inet_csum_sse2(const void *buf, size_t len)
 {
-	const uint16_t *ptr = data;
-	uint32_t sum = 0;
-	size_t nleft = len;
+	const uint8_t *data = buf;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc_lo = _mm_setzero_si128();
+	__m128i acc_hi = _mm_setzero_si128();
 
-	while (nleft > 1) {
-		sum += *ptr++;
-		nleft -= 2;
+	for (; len >= 16; data += 16, len -= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)data);
+		acc_lo = _mm_add_epi64(acc_lo, _mm_unpacklo_epi32(v, zero));
+		acc_hi = _mm_add_epi64(acc_hi, _mm_unpackhi_epi32(v, zero));
 	}
 
-	if (nleft == 1) {
-		uint16_t odd_byte = 0;
-		*(uint8_t *)&odd_byte = *(const uint8_t *)ptr;
-		sum += odd_byte;
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc_lo, acc_hi));
+
+	/**
+	 * Les compteurs ne dépassent 32 bits qu'après des milliers de mots: on les
+	 * replie avant de les additionner pour ne pas perdre de retenue.
+	 */
+	uint64_t sum = (lanes[0] & 0xFFFFFFFF) + (lanes[0] >> 32) + (lanes[1] & 0xFFFFFFFF) + (lanes[1] >> 32);
+	return (sum + inet_csum_scalar(data, len));
+}
+
+__attribute__((target("avx2")))
+uint64_t
+inet_csum_avx2(const void *buf, size_t len)
+{
+	const uint8_t *data = buf;
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc_lo = _mm256_setzero_si256();
+	__m256i acc_hi = _mm256_setzero_si256();
+
+	for (; len >= 32; data += 32, len -= 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)data);
+		acc_lo = _mm256_add_epi64(acc_lo, _mm256_unpacklo_epi32(v, zero));
+		acc_hi = _mm256_add_epi64(acc_hi, _mm256_unpackhi_epi32(v, zero));
 	}
 
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc_lo, acc_hi));
+
+	uint64_t sum = 0;
+	for (int i = 0; i < 4; ++i)
+		sum += (lanes[i] & 0xFFFFFFFF) + (lanes[i] >> 32);
+	return (sum + inet_csum_sse2(data, len));
+}
+
+#endif /* TR_CSUM_X86 */
+
+static tr_csum_kernel	csum_kernel = NULL;
+static const char		*csum_kernel_name = "scalar";
+
+static tr_csum_kernel
+csum_select(void)
+{
+	if (csum_kernel)
+		return (csum_kernel);
+
+	csum_kernel = inet_csum_scalar;
+#ifdef TR_CSUM_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		csum_kernel = inet_csum_avx2;
+		csum_kernel_name = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		csum_kernel = inet_csum_sse2;
+		csum_kernel_name = "sse2";
+	}
+#endif /* TR_CSUM_X86 */
+	return (csum_kernel);
+}
+
+const char *
+inet_csum_kernel_name(void)
+{
+	(void)csum_select();
+	return (csum_kernel_name);
+}
+
+/**
+ * Calcule la checksum d'un message, à placer telle quelle dans son en-tête.
+ */
+uint16_t
+inet_checksum(const void *buf, size_t len)
+{
+	return ((uint16_t)~inet_csum_fold(csum_select()(buf, len)));
+}
+
+/**
+ * Vérifie la checksum d'un message reçu: la somme d'un message intact, checksum
+ * comprise, vaut 0xFFFF.
+ */
+int
+inet_checksum_verify(const void *buf, size_t len)
+{
+	return (inet_csum_fold(csum_select()(buf, len)) == 0xFFFF);
+}
+
+/**
+ * Mise à jour incrémentale d'une checksum Internet lorsqu'un mot de 16 bits du
+ * message passe de `old` à `new` (RFC 1624, équation 3): HC' = ~(~HC + ~m + m').
+ * Les valeurs sont dans l'ordre réseau, la somme en complément à un ne dépendant
+ * pas de l'ordre des octets.
+ */
+uint16_t
+cksum_update(uint16_t cksum, uint16_t old, uint16_t new)
+{
+	uint32_t sum = (uint16_t)~cksum + (uint16_t)~old + new;
+
 	while (sum >> 16)
 		sum = (sum & 0xFFFF) + (sum >> 16);
 
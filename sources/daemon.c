@@ -0,0 +1,416 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   daemon.c                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/25 10:18:44 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/25 10:18:44 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * NOTE:
+ * Mode démon (--daemon socket): un processus unique, lancé une fois avec les
+ * privilèges nécessaires, sert les requêtes de traces de clients locaux sur un
+ * socket UNIX. Un client envoie une ligne contenant les options et arguments
+ * qu'il aurait passés en ligne de commande, par exemple
+ *   -I -q 1 --json 192.0.2.1
+ * puis reçoit sur la même connexion la sortie de la trace, au fil de l'eau,
+ * ainsi que ses erreurs. Avec `--targets -`, les lignes suivantes de la
+ * connexion sont les cibles. La connexion est fermée à la fin de la requête.
+ *
+ * Chaque client est servi par un thread: sa requête est analysée sans jamais
+ * quitter le processus, puis tracée par son propre moteur, comme en ligne de
+ * commande. Les paires de sockets bruts sont réutilisées d'une requête à
+ * l'autre, et le cache des noms de routeurs reste ouvert en mémoire partagée.
+ */
+
+#include "traceroute.h"
+#include "daemon.h"
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/**
+ * Vide un socket réservé des trames reçues depuis la fin de la requête
+ * précédente, ainsi que sa file d'erreurs (horodatages d'émission).
+ */
+static void
+pool_drain(int sock)
+{
+	uint8_t buf[256];
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+	while (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+		;
+	while (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0)
+		;
+}
+
+/**
+ * Fournit une paire de sockets pour une requête: une paire inactive du même
+ * type si possible, une nouvelle sinon. Les options -d et -r, ainsi que
+ * l'interface imposée par -i (SO_BINDTODEVICE), ne pouvant être retirées, leurs
+ * sockets ne sont jamais réutilisés.
+ */
+static int
+pool_acquire(struct tr_sockpool *pool, struct tr_params *params, struct tr_sockpair *pair)
+{
+	int kind = tr_pool_kind(params);
+	int found = 0;
+
+	if (!(params->flags & (TR_FLAG_DEBUG | TR_FLAG_NOROUTE)) && params->ifname == NULL)
+	{
+		(void)pthread_mutex_lock(&pool->lock);
+		if (pool->count[kind])
+		{
+			*pair = pool->idle[kind][--pool->count[kind]];
+			found = 1;
+		}
+		(void)pthread_mutex_unlock(&pool->lock);
+	}
+	if (!found)
+		return (tr_open_sockets(params, &pair->send_sock, &pair->recv_sock));
+
+	pool_drain(pair->recv_sock);
+	pool_drain(pair->send_sock);
+	if (tr_set_tos(pair->send_sock, params))
+	{
+		(void)close(pair->send_sock);
+		(void)close(pair->recv_sock);
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * Rend une paire à la réserve. Les filtres de la requête sont retirés, et
+ * l'horodatage d'émission est désactivé afin que la requête suivante retrouve
+ * un compteur SOF_TIMESTAMPING_OPT_ID à zéro, comme sur un socket neuf.
+ */
+static void
+pool_release(struct tr_sockpool *pool, struct tr_params *params, struct tr_sockpair *pair)
+{
+	int kind = tr_pool_kind(params);
+	int off = 0;
+
+	if (!(params->flags & (TR_FLAG_DEBUG | TR_FLAG_NOROUTE)) && params->ifname == NULL)
+	{
+		(void)setsockopt(pair->recv_sock, SOL_SOCKET, SO_DETACH_FILTER, &off, sizeof(off));
+		(void)setsockopt(pair->send_sock, SOL_SOCKET, SO_DETACH_FILTER, &off, sizeof(off));
+		(void)setsockopt(pair->send_sock, SOL_SOCKET, SO_TIMESTAMPING, &off, sizeof(off));
+
+		(void)pthread_mutex_lock(&pool->lock);
+		if (pool->count[kind] < TR_POOL_DEPTH)
+		{
+			pool->idle[kind][pool->count[kind]++] = *pair;
+			(void)pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+		(void)pthread_mutex_unlock(&pool->lock);
+	}
+	(void)close(pair->send_sock);
+	(void)close(pair->recv_sock);
+}
+
+static void
+pool_destroy(struct tr_sockpool *pool)
+{
+	for (int kind = 0; kind < TR_POOL_KINDS; ++kind)
+	{
+		for (uint32_t i = 0; i < pool->count[kind]; ++i)
+		{
+			(void)close(pool->idle[kind][i].send_sock);
+			(void)close(pool->idle[kind][i].recv_sock);
+		}
+		pool->count[kind] = 0;
+	}
+	(void)pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * Réserve un identifiant de probes distinct de ceux des requêtes en cours.
+ * Appelé avec le verrou du démon.
+ */
+static uint16_t
+daemon_ident(struct tr_daemon *daemon)
+{
+	uint16_t ident = daemon->next_ident;
+
+	while (daemon->idents[ident / 8] & (1 << (ident % 8)))
+		ident++;
+	daemon->idents[ident / 8] |= 1 << (ident % 8);
+	daemon->next_ident = ident + 1;
+	return (ident);
+}
+
+/**
+ * Découpe la ligne de requête en arguments séparés par des blancs. Retourne le
+ * nombre d'arguments, -1 s'il y en a trop.
+ */
+static int
+request_split(char *line, char **argv)
+{
+	int argc = 0;
+
+	// argv[0] tient lieu de nom du programme, comme pour ft_getopt_init()
+	argv[argc++] = TR_PREFIX;
+	for (char *arg = strtok_r(line, " \t\r\n", &line); arg; arg = strtok_r(NULL, " \t\r\n", &line))
+	{
+		if (argc > TR_DAEMON_MAX_ARGS)
+			return (-1);
+		argv[argc++] = arg;
+	}
+	argv[argc] = NULL;
+	return (argc);
+}
+
+/**
+ * Refuse les options qui feraient lire ou écrire un fichier par le démon, avec
+ * ses privilèges, au nom du client.
+ */
+static int
+request_allowed(struct tr_daemon *daemon, struct tr_request *req)
+{
+	struct tr_params *params = &req->params;
+
+	if (req->daemon)
+		tr_err("--daemon can't be used in a daemon request");
+	else if (req->targets_path && strcmp(req->targets_path, "-") != 0)
+		tr_err("daemon requests read their targets from the connection (--targets -)");
+	else if (params->archive || params->stop_set || params->histograms)
+		tr_err("--archive, --stop-set and --histograms can't be used in a daemon request");
+	else if (params->name_cache && params->name_cache != daemon->name_cache)
+		tr_err("--name-cache can't be used in a daemon request");
+	else
+		return (1);
+	return (0);
+}
+
+/**
+ * Trace une requête analysée, sur une paire de sockets de la réserve.
+ */
+static int
+request_trace(struct tr_daemon *daemon, struct tr_request *req)
+{
+	struct tr_sockpair pair;
+
+	if (tr_addrtab_init(req->params.family))
+		return (1);
+	if (pool_acquire(&daemon->pool, &req->params, &pair))
+	{
+		tr_addrtab_destroy();
+		return (1);
+	}
+	int res = tr_request_run(req, pair.send_sock, pair.recv_sock);
+	pool_release(&daemon->pool, &req->params, &pair);
+	tr_addrtab_destroy();
+	return (res);
+}
+
+static void *
+daemon_client(void *arg)
+{
+	struct tr_client *client = arg;
+	struct tr_daemon *daemon = client->daemon;
+	struct tr_request req;
+	char line[TR_DAEMON_LINE_MAX];
+	char *argv[TR_DAEMON_MAX_ARGS + 2];
+	struct timeval timeout = { .tv_sec = TR_DAEMON_REQ_TIMEOUT };
+
+	FILE *in = fdopen(client->fd, "r");
+	int out_fd = in ? dup(client->fd) : -1;
+	FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+	if (out == NULL)
+	{
+		if (out_fd >= 0)
+			(void)close(out_fd);
+		if (in)
+			(void)fclose(in);
+		else
+			(void)close(client->fd);
+		goto done;
+	}
+	(void)setvbuf(out, NULL, _IOFBF, TR_OUT_BUFSIZE);
+	tr_session_set(out, out, client->ident);
+
+	// Seule la ligne de requête est attendue pour une durée limitée
+	(void)setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	if (fgets(line, sizeof(line), in) == NULL)
+		goto close;
+	timeout.tv_sec = 0;
+	(void)setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	int argc = strchr(line, '\n') ? request_split(line, argv) : -1;
+	if (argc < 0)
+	{
+		tr_err("request too long");
+		goto close;
+	}
+
+	tr_request_init(&req);
+	req.params.name_cache = daemon->name_cache;
+	if (tr_request_parse(&req, argc, argv) == 0 && request_allowed(daemon, &req))
+	{
+		if (req.targets_path)
+			req.targets = in;
+		(void)request_trace(daemon, &req);
+	}
+
+close:
+	(void)fflush(out);
+	(void)fclose(out);
+	(void)fclose(in);
+	tr_session_set(NULL, NULL, 0);
+done:
+	(void)pthread_mutex_lock(&daemon->lock);
+	daemon->idents[client->ident / 8] &= ~(1 << (client->ident % 8));
+	daemon->nclients--;
+	(void)pthread_mutex_unlock(&daemon->lock);
+	free(client);
+	return (NULL);
+}
+
+/**
+ * Confie une connexion acceptée à un nouveau thread, dans la limite de
+ * TR_DAEMON_MAX_CLIENTS clients simultanés.
+ */
+static void
+daemon_accept(struct tr_daemon *daemon, int fd)
+{
+	static const char busy[] = TR_PREFIX": too many requests\n";
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	struct tr_client *client = malloc(sizeof(struct tr_client));
+	if (client == NULL)
+	{
+		tr_perr("malloc");
+		(void)close(fd);
+		return;
+	}
+	client->daemon = daemon;
+	client->fd = fd;
+
+	(void)pthread_mutex_lock(&daemon->lock);
+	if (daemon->nclients >= TR_DAEMON_MAX_CLIENTS)
+	{
+		(void)pthread_mutex_unlock(&daemon->lock);
+		(void)send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+		(void)close(fd);
+		free(client);
+		return;
+	}
+	daemon->nclients++;
+	client->ident = daemon_ident(daemon);
+	(void)pthread_mutex_unlock(&daemon->lock);
+
+	(void)pthread_attr_init(&attr);
+	(void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, daemon_client, client) != 0)
+	{
+		tr_err("pthread_create failed");
+		(void)close(fd);
+		(void)pthread_mutex_lock(&daemon->lock);
+		daemon->idents[client->ident / 8] &= ~(1 << (client->ident % 8));
+		daemon->nclients--;
+		(void)pthread_mutex_unlock(&daemon->lock);
+		free(client);
+	}
+	(void)pthread_attr_destroy(&attr);
+}
+
+/**
+ * Crée le socket d'écoute. Un ancien socket laissé par un démon arrêté est
+ * remplacé, tout autre fichier au même chemin est conservé.
+ */
+static int
+daemon_listen(struct tr_daemon *daemon)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(daemon->path) >= sizeof(addr.sun_path))
+	{
+		tr_err("daemon socket path too long");
+		return (-1);
+	}
+	(void)strcpy(addr.sun_path, daemon->path);
+
+	if (lstat(daemon->path, &st) == 0 && S_ISSOCK(st.st_mode))
+		(void)unlink(daemon->path);
+
+	daemon->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (daemon->listen_fd < 0)
+	{
+		tr_perr("socket");
+		return (-1);
+	}
+	if (bind(daemon->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+		|| chmod(daemon->path, TR_DAEMON_SOCK_MODE) < 0
+		|| listen(daemon->listen_fd, TR_DAEMON_BACKLOG) < 0)
+	{
+		tr_perr(daemon->path);
+		(void)close(daemon->listen_fd);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+tr_daemon_run(struct tr_request *req)
+{
+	struct tr_daemon *daemon = calloc(1, sizeof(struct tr_daemon));
+	if (daemon == NULL)
+	{
+		tr_perr("calloc");
+		return (1);
+	}
+	daemon->path = req->daemon;
+	daemon->name_cache = req->params.name_cache;
+	daemon->next_ident = getpid() & 0xFFFF;
+	(void)pthread_mutex_init(&daemon->lock, NULL);
+	(void)pthread_mutex_init(&daemon->pool.lock, NULL);
+
+	// Un client qui ferme sa connexion ne doit pas interrompre le démon
+	(void)signal(SIGPIPE, SIG_IGN);
+	// Choisi une fois pour toutes avant que les threads ne calculent des checksums
+	(void)inet_csum_kernel_name();
+
+	if (daemon_listen(daemon))
+	{
+		pool_destroy(&daemon->pool);
+		(void)pthread_mutex_destroy(&daemon->lock);
+		free(daemon);
+		return (1);
+	}
+
+	for (;;)
+	{
+		int fd = accept4(daemon->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			tr_perr("accept");
+			// Plus de descripteurs disponibles: on laisse les requêtes en cours se terminer
+			if (errno == EMFILE || errno == ENFILE)
+			{
+				(void)usleep(100000);
+				continue;
+			}
+			break;
+		}
+		daemon_accept(daemon, fd);
+	}
+
+	(void)close(daemon->listen_fd);
+	(void)unlink(daemon->path);
+	return (1);
+}
@@ -36,43 +36,110 @@ static const char* icmp_type_names[] = {
 };
 
 void
-print_router_name(struct sockaddr *sa)
+print_trace_header(FILE *out, const char *host, uint32_t dst_addr, struct tr_params *params)
 {
-	char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-	char ip_str[INET_ADDRSTRLEN];
-	(void)inet_ntop(AF_INET, &((struct sockaddr_in *)sa)->sin_addr, ip_str, sizeof(ip_str));
-
-#ifdef HAVE_SOCKADDR_SA_LEN
-	socklen_t sa_len = sa->sa_len;
-#else
-	socklen_t sa_len = sizeof(struct sockaddr_in);
-#endif /* __APPLE__ */
-
-	/**
-	 * Grace au rDNS (reverse DNS), on peut essayer de récupérer le nom
-	 * de l'hôte à partir de son adresse IP.
-	 */
-	if (getnameinfo(sa, sa_len, hbuf, sizeof(hbuf), sbuf, sizeof(sbuf), NI_NAMEREQD) != 0)
-	{
-		(void)printf("%s (%s) ", ip_str, ip_str);
-	}
+	char ip_str[TR_ADDRSTRLEN];
+
+	(void)tr_addr_ntop(dst_addr, ip_str, sizeof(ip_str));
+	(void)fprintf(out, TR_PREFIX" to %s (%s), %d hops max, %d byte packets\n", host, ip_str, params->max_ttl, params->packet_len);
+}
+
+/**
+ * Affiche un routeur sous la forme `nom (adresse)`. Le nom est résolu en amont
+ * par le résolveur asynchrone; sans nom, l'adresse est affichée à sa place.
+ */
+void
+print_router_name(FILE *out, uint32_t addr, const char *name)
+{
+	char ip_str[TR_ADDRSTRLEN];
+	(void)tr_addr_ntop(addr, ip_str, sizeof(ip_str));
+
+	(void)fprintf(out, "%s (%s) ", name ? name : ip_str, ip_str);
+}
+
+void
+print_router_rtt(FILE *out, struct timespec start, struct timespec end)
+{
+	double rtt = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	(void)fprintf(out, " %.3f ms ", rtt);
+}
+
+/**
+ * Résumé de la distribution des RTT d'un saut (-S): extrêmes, percentiles et
+ * gigue, rien lorsque le saut n'a pas répondu.
+ */
+void
+print_rtt_summary(FILE *out, const struct tr_histogram *hist)
+{
+	if (hist->count == 0)
+		return;
+	(void)fprintf(out, " min/p50/p90/p99/max %.3f/%.3f/%.3f/%.3f/%.3f ms jitter %.3f ms",
+		hist->min / 1000.0,
+		tr_histogram_percentile(hist, 50) / 1000.0,
+		tr_histogram_percentile(hist, 90) / 1000.0,
+		tr_histogram_percentile(hist, 99) / 1000.0,
+		hist->max / 1000.0,
+		tr_histogram_jitter(hist) / 1000.0);
+}
+
+/**
+ * Affiche le RTT d'une probe à partir des horodatages noyau lorsqu'ils sont
+ * disponibles, des horloges de l'espace utilisateur sinon.
+ */
+void
+print_probe_rtt(FILE *out, struct tr_probe *probe)
+{
+	if ((probe->tx_ts.tv_sec || probe->tx_ts.tv_nsec) && (probe->rx_ts.tv_sec || probe->rx_ts.tv_nsec))
+		print_router_rtt(out, probe->tx_ts, probe->rx_ts);
 	else
+		print_router_rtt(out, probe->start, probe->end);
+}
+
+/**
+ * RTT d'une probe en millisecondes, mesuré comme par print_probe_rtt().
+ */
+double
+tr_probe_rtt(const struct tr_probe *probe)
+{
+	const struct timespec *start = &probe->start;
+	const struct timespec *end = &probe->end;
+
+	if ((probe->tx_ts.tv_sec || probe->tx_ts.tv_nsec) && (probe->rx_ts.tv_sec || probe->rx_ts.tv_nsec))
 	{
-		(void)printf("%s (%s) ", hbuf, ip_str);
+		start = &probe->tx_ts;
+		end = &probe->rx_ts;
 	}
-	(void)fflush(stdout);
+	return ((end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1e6);
 }
 
-void
-print_router_rtt(struct timespec start, struct timespec end)
+/**
+ * Affiche le contenu d'un message ICMP par mots de 4 octets.
+ */
+static void
+print_icmp_payload(FILE *out, uint8_t *icmp_payload, size_t icmp_len)
 {
-	double rtt = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
-	(void)printf(" %.3f ms ", rtt);
-	(void)fflush(stdout);
+	size_t offset = 4; // On évite les 4 premiers octets qui contiennent l'en-tête
+	while (offset < icmp_len)
+	{
+		(void)fprintf(out, "%2zu: ", offset);
+		(void)fprintf(out, "x");
+		for (int i = 0; i < 4 && offset + i < icmp_len; i++)
+		{
+			(void)fprintf(out, "%02x", icmp_payload[offset + i]);
+		}
+		(void)fprintf(out, " ");
+		for (int i = 0; i < 4 && offset + i < icmp_len; i++)
+		{
+			unsigned char c = icmp_payload[offset + i];
+			(void)fprintf(out, "%c", (c >= 32 && c < 127) ? c : '.');
+		}
+		(void)fprintf(out, "\n");
+		offset += 4;
+	}
 }
 
 void
-print_verbose_response(uint8_t *packet, size_t packet_size)
+print_verbose_response(FILE *out, uint8_t *packet, size_t packet_size)
 {
 	if (packet_size < sizeof(struct ip))
 		return;
@@ -95,7 +162,7 @@ print_verbose_response(uint8_t *packet, size_t packet_size)
 
 	const char *type_name = icmp_hdr->icmp_type < sizeof(icmp_type_names) ? icmp_type_names[icmp_hdr->icmp_type] : "unknown";
 
-	(void)printf("%zd bytes from %s to %s: icmp type %d (%s) code %d\n",
+	(void)fprintf(out, "%zd bytes from %s to %s: icmp type %d (%s) code %d\n",
 		icmp_len,
 		src,
 		dst,
@@ -103,22 +170,51 @@ print_verbose_response(uint8_t *packet, size_t packet_size)
 		type_name,
 		icmp_hdr->icmp_code);
 
-	size_t offset = 4; // On évite les 4 premiers octets qui contiennent l'en-tête
-	while (offset < icmp_len)
+	print_icmp_payload(out, icmp_payload, icmp_len);
+}
+
+static const char *
+icmp6_type_name(uint8_t type)
+{
+	switch (type)
 	{
-		(void)printf("%2zu: ", offset);
-		(void)printf("x");
-		for (int i = 0; i < 4 && offset + i < icmp_len; i++)
-		{
-			(void)printf("%02x", icmp_payload[offset + i]);
-		}
-		(void)printf(" ");
-		for (int i = 0; i < 4 && offset + i < icmp_len; i++)
-		{
-			unsigned char c = icmp_payload[offset + i];
-			(void)printf("%c", (c >= 32 && c < 127) ? c : '.');
-		}
-		(void)printf("\n");
-		offset += 4;
+	case ICMP6_DST_UNREACH:
+		return ("Dest Unreachable");
+	case ICMP6_PACKET_TOO_BIG:
+		return ("Packet Too Big");
+	case ICMP6_TIME_EXCEEDED:
+		return ("Time Exceeded");
+	case ICMP6_PARAM_PROB:
+		return ("Parameter Problem");
+	case ICMP6_ECHO_REQUEST:
+		return ("Echo Request");
+	case ICMP6_ECHO_REPLY:
+		return ("Echo Reply");
+	default:
+		return ("unknown");
 	}
+}
+
+/**
+ * Équivalent IPv6 de print_verbose_response(): le socket ICMPv6 ne remet pas
+ * l'en-tête IPv6, l'émetteur est donc fourni par l'appelant.
+ */
+void
+print_verbose_response6(FILE *out, const struct in6_addr *from, uint8_t *packet, size_t packet_size)
+{
+	if (packet_size < sizeof(struct icmp6_hdr))
+		return;
+
+	struct icmp6_hdr *icmp6_hdr = (struct icmp6_hdr *)packet;
+	char src[INET6_ADDRSTRLEN];
+
+	(void)inet_ntop(AF_INET6, from, src, sizeof(src));
+	(void)fprintf(out, "%zd bytes from %s: icmp6 type %d (%s) code %d\n",
+		packet_size,
+		src,
+		icmp6_hdr->icmp6_type,
+		icmp6_type_name(icmp6_hdr->icmp6_type),
+		icmp6_hdr->icmp6_code);
+
+	print_icmp_payload(out, packet, packet_size);
 }
\ No newline at end of file
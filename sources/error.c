@@ -15,24 +15,23 @@
 void
 tr_err(const char *msg)
 {
-	(void)fprintf(stderr, TR_PREFIX": %s\n", msg);
+	(void)fprintf(tr_errout(), TR_PREFIX": %s\n", msg);
 }
 
 void
 tr_perr(const char *msg)
 {
-	(void)fprintf(stderr, TR_PREFIX": %s: %s\n", msg, strerror(errno));
+	(void)fprintf(tr_errout(), TR_PREFIX": %s: %s\n", msg, strerror(errno));
 }
 
 void
 tr_warn(const char *msg)
 {
-	(void)fprintf(stderr, TR_PREFIX": Warning: %s\n", msg);
+	(void)fprintf(tr_errout(), TR_PREFIX": Warning: %s\n", msg);
 }
 
 void
 tr_bad_value(const char *key, const char *val)
 {
-	(void)fprintf(stderr, TR_PREFIX": \"%s\" bad value for %s\n", val, key);
-	exit(1);
+	(void)fprintf(tr_errout(), TR_PREFIX": \"%s\" bad value for %s\n", val, key);
 }
@@ -0,0 +1,107 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   event.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/16 14:03:52 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/16 14:03:52 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "event.h"
+
+/**
+ * NOTE:
+ * Boucle d'événements basée sur epoll. Contrairement à select(), l'ensemble des
+ * descripteurs surveillés est conservé par le noyau: il n'est pas reconstruit
+ * à chaque attente et le coût d'un réveil ne dépend que du nombre de
+ * descripteurs prêts.
+ */
+
+int
+tr_evloop_init(struct tr_evloop *loop)
+{
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0)
+	{
+		tr_perr("epoll_create1");
+		return (-1);
+	}
+	return (0);
+}
+
+void
+tr_evloop_close(struct tr_evloop *loop)
+{
+	if (loop->epfd >= 0)
+		(void)close(loop->epfd);
+	loop->epfd = -1;
+}
+
+int
+tr_evloop_add(struct tr_evloop *loop, struct tr_evsource *source, uint32_t events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = source;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, source->fd, &ev) < 0)
+	{
+		tr_perr("epoll_ctl");
+		return (-1);
+	}
+	return (0);
+}
+
+int
+tr_evloop_mod(struct tr_evloop *loop, struct tr_evsource *source, uint32_t events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = source;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, source->fd, &ev) < 0)
+	{
+		tr_perr("epoll_ctl");
+		return (-1);
+	}
+	return (0);
+}
+
+int
+tr_evloop_del(struct tr_evloop *loop, struct tr_evsource *source)
+{
+	return (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, source->fd, NULL));
+}
+
+/**
+ * Attend au plus `timeout_ms` millisecondes (indéfiniment si négatif) et
+ * appelle le handler de chaque source prête. Retourne le nombre de sources
+ * traitées.
+ */
+int
+tr_evloop_wait(struct tr_evloop *loop, int timeout_ms)
+{
+	struct epoll_event events[TR_EV_MAX_EVENTS];
+
+	int n = epoll_wait(loop->epfd, events, TR_EV_MAX_EVENTS, timeout_ms);
+	if (n < 0)
+	{
+		if (errno == EINTR)
+			return (0);
+		tr_perr("epoll_wait");
+		return (-1);
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		struct tr_evsource *source = events[i].data.ptr;
+		source->handler(source, events[i].events);
+	}
+	return (n);
+}
@@ -0,0 +1,354 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   filter.c                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/17 15:08:44 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/17 15:08:44 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+
+#include <linux/filter.h>
+
+/**
+ * NOTE:
+ * Le socket de réception étant brut, toutes les trames ICMP reçues par le système
+ * remontent jusqu'au programme, qui écarte celles ne correspondant à aucune probe.
+ * On génère donc un programme BPF classique à partir des paramètres de la trace
+ * afin que le noyau écarte ces trames avant de réveiller le processus.
+ *
+ * Les offsets sont relatifs au début de l'en-tête ICMP (registre X), l'en-tête IP
+ * cité étant celui de nos probes il ne comporte pas d'options (20 octets):
+ * ┌──────────────┬───────────────────────────────────────────┐
+ * │ X + 0        │ type ICMP                                 │
+ * │ X + 4        │ identifiant (Echo Reply)                  │
+ * │ X + 8 + 9    │ protocole du paquet cité                  │
+ * │ X + 8 + 16   │ destination du paquet cité                │
+ * │ X + 28       │ en-tête UDP / ICMP / TCP cité             │
+ * └──────────────┴───────────────────────────────────────────┘
+ */
+
+#define TR_BPF_MAX_INSNS	32
+
+/**
+ * Étiquettes symboliques utilisées dans les sauts pendant la génération, elles
+ * sont remplacées par les offsets relatifs une fois le programme terminé.
+ */
+#define L_QUOTED	0xfc
+#define L_ECHO		0xfd
+#define L_ACCEPT	0xfe
+#define L_DROP		0xff
+
+#define QUOTED_OFF	(ICMP_MINLEN)
+#define INNER_OFF	(ICMP_MINLEN + sizeof(struct ip))
+#define INNER6_OFF	(sizeof(struct icmp6_hdr) + sizeof(struct ip6_hdr))
+
+struct bpf_builder {
+	struct sock_filter	insns[TR_BPF_MAX_INSNS];
+	int					len;
+	int					labels[256];
+};
+
+static void
+emit(struct bpf_builder *b, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k)
+{
+	b->insns[b->len++] = (struct sock_filter)BPF_JUMP(code, k, jt, jf);
+}
+
+static void
+label(struct bpf_builder *b, int id)
+{
+	b->labels[id] = b->len;
+}
+
+static void
+resolve(struct bpf_builder *b)
+{
+	for (int pc = 0; pc < b->len; ++pc)
+	{
+		struct sock_filter *insn = &b->insns[pc];
+
+		if (BPF_CLASS(insn->code) != BPF_JMP)
+			continue;
+		if (insn->jt >= L_QUOTED)
+			insn->jt = b->labels[insn->jt] - pc - 1;
+		if (insn->jf >= L_QUOTED)
+			insn->jf = b->labels[insn->jf] - pc - 1;
+		if (BPF_OP(insn->code) == BPF_JA && insn->k >= L_QUOTED)
+			insn->k = b->labels[insn->k] - pc - 1;
+	}
+}
+
+/**
+ * Termine le programme par ses deux issues et l'attache au socket.
+ */
+static int
+attach(struct bpf_builder *b, int sock)
+{
+	label(b, L_ACCEPT);
+	emit(b, BPF_RET | BPF_K, 0, 0, 0x40000);
+	label(b, L_DROP);
+	emit(b, BPF_RET | BPF_K, 0, 0, 0);
+
+	resolve(b);
+
+	struct sock_fprog prog = { .len = b->len, .filter = b->insns };
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+	{
+		tr_perr("setsockopt SO_ATTACH_FILTER");
+		return (0);
+	}
+	return (1);
+}
+
+/**
+ * Programme du socket ICMPv6: le noyau ne remet pas l'en-tête IPv6 aux sockets
+ * bruts, les offsets sont donc absolus depuis le début de l'en-tête ICMPv6.
+ * ┌──────────────┬───────────────────────────────────────────┐
+ * │ 0            │ type ICMPv6                               │
+ * │ 4            │ identifiant (Echo Reply)                  │
+ * │ 8 + 6        │ en-tête suivant du paquet cité            │
+ * │ 8 + 24       │ destination du paquet cité (16 octets)    │
+ * │ 48           │ en-tête UDP / ICMPv6 cité                 │
+ * └──────────────┴───────────────────────────────────────────┘
+ */
+static int
+filter_attach6(int recv_sock, uint32_t dst_addr, struct tr_params *params)
+{
+	struct bpf_builder b;
+	uint16_t ident = tr_ident();
+
+	memset(&b, 0, sizeof(b));
+
+	emit(&b, BPF_LD | BPF_B | BPF_ABS, 0, 0, 0);
+	emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_QUOTED, 0, ICMP6_TIME_EXCEEDED);
+	if (params->protocol == TR_PROTO_ICMP)
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ECHO, L_DROP, ICMP6_ECHO_REPLY);
+	else
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_QUOTED, L_DROP, ICMP6_DST_UNREACH);
+
+	label(&b, L_QUOTED);
+	emit(&b, BPF_LD | BPF_B | BPF_ABS, 0, 0, sizeof(struct icmp6_hdr) + offsetof(struct ip6_hdr, ip6_nxt));
+	emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, params->protocol == TR_PROTO_ICMP ? IPPROTO_ICMPV6 : IPPROTO_UDP);
+	if (dst_addr)
+	{
+		const uint8_t *dst = tr_addr_get(dst_addr)->s6_addr;
+		for (int i = 0; i < 16; i += 4)
+		{
+			uint32_t word;
+			memcpy(&word, dst + i, sizeof(word));
+			emit(&b, BPF_LD | BPF_W | BPF_ABS, 0, 0, sizeof(struct icmp6_hdr) + offsetof(struct ip6_hdr, ip6_dst) + i);
+			emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, ntohl(word));
+		}
+	}
+
+	if (params->protocol == TR_PROTO_UDP)
+	{
+		// Même plage de ports qu'en IPv4 (voir tr_filter_attach)
+		uint32_t lo = params->port;
+		uint32_t hi = params->port;
+		if (!(params->flags & TR_FLAG_FIXED_PORT))
+		{
+			lo = params->port + params->first_ttl * params->nprobes;
+			hi = params->port + params->max_ttl * params->nprobes + params->nprobes - 1;
+		}
+		if (hi <= TR_MAX_PORT)
+		{
+			emit(&b, BPF_LD | BPF_H | BPF_ABS, 0, 0, INNER6_OFF + offsetof(struct udphdr, uh_dport));
+			emit(&b, BPF_JMP | BPF_JGE | BPF_K, 0, L_DROP, lo);
+			emit(&b, BPF_JMP | BPF_JGT | BPF_K, L_DROP, L_ACCEPT, hi);
+		}
+		else
+		{
+			emit(&b, BPF_JMP | BPF_JA, 0, 0, L_ACCEPT);
+		}
+	}
+	else
+	{
+		emit(&b, BPF_LD | BPF_B | BPF_ABS, 0, 0, INNER6_OFF);
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, ICMP6_ECHO_REQUEST);
+		emit(&b, BPF_LD | BPF_H | BPF_ABS, 0, 0, INNER6_OFF + offsetof(struct icmp6_hdr, icmp6_id));
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ACCEPT, L_DROP, ident);
+
+		label(&b, L_ECHO);
+		emit(&b, BPF_LD | BPF_H | BPF_ABS, 0, 0, offsetof(struct icmp6_hdr, icmp6_id));
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ACCEPT, L_DROP, ident);
+	}
+
+	return (attach(&b, recv_sock));
+}
+
+/**
+ * Génère le programme et l'attache au socket de réception. `dst_addr` à 0
+ * désactive le contrôle de la destination citée. Retourne 1 si le filtre a été
+ * attaché, 0 sinon.
+ */
+int
+tr_filter_attach(int recv_sock, uint32_t dst_addr, struct tr_params *params)
+{
+	struct bpf_builder b;
+	uint16_t ident = tr_ident();
+
+	if (params->protocol != TR_PROTO_UDP && params->protocol != TR_PROTO_ICMP && params->protocol != TR_PROTO_TCP)
+		return (0);
+	if (params->family == AF_INET6)
+		return (filter_attach6(recv_sock, dst_addr, params));
+
+	memset(&b, 0, sizeof(b));
+
+	// X = longueur de l'en-tête IP externe, A = type ICMP
+	emit(&b, BPF_LDX | BPF_B | BPF_MSH, 0, 0, 0);
+	emit(&b, BPF_LD | BPF_B | BPF_IND, 0, 0, 0);
+
+	emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_QUOTED, 0, ICMP_TIMXCEED);
+	if (params->protocol == TR_PROTO_ICMP)
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ECHO, L_DROP, ICMP_ECHOREPLY);
+	else
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_QUOTED, L_DROP, ICMP_UNREACH);
+
+	// Le paquet cité doit être une de nos probes, à destination de la cible
+	label(&b, L_QUOTED);
+	emit(&b, BPF_LD | BPF_B | BPF_IND, 0, 0, QUOTED_OFF + offsetof(struct ip, ip_p));
+	uint32_t proto = IPPROTO_UDP;
+	if (params->protocol == TR_PROTO_ICMP)
+		proto = IPPROTO_ICMP;
+	else if (params->protocol == TR_PROTO_TCP)
+		proto = IPPROTO_TCP;
+	emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, proto);
+	if (dst_addr)
+	{
+		emit(&b, BPF_LD | BPF_W | BPF_IND, 0, 0, QUOTED_OFF + offsetof(struct ip, ip_dst));
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, ntohl(dst_addr));
+	}
+
+	if (params->protocol == TR_PROTO_UDP)
+	{
+		/**
+		 * Le port de destination doit être compris dans la plage utilisée par
+		 * get_probe_port(). Si la plage déborde au-delà de 65535, le contrôle est
+		 * laissé au programme.
+		 */
+		uint32_t lo = params->port;
+		uint32_t hi = params->port;
+		if (params->flags & TR_FLAG_MDA)
+			hi = params->port + params->nprobes - 1;
+		else if (!(params->flags & TR_FLAG_FIXED_PORT))
+		{
+			lo = params->port + params->first_ttl * params->nprobes;
+			hi = params->port + params->max_ttl * params->nprobes + params->nprobes - 1;
+		}
+		if (hi <= TR_MAX_PORT)
+		{
+			emit(&b, BPF_LD | BPF_H | BPF_IND, 0, 0, INNER_OFF + offsetof(struct udphdr, uh_dport));
+			emit(&b, BPF_JMP | BPF_JGE | BPF_K, 0, L_DROP, lo);
+			emit(&b, BPF_JMP | BPF_JGT | BPF_K, L_DROP, L_ACCEPT, hi);
+		}
+		else
+		{
+			emit(&b, BPF_JMP | BPF_JA, 0, 0, L_ACCEPT);
+		}
+	}
+	else if (params->protocol == TR_PROTO_TCP)
+	{
+		// Les 16 bits de poids fort du numéro de séquence cité identifient l'exécution (tr_ident)
+		emit(&b, BPF_LD | BPF_W | BPF_IND, 0, 0, INNER_OFF + offsetof(struct tcphdr, th_seq));
+		emit(&b, BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16);
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ACCEPT, L_DROP, ident);
+	}
+	else
+	{
+		emit(&b, BPF_LD | BPF_B | BPF_IND, 0, 0, INNER_OFF);
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, ICMP_ECHO);
+		emit(&b, BPF_LD | BPF_H | BPF_IND, 0, 0, INNER_OFF + offsetof(struct icmp, icmp_id));
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ACCEPT, L_DROP, ident);
+
+		// Echo Reply de la destination, identifié par l'identifiant ICMP
+		label(&b, L_ECHO);
+		emit(&b, BPF_LD | BPF_H | BPF_IND, 0, 0, offsetof(struct icmp, icmp_id));
+		emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ACCEPT, L_DROP, ident);
+	}
+
+	return (attach(&b, recv_sock));
+}
+
+/**
+ * Filtre du socket TCP brut recevant les réponses de la destination: ce socket
+ * reçoit une copie de tous les segments TCP reçus par le système, seuls les
+ * SYN-ACK et RST acquittant une de nos probes sont conservés.
+ * Les offsets sont relatifs au début de l'en-tête TCP (registre X).
+ */
+int
+tr_filter_attach_tcp(int tcp_sock, struct tr_params *params)
+{
+	struct bpf_builder b;
+	uint16_t ident = tr_ident();
+
+	memset(&b, 0, sizeof(b));
+
+	emit(&b, BPF_LDX | BPF_B | BPF_MSH, 0, 0, 0);
+
+	// Le segment provient du port visé
+	emit(&b, BPF_LD | BPF_H | BPF_IND, 0, 0, offsetof(struct tcphdr, th_sport));
+	emit(&b, BPF_JMP | BPF_JEQ | BPF_K, 0, L_DROP, params->port);
+
+	// ACK et SYN ou RST
+	emit(&b, BPF_LD | BPF_B | BPF_IND, 0, 0, offsetof(struct tcphdr, th_flags));
+	emit(&b, BPF_JMP | BPF_JSET | BPF_K, 0, L_DROP, TH_ACK);
+	emit(&b, BPF_JMP | BPF_JSET | BPF_K, 0, L_DROP, TH_SYN | TH_RST);
+
+	// Le numéro d'acquittement moins un porte l'identifiant de l'exécution
+	emit(&b, BPF_LD | BPF_W | BPF_IND, 0, 0, offsetof(struct tcphdr, th_ack));
+	emit(&b, BPF_ALU | BPF_SUB | BPF_K, 0, 0, 1);
+	emit(&b, BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16);
+	emit(&b, BPF_JMP | BPF_JEQ | BPF_K, L_ACCEPT, L_DROP, ident);
+
+	return (attach(&b, tcp_sock));
+}
+
+/**
+ * Retourne le nombre de messages ICMP reçus par le système (compteur InMsgs de
+ * /proc/net/snmp, Icmp6InMsgs de /proc/net/snmp6 en IPv6), ou 0 s'il n'est pas
+ * disponible.
+ * Un socket ICMP brut recevant tous les messages ICMP, la différence entre ce
+ * compteur et le nombre de trames effectivement lues donne le nombre de trames
+ * écartées par le filtre.
+ */
+uint64_t
+tr_filter_icmp_in(int family)
+{
+	FILE *f = fopen(family == AF_INET6 ? "/proc/net/snmp6" : "/proc/net/snmp", "r");
+	char line[512];
+	int header = 1;
+	unsigned long long in_msgs = 0;
+
+	if (f == NULL)
+		return (0);
+
+	while (fgets(line, sizeof(line), f))
+	{
+		// Une ligne par compteur en IPv6: nom puis valeur
+		if (family == AF_INET6)
+		{
+			if (sscanf(line, "Icmp6InMsgs %llu", &in_msgs) == 1)
+				break;
+			continue;
+		}
+		if (strncmp(line, "Icmp: ", 6) != 0)
+			continue;
+		// La première ligne "Icmp:" contient les noms des champs, la seconde les valeurs
+		if (header)
+		{
+			header = 0;
+			continue;
+		}
+		if (sscanf(line + 6, "%llu", &in_msgs) != 1)
+			in_msgs = 0;
+		break;
+	}
+	(void)fclose(f);
+	return (in_msgs);
+}
@@ -0,0 +1,303 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   histogram.c                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/28 11:02:37 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/28 11:02:37 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "histogram.h"
+
+/**
+ * NOTE:
+ * Les cases ne dépendent que de la valeur: deux histogrammes se fusionnent en
+ * additionnant leurs cases, quels que soient les traces, les sauts ou les
+ * exécutions dont ils proviennent. Les percentiles sont lus en cumulant les
+ * cases, sans conserver les valeurs elles-mêmes.
+ */
+
+static uint32_t
+hist_index(uint32_t value)
+{
+	if (value < TR_HIST_SUB_COUNT)
+		return (value);
+
+	uint32_t shift = (31 - __builtin_clz(value)) - TR_HIST_SUB_BITS;
+	return ((shift + 1) * TR_HIST_SUB_COUNT + (value >> shift) - TR_HIST_SUB_COUNT);
+}
+
+/**
+ * Valeur représentant une case: le milieu de l'intervalle qu'elle couvre.
+ */
+static uint32_t
+hist_value(uint32_t index)
+{
+	if (index < TR_HIST_SUB_COUNT)
+		return (index);
+
+	uint32_t shift = index / TR_HIST_SUB_COUNT - 1;
+	uint32_t low = (index % TR_HIST_SUB_COUNT + TR_HIST_SUB_COUNT) << shift;
+	return (low + ((1u << shift) >> 1));
+}
+
+void
+tr_histogram_record(struct tr_histogram *hist, uint32_t value)
+{
+	if (value > TR_HIST_MAX)
+		value = TR_HIST_MAX;
+
+	if (hist->count)
+	{
+		hist->jitter_sum += value > hist->last ? value - hist->last : hist->last - value;
+		hist->jitter_count++;
+	}
+	if (hist->count == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->last = value;
+	hist->count++;
+	hist->sum += value;
+	hist->counts[hist_index(value)]++;
+}
+
+/**
+ * Ajoute les valeurs de `src` à `dst`. La gigue est celle des deux suites de
+ * valeurs, l'écart entre la dernière valeur de l'une et la première de l'autre
+ * n'étant pas connu.
+ */
+void
+tr_histogram_merge(struct tr_histogram *dst, const struct tr_histogram *src)
+{
+	if (src->count == 0)
+		return;
+
+	if (dst->count == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->last = src->last;
+	dst->count += src->count;
+	dst->sum += src->sum;
+	dst->jitter_sum += src->jitter_sum;
+	dst->jitter_count += src->jitter_count;
+	for (uint32_t i = 0; i < TR_HIST_BUCKETS; ++i)
+		dst->counts[i] += src->counts[i];
+}
+
+/**
+ * Plus petite valeur au-dessous de laquelle se trouvent `pct` % des valeurs,
+ * à la précision des cases près, bornée par les extrêmes exacts.
+ */
+uint32_t
+tr_histogram_percentile(const struct tr_histogram *hist, uint32_t pct)
+{
+	uint64_t rank = (hist->count * pct + 99) / 100;
+	uint64_t seen = 0;
+
+	if (rank == 0)
+		rank = 1;
+	if (rank >= hist->count)
+		return (hist->max);
+	for (uint32_t i = 0; i < TR_HIST_BUCKETS; ++i)
+	{
+		seen += hist->counts[i];
+		if (seen < rank)
+			continue;
+
+		uint32_t value = hist_value(i);
+		if (value < hist->min)
+			value = hist->min;
+		if (value > hist->max)
+			value = hist->max;
+		return (value);
+	}
+	return (hist->max);
+}
+
+uint32_t
+tr_histogram_jitter(const struct tr_histogram *hist)
+{
+	if (hist->jitter_count == 0)
+		return (0);
+	return ((uint32_t)(hist->jitter_sum / hist->jitter_count));
+}
+
+static inline uint32_t
+histtab_hash(uint32_t addr)
+{
+	return ((ntohl(addr) * 2654435761u) & (TR_HISTTAB_SIZE - 1));
+}
+
+int
+tr_histtab_init(struct tr_histtab *tab)
+{
+	tab->count = 0;
+	tab->addrs = calloc(TR_HISTTAB_SIZE, sizeof(uint32_t));
+	tab->hists = calloc(TR_HISTTAB_SIZE, sizeof(struct tr_histogram *));
+	if (tab->addrs == NULL || tab->hists == NULL)
+	{
+		tr_perr("calloc");
+		tr_histtab_destroy(tab);
+		return (-1);
+	}
+	return (0);
+}
+
+void
+tr_histtab_destroy(struct tr_histtab *tab)
+{
+	if (tab->hists)
+	{
+		for (uint32_t i = 0; i < TR_HISTTAB_SIZE; ++i)
+			free(tab->hists[i]);
+	}
+	free(tab->hists);
+	free(tab->addrs);
+	tab->hists = NULL;
+	tab->addrs = NULL;
+	tab->count = 0;
+}
+
+/**
+ * Histogramme du routeur `addr`, créé à sa première rencontre. Retourne NULL
+ * lorsque la table est pleine.
+ */
+struct tr_histogram *
+tr_histtab_get(struct tr_histtab *tab, uint32_t addr)
+{
+	uint32_t i = histtab_hash(addr);
+
+	while (tab->addrs[i])
+	{
+		if (tab->addrs[i] == addr)
+			return (tab->hists[i]);
+		i = (i + 1) & (TR_HISTTAB_SIZE - 1);
+	}
+	if (tab->count >= TR_HISTTAB_MAX || (tab->hists[i] = calloc(1, sizeof(struct tr_histogram))) == NULL)
+		return (NULL);
+	tab->addrs[i] = addr;
+	tab->count++;
+	return (tab->hists[i]);
+}
+
+/**
+ * Lit une ligne écrite par tr_histtab_save(). Retourne -1 si elle est invalide.
+ */
+static int
+histtab_parse(char *line, struct in_addr *addr, struct tr_histogram *hist)
+{
+	char ip_str[INET_ADDRSTRLEN];
+	unsigned long long count, sum, jitter_sum, jitter_count;
+	unsigned int min, max, last;
+	int len;
+
+	if (sscanf(line, "%15s %llu %llu %u %u %u %llu %llu%n", ip_str, &count, &sum, &min, &max,
+			&last, &jitter_sum, &jitter_count, &len) != 8 || !inet_aton(ip_str, addr) || addr->s_addr == 0)
+		return (-1);
+
+	memset(hist, 0, sizeof(*hist));
+	hist->count = count;
+	hist->sum = sum;
+	hist->min = min;
+	hist->max = max;
+	hist->last = last;
+	hist->jitter_sum = jitter_sum;
+	hist->jitter_count = jitter_count;
+
+	uint64_t total = 0;
+	char *p = line + len;
+	unsigned int index, n;
+	while (sscanf(p, " %u:%u%n", &index, &n, &len) == 2)
+	{
+		if (index >= TR_HIST_BUCKETS)
+			return (-1);
+		hist->counts[index] += n;
+		total += n;
+		p += len;
+	}
+	// Les percentiles supposent que les cases comptent toutes les valeurs
+	if (total != count || min > max || max > TR_HIST_MAX)
+		return (-1);
+	return (0);
+}
+
+/**
+ * Ajoute aux histogrammes de la table ceux d'un fichier enregistré par
+ * tr_histtab_save(): un routeur peut y figurer plusieurs fois (fichiers mis
+ * bout à bout), ses histogrammes sont alors fusionnés. Un fichier absent
+ * correspond à une table vide.
+ */
+int
+tr_histtab_load(struct tr_histtab *tab, const char *path)
+{
+	struct tr_histogram hist;
+	struct in_addr addr;
+	char *line = NULL;
+	size_t cap = 0;
+
+	FILE *file = tr_user_fopen(path, "r");
+	if (file == NULL)
+	{
+		if (errno == ENOENT)
+			return (0);
+		tr_perr(path);
+		return (-1);
+	}
+
+	while (getline(&line, &cap, file) > 0)
+	{
+		if (histtab_parse(line, &addr, &hist))
+			continue;
+
+		struct tr_histogram *dst = tr_histtab_get(tab, addr.s_addr);
+		if (dst == NULL)
+			break;
+		tr_histogram_merge(dst, &hist);
+	}
+	free(line);
+	(void)fclose(file);
+	return (0);
+}
+
+/**
+ * Enregistre un routeur par ligne: adresse, nombre de valeurs, somme, minimum,
+ * maximum, dernière valeur, somme et nombre des écarts de la gigue, puis les
+ * cases non vides sous la forme `index:nombre`. Les valeurs sont en µs.
+ */
+int
+tr_histtab_save(const struct tr_histtab *tab, const char *path)
+{
+	char ip_str[INET_ADDRSTRLEN];
+
+	FILE *file = tr_user_fopen(path, "w");
+	if (file == NULL)
+	{
+		tr_perr(path);
+		return (-1);
+	}
+
+	for (uint32_t i = 0; i < TR_HISTTAB_SIZE; ++i)
+	{
+		const struct tr_histogram *hist = tab->hists[i];
+		if (tab->addrs[i] == 0 || hist->count == 0)
+			continue;
+
+		(void)inet_ntop(AF_INET, &tab->addrs[i], ip_str, sizeof(ip_str));
+		(void)fprintf(file, "%s %llu %llu %u %u %u %llu %llu", ip_str, (unsigned long long)hist->count,
+			(unsigned long long)hist->sum, hist->min, hist->max, hist->last,
+			(unsigned long long)hist->jitter_sum, (unsigned long long)hist->jitter_count);
+		for (uint32_t j = 0; j < TR_HIST_BUCKETS; ++j)
+		{
+			if (hist->counts[j])
+				(void)fprintf(file, " %u:%u", j, hist->counts[j]);
+		}
+		(void)fprintf(file, "\n");
+	}
+	return (fclose(file));
+}
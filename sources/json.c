@@ -0,0 +1,312 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   json.c                                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/23 09:13:20 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/23 09:13:20 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "json.h"
+
+#include <stdarg.h>
+
+/**
+ * NOTE:
+ * Sortie --json: chaque résultat est un objet JSON sur sa propre ligne (NDJSON),
+ * portant l'adresse de destination de sa trace afin que les enregistrements des
+ * traces simultanées puissent être écrits dès qu'ils sont connus, sans attendre
+ * la fin de chaque trace. Une trace produit un enregistrement "trace" à son
+ * démarrage, un "probe" par probe et un "hop" par saut dans l'ordre des TTL,
+ * un "skip" par groupe de sauts évités par Doubletree, et un "done" à sa fin.
+ */
+
+static const char	*stop_names[] = {
+	[TR_STOP_NONE] = "none",
+	[TR_STOP_REACHED] = "reached",
+	[TR_STOP_MAX_TTL] = "max_ttl",
+	[TR_STOP_GAP] = "gap",
+	[TR_STOP_LOOP] = "loop",
+	[TR_STOP_STOP_SET] = "stop_set",
+};
+
+static const char	*proto_names[] = {
+	[TR_PROTO_UDP] = "udp",
+	[TR_PROTO_ICMP] = "icmp",
+	[TR_PROTO_TCP] = "tcp",
+	[TR_PROTO_GRE] = "gre",
+};
+
+/**
+ * Place libre dans le tampon, deux octets étant réservés à la fin de l'objet.
+ */
+static inline size_t
+json_room(const struct tr_json *json)
+{
+	return (TR_JSON_BUFSIZE - 2 - json->len);
+}
+
+static int
+json_append(struct tr_json *json, const char *s, size_t len)
+{
+	if (len > json_room(json))
+		return (-1);
+	memcpy(json->buf + json->len, s, len);
+	json->len += len;
+	return (0);
+}
+
+static int
+json_key(struct tr_json *json, const char *key)
+{
+	if (json_append(json, ",\"", 2) || json_append(json, key, strlen(key)))
+		return (-1);
+	return (json_append(json, "\":", 2));
+}
+
+/**
+ * Ajoute une valeur formatée par snprintf(). Le champ est retiré s'il ne
+ * tient pas entièrement dans le tampon.
+ */
+static void
+json_number(struct tr_json *json, const char *key, const char *fmt, ...)
+{
+	size_t start = json->len;
+	va_list ap;
+
+	if (json_key(json, key) == 0)
+	{
+		va_start(ap, fmt);
+		int n = vsnprintf(json->buf + json->len, json_room(json) + 1, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t)n <= json_room(json))
+		{
+			json->len += n;
+			return;
+		}
+	}
+	json->len = start;
+}
+
+void
+tr_json_begin(struct tr_json *json, const char *type)
+{
+	json->len = 0;
+	(void)json_append(json, "{\"type\":\"", 9);
+	(void)json_append(json, type, strlen(type));
+	(void)json_append(json, "\"", 1);
+}
+
+/**
+ * Ajoute une chaîne échappée selon la RFC 8259, ou null si `val` est NULL.
+ */
+void
+tr_json_str(struct tr_json *json, const char *key, const char *val)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t start = json->len;
+	int err;
+
+	if (json_key(json, key))
+	{
+		json->len = start;
+		return;
+	}
+	if (val == NULL)
+	{
+		if (json_append(json, "null", 4))
+			json->len = start;
+		return;
+	}
+
+	err = json_append(json, "\"", 1);
+	for (const unsigned char *p = (const unsigned char *)val; *p && !err; ++p)
+	{
+		if (*p == '"' || *p == '\\')
+		{
+			char esc[2] = { '\\', *p };
+			err = json_append(json, esc, 2);
+		}
+		else if (*p < 0x20)
+		{
+			char esc[6] = { '\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xF] };
+			err = json_append(json, esc, 6);
+		}
+		else
+			err = json_append(json, (const char *)p, 1);
+	}
+	if (err || json_append(json, "\"", 1))
+		json->len = start;
+}
+
+void
+tr_json_uint(struct tr_json *json, const char *key, uint64_t val)
+{
+	json_number(json, key, "%llu", (unsigned long long)val);
+}
+
+void
+tr_json_int(struct tr_json *json, const char *key, int64_t val)
+{
+	json_number(json, key, "%lld", (long long)val);
+}
+
+void
+tr_json_double(struct tr_json *json, const char *key, double val, int precision)
+{
+	json_number(json, key, "%.*f", precision, val);
+}
+
+void
+tr_json_bool(struct tr_json *json, const char *key, int val)
+{
+	size_t start = json->len;
+
+	if (json_key(json, key) || json_append(json, val ? "true" : "false", val ? 4 : 5))
+		json->len = start;
+}
+
+/**
+ * Termine l'objet et l'écrit d'un bloc: les lignes de traces différentes ne
+ * peuvent donc pas se mélanger.
+ */
+void
+tr_json_end(struct tr_json *json, FILE *out)
+{
+	// La place de la fin de l'objet est toujours réservée
+	json->buf[json->len++] = '}';
+	json->buf[json->len++] = '\n';
+	(void)fwrite(json->buf, 1, json->len, out);
+}
+
+/**
+ * Commence un enregistrement de la trace, identifié par sa destination.
+ */
+static struct tr_json *
+json_record(struct tr_trace *trace, const char *type)
+{
+	struct tr_json *json = &trace->engine->json;
+	char addr[TR_ADDRSTRLEN];
+
+	tr_json_begin(json, type);
+	tr_json_str(json, "dst", tr_addr_ntop(trace->dst_addr, addr, sizeof(addr)));
+	return (json);
+}
+
+static void
+json_addr(struct tr_json *json, const char *key, uint32_t addr)
+{
+	char buf[TR_ADDRSTRLEN];
+
+	tr_json_str(json, key, tr_addr_ntop(addr, buf, sizeof(buf)));
+}
+
+void
+tr_json_trace(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+	struct tr_json *json = json_record(trace, "trace");
+
+	tr_json_str(json, "host", trace->host);
+	tr_json_str(json, "protocol", proto_names[params->protocol]);
+	tr_json_uint(json, "family", params->family == AF_INET6 ? 6 : 4);
+	tr_json_uint(json, "first_ttl", params->first_ttl);
+	tr_json_uint(json, "max_ttl", params->max_ttl);
+	tr_json_uint(json, "nprobes", params->nprobes);
+	tr_json_uint(json, "packet_len", params->packet_len);
+	tr_json_end(json, trace->out);
+}
+
+/**
+ * Résultat d'une probe terminée. `name` est le nom de l'émetteur de la réponse,
+ * déjà résolu par l'appelant.
+ */
+void
+tr_json_probe(struct tr_trace *trace, uint32_t ttl, uint32_t index, struct tr_probe *probe, const char *name)
+{
+	struct tr_json *json = json_record(trace, "probe");
+
+	tr_json_uint(json, "ttl", ttl);
+	tr_json_uint(json, "probe", index);
+	if (probe->state == TR_PROBE_REPLIED)
+	{
+		tr_json_str(json, "status", "reply");
+		json_addr(json, "addr", probe->from);
+		tr_json_str(json, "name", name);
+		tr_json_double(json, "rtt_ms", tr_probe_rtt(probe), 3);
+		tr_json_uint(json, "icmp_type", probe->icmp_type);
+		tr_json_uint(json, "icmp_code", probe->icmp_code);
+		tr_json_bool(json, "reached", probe->reached);
+	}
+	else if (probe->state == TR_PROBE_FAILED)
+	{
+		tr_json_str(json, "status", "error");
+		tr_json_int(json, "ret", probe->ret);
+	}
+	else
+		tr_json_str(json, "status", "timeout");
+	tr_json_end(json, trace->out);
+}
+
+/**
+ * Bilan d'un saut, après ses probes. Les probes sans réponse sont perdues.
+ */
+void
+tr_json_hop(struct tr_trace *trace, uint32_t ttl, uint32_t sent, uint32_t lost)
+{
+	struct tr_json *json = json_record(trace, "hop");
+
+	tr_json_uint(json, "ttl", ttl);
+	tr_json_uint(json, "sent", sent);
+	tr_json_uint(json, "lost", lost);
+	tr_json_double(json, "loss_pct", sent ? (double)lost * 100.0 / sent : 0.0, 1);
+	// Distribution des RTT du saut (-S)
+	if (summary(trace->params->flags) && trace->hists && trace->hists[ttl - trace->params->first_ttl].count)
+	{
+		const struct tr_histogram *hist = &trace->hists[ttl - trace->params->first_ttl];
+		tr_json_double(json, "rtt_min_ms", hist->min / 1000.0, 3);
+		tr_json_double(json, "rtt_p50_ms", tr_histogram_percentile(hist, 50) / 1000.0, 3);
+		tr_json_double(json, "rtt_p90_ms", tr_histogram_percentile(hist, 90) / 1000.0, 3);
+		tr_json_double(json, "rtt_p99_ms", tr_histogram_percentile(hist, 99) / 1000.0, 3);
+		tr_json_double(json, "rtt_max_ms", hist->max / 1000.0, 3);
+		tr_json_double(json, "jitter_ms", tr_histogram_jitter(hist) / 1000.0, 3);
+	}
+	tr_json_end(json, trace->out);
+}
+
+/**
+ * Sauts abandonnés par le sondage en arrière de Doubletree.
+ */
+void
+tr_json_skip(struct tr_trace *trace)
+{
+	struct tr_json *json = json_record(trace, "skip");
+
+	tr_json_uint(json, "first_ttl", trace->back_skip_ttl);
+	tr_json_uint(json, "last_ttl", trace->back_stop_ttl - 1);
+	json_addr(json, "addr", trace->back_stop_addr);
+	tr_json_uint(json, "seen_ttl", trace->back_stop_ttl);
+	tr_json_end(json, trace->out);
+}
+
+/**
+ * Fin de la trace et sa raison; `addr` est le routeur déjà vu pour un arrêt sur
+ * boucle ou sur l'ensemble d'arrêt global.
+ */
+void
+tr_json_done(struct tr_trace *trace)
+{
+	struct tr_json *json = json_record(trace, "done");
+
+	tr_json_str(json, "host", trace->host);
+	tr_json_str(json, "stop", stop_names[trace->stop]);
+	if (trace->stop == TR_STOP_LOOP || trace->stop == TR_STOP_STOP_SET)
+		json_addr(json, "addr", trace->stop_addr);
+	if (trace->end)
+		tr_json_uint(json, "last_ttl", (trace->end - 1) / trace->params->nprobes + trace->params->first_ttl);
+	tr_json_end(json, trace->out);
+}
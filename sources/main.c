@@ -24,380 +24,139 @@
 #include "traceroute.h"
 #include "pcolors.h"
 #include "debug.h"
-#include "ft_getopt.h"
 
-void
-usage(void)
-{
-	(void)fprintf(stderr, "Usage: traceroute [-dIrSv] [-f first_ttl] [-m max_ttl]\n");
-	(void)fprintf(stderr, "        [-p port] [-q nqueries] [-w waittime] host [packetlen]\n");
-	exit(64);
-}
-
-static double
-time_diff_ms(struct timespec start, struct timespec end)
+/**
+ * Lance la trace d'une requête sur les sockets fournis: vers l'hôte de la
+ * requête, ou vers chaque cible de son fichier de cibles.
+ */
+int
+tr_request_run(struct tr_request *req, int send_sock, int recv_sock)
 {
-	return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
-}
+	struct tr_params *params = &req->params;
+	FILE *targets = req->targets;
 
-static int
-get_probe_port(uint32_t ttl, uint32_t probe, struct tr_params *params)
-{
-	if (params->flags & TR_FLAG_FIXED_PORT)
+	if (targets == NULL && req->targets_path)
 	{
-		return (params->port);
+		targets = strcmp(req->targets_path, "-") == 0 ? stdin : tr_user_fopen(req->targets_path, "r");
+		if (targets == NULL)
+		{
+			tr_perr(req->targets_path);
+			return (1);
+		}
 	}
-	return (params->port + ttl * params->nprobes + probe);
-}
 
-int
-trace(int send_sock, int recv_sock, uint32_t dst_addr, struct tr_params *params)
-{
-	for (uint32_t ttl = params->first_ttl; ttl <= params->max_ttl; ++ttl)
+	/**
+	 * L'interface de sortie dépend de la destination: en mode multi-cibles
+	 * le choix est laissé au système pour chaque paquet, sauf si une interface
+	 * est imposée.
+	 */
+	uint32_t dst_addr = 0;
+	if (targets == NULL)
 	{
-		/**
-		 * Définit le TTL du socket d'envoi
-		 */
-		(void)setsockopt(send_sock, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
-
-		(void)printf("%2d  ", ttl);
-
-		uint32_t last_addr_reached = 0;
-		int dest_reached = 0;
-		size_t sent = 0;
-		uint32_t losses = 0;
-
-		for (uint32_t probe = 0; probe < params->nprobes; ++probe)
+		dst_addr = get_destination_ip_addr(req->target, params);
+		if (dst_addr == 0)
 		{
-			int got_reply = 0;
-
-			// Le port est calculé en fonction du TTL et du numéro de probe afin d'être unique
-			uint16_t current_port = get_probe_port(ttl, probe, params);
-
-			struct timespec start, end, now;
-			(void)clock_gettime(CLOCK_MONOTONIC, &start);
-
-			if ((sent = send_probe(send_sock, dst_addr, current_port, params)) <= 0)
-			{
-				printf(TR_PREFIX": wrote %s %u chars, ret=%zu", params->dest_host, params->packet_len, sent);
-				fflush(stdout);
-				continue;
-			}
-
-			/**
-			 * Le socket de réception étant brut il reçoit toutes les trames ICMP reçues par le système.
-			 * Il faut donc filtrer les réponse pour ne garder que celles correspondant aux probes envoyées.
-			 * Pour cela on lit les messages reçus jusqu'à ce qu'on trouve une réponse correspondante ou que le timeout
-			 * soit atteint.
-			 */
-			while (!got_reply)
-			{
-				(void)clock_gettime(CLOCK_MONOTONIC, &now);
-				// Calcule le temps écoulé depuis l'envoi de la probe
-				double elapsed = time_diff_ms(start, now);
-
-				// Si le temps écoulé dépasse le timeout, on arrête la réception
-				if (elapsed > params->waittime * 1000.0)
-					break;
-
-				// Calcule le temps restant pour select() afin de ne pas dépasser le timeout global
-				// et de désynchroniser les probes.
-				double remaining = (params->waittime * 1000.0) - elapsed;
-				if (remaining < 0)
-					remaining = 0;
-
-				struct timeval tv;
-				tv.tv_sec = (int)(remaining / 1000);
-				tv.tv_usec = (int)((remaining - tv.tv_sec * 1000) * 1000);
-
-				fd_set rfds;
-				FD_ZERO(&rfds);
-				FD_SET(recv_sock, &rfds);
-
-				int rv = select(recv_sock+1, &rfds, NULL, NULL, &tv);
-				if (rv <= 0)
-					break;
-
-				char buff[1024];
-				struct ip *ip;
-				struct icmp *icmp;
-				struct sockaddr_in from;
-				socklen_t fromlen = sizeof(from);
-
-				ssize_t n = recvfrom(recv_sock, buff, sizeof(buff), 0, (struct sockaddr*)&from, &fromlen);
-				if (n <= 0)
-					continue;
-
-				(void)clock_gettime(CLOCK_MONOTONIC, &end);
-
-				/**
-				 * Le packet reçu est une trame IP contenant un message ICMP, lui même
-				 * contenant la requête initiale.
-				 * ┌─────────────────────────────────────────┐
-				 * │ IP header                               │  ← ip
-				 * ├─────────────────────────────────────────┤
-				 * │ ICMP header (type=X, code=X)            │  ← icmp
-				 * ├─────────────────────────────────────────┤
-				 * │ Inner IP header (paquet original)       │  ← inner_ip
-				 * ├─────────────────────────────────────────┤
-				 * │ Proto header (paquet original)          │  ← inner_udp
-				 * └─────────────────────────────────────────┘
-				 */
-
-				ip = (struct ip *)buff;
-				int ip_header_len = ip->ip_hl * 4;
-				// Le contenu ICMP commence après l'en-tête IP
-				icmp = (struct icmp *)(buff + ip_header_len);
-
-				/**
-				 * Application du filtre de validation des réponses ICMP reçues
-				 * en fonction du protocole utilisé pour envoyer les probes.
-				 */
-				if (!is_valid_response(icmp, current_port, params))
-				{
-					if (verbose(params->flags))
-					{
-						print_verbose_response((uint8_t *)ip, n);
-					}
-					continue;
-				}
-
-				got_reply = 1;
+			(void)fprintf(tr_errout(), "traceroute: unknown host %s\n", req->target);
+			return (1);
+		}
+	}
 
-				/**
-				 * Lorsque le TTL est atteint, le router envoie un message ICMP de type 11 (Time Exceeded).
-				 * Lorsque la destination est atteinte, elle envoie un message ICMP de type 0 (Echo Reply)
-				 * ou de type 3 (Destination Unreachable) code 3 (Port Unreachable).
-				 */
-				if (icmp->icmp_type == ICMP_TIMXCEED
-					|| (icmp->icmp_type == ICMP_UNREACH && icmp->icmp_code == ICMP_UNREACH_PORT)
-					|| icmp->icmp_type == ICMP_ECHOREPLY)
-				{
-					if (last_addr_reached == 0)
-					{
-						print_router_name((struct sockaddr*)&from);
-						last_addr_reached = from.sin_addr.s_addr;
-					}
-					else if (last_addr_reached != 0 && last_addr_reached != from.sin_addr.s_addr)
-					{
-						(void)printf("%s%s", "\n", "    ");
-						print_router_name((struct sockaddr*)&from);
-						last_addr_reached = from.sin_addr.s_addr;
-					}
-					print_router_rtt(start, end);
-				}
+	if ((targets == NULL || params->ifname) && assign_iface(send_sock, dst_addr, params))
+		return (0);
 
-				if (icmp->icmp_type == ICMP_ECHOREPLY || (icmp->icmp_type == ICMP_UNREACH && icmp->icmp_code == ICMP_UNREACH_PORT))
-					dest_reached = 1;
-			}
-			if (!got_reply)
-			{
-				(void)printf("* ");
-				(void)fflush(stdout);
-				losses++;
-			}
-		}
-		if (summary(params->flags))
-		{
-			double loss_percent = ((double)losses / (double)params->nprobes) * 100.0;
-			(void)printf("(%.0f%% loss)", loss_percent);
-		}
-		(void)printf("\n");
+	if (params->protocol == TR_PROTO_UDP && !(params->flags & TR_FLAG_STATELESS))
+		params->sport = get_source_port(send_sock);
 
-		if (dest_reached)
-		{
-			break;
-		}
+	int res;
+	if (targets)
+	{
+		res = trace_targets(send_sock, recv_sock, targets, params);
+		if (targets != stdin && targets != req->targets)
+			(void)fclose(targets);
+	}
+	else
+	{
+		// Le rapport de la surveillance continue porte son propre en-tête
+		if (!json_output(params->flags) && !params->monitor)
+			(void)fprintf(tr_out(), TR_PREFIX" to %s (%s), %d hops max, %d byte packets\n", req->target, params->dest_host, params->max_ttl, params->packet_len);
+		res = trace(send_sock, recv_sock, dst_addr, params);
 	}
-	return (0);
+	return (res);
 }
 
 /**
  * Program params:
+ * -4, -6         : Trace over IPv4 or IPv6 (default is the family of host, IPv4 with --targets).
  * -d             : Enable socket level debug mode (SO_DEBUG).
  * -f first_ttl   : Set the initial time-to-live value (default is 1).
  * -I             : Use ICMP Echo Request as the probe protocol instead of UDP (-P icmp).
  * -m max_ttl     : Set the maximum time-to-live value (value of net.inet.ip.ttl).
- * -P protocol    : Set the protocol (udp, icmp, tcp, gre) (default is udp).
- * -p port        : Set the destination port (default is 33434).
+ * -N squeries    : Set the number of probes sent simultaneously, all TTLs included (default is 1).
+ * -P protocol    : Set the protocol (udp, icmp, tcp) (default is udp).
+ * -p port        : Set the destination port (default is 33434, 80 with tcp).
  * -q nqueries    : Set the number of probes per TTL (default is 3).
  * -r             : Do not use routing tables (SO_DONTROUTE).
- * -S             : Enable summary mode.
+ * -S             : Enable summary mode: loss, RTT percentiles and jitter of each hop.
  * -t tos         : Set the Type of Service field in the IP header.
  * -U			  : Use UDP to particular destination port for tracerouting (instead of increasing the port per each probe). Default port is 53 (dns).
  * -V             : Print version information and exit.
  * -v             : Enable verbose output.
- * -w waittime    : Set the timeout for each probe (default is 5 seconds).
+ * -w waittime    : Set the timeout for each probe, in seconds or in milliseconds with a ms suffix (default is 5 seconds).
+ * --targets file : Trace every host listed in file (one per line, - for stdin) instead of a single host.
+ * --concurrency n: Set the number of targets traced simultaneously with --targets (default is 32).
+ * --name-cache file: Set the persistent router name cache (default is /var/cache/ft_traceroute.names, none to disable).
+ * --stateless    : Encode the probe and its send time in the IP header of UDP and ICMP probes (IP_HDRINCL).
+ * --rate pps     : Limit the probe rate, all targets included, in packets per second.
+ * --bitrate bps  : Limit the probe rate in bits per second (k, M and G suffixes allowed).
+ * --burst n      : Set the number of probes that may be sent back to back when rate limited (default is 10).
+ * --adaptive     : Derive the timeout of each probe from the RTTs seen on the path, at most waittime.
+ * --min-wait time: Set the lowest adaptive timeout (default is 50ms).
+ * --gap-limit n  : Stop after n consecutive silent hops (exit status 2).
+ * --loop-limit n : Stop after n hops answered by a router already seen earlier on the path (exit status 3).
+ * --mda          : Enumerate every next hop of each TTL with flow-stable probes (Multipath Detection Algorithm).
+ * --mda-confidence pct: Set the confidence of the --mda stopping rule (default is 95).
+ * --doubletree ttl: Start each trace at ttl and skip the hops already seen by previous traces (Doubletree).
+ * --stop-set file: Load and save the --doubletree global stop set, to share it between runs.
+ * --json         : Print one JSON object per line for each trace, probe and hop (NDJSON).
+ * --archive file : Write every finished trace to a binary archive, read with trarchive.
+ * --daemon socket: Serve trace requests from local clients on a UNIX socket (see daemon.c).
+ * --monitor interval: Keep probing the hops found by the first cycle, every interval (same units as -w), and print a report after each cycle.
+ * --cycles n     : Stop --monitor after n cycles (default is to run until interrupted).
+ * --histograms file: Merge the RTT histogram of every router into file, shared between runs.
  */
 int
 main(int argc, char **argv)
 {
-	check_privileges();
+	struct tr_request req;
+	int send_sock, recv_sock;
 
-	int ch;
-	char* target;
-	int on = 1;
-	struct tr_params params;
+	check_privileges();
 
-	memset(&params, 0, sizeof(params));
-	
-	params.packet_len = TR_DEFAULT_PACKET_LEN;
-	params.max_ttl = get_max_ttl();
-	params.first_ttl = TR_DEFAULT_FIRST_TTL;
-	params.port = TR_DEFAULT_BASE_PORT;
-	params.nprobes = TR_DEFAULT_PROBES;
-	params.waittime = TR_DEFAULT_TIMEOUT;
-	params.protocol = TR_PROTO_UDP;
-	params.tos = TR_DEFAULT_TOS;
+	/**
+	 * Vers un tube ou un fichier, la sortie est tamponnée par grands blocs et
+	 * n'est vidée qu'à la fin de chaque saut ou de chaque trace (voir trace_flush_output).
+	 */
+	if (!isatty(STDOUT_FILENO))
+		(void)setvbuf(stdout, NULL, _IOFBF, TR_OUT_BUFSIZE);
 
-	struct getopt_list_s optlist[] = {
-		{"debug", 'd', OPTPARSE_NONE},
-		{"first", 'f', OPTPARSE_REQUIRED},
-		{"help", 'h', OPTPARSE_NONE},
-		{"icmp", 'I', OPTPARSE_NONE},
-		{"max-hops", 'm', OPTPARSE_REQUIRED},
-		{"protocol", 'P', OPTPARSE_REQUIRED},
-		{"port", 'p', OPTPARSE_REQUIRED},
-		{"queries", 'q', OPTPARSE_REQUIRED},
-		{"noroute", 'r', OPTPARSE_NONE},
-		{"summary", 'S', OPTPARSE_NONE},
-		{"tos", 't', OPTPARSE_REQUIRED},
-		{"udp", 'U', OPTPARSE_NONE},
-		{"version", 'V', OPTPARSE_NONE},
-		{"verbose", 'v', OPTPARSE_NONE},
-		{"wait", 'w', OPTPARSE_REQUIRED},
-		{0}
-	};
-	struct getopt_s options;
+	tr_request_init(&req);
+	if (tr_request_parse(&req, argc, argv))
+		return (req.status);
 
-	ft_getopt_init(&options, argv);
-	while ((ch = ft_getopt(&options, optlist, NULL)) != -1) {
-		switch (ch) {
-			case 'I':
-				params.protocol = TR_PROTO_ICMP;
-				break;
-			case 'd':
-				params.flags |= TR_FLAG_DEBUG;
-				break;
-			case 'r':
-				params.flags |= TR_FLAG_NOROUTE;
-				break;
-			case 'U':
-				params.protocol = TR_PROTO_UDP;
-				params.port = 53;
-				params.flags |= TR_FLAG_FIXED_PORT;
-				break;
-			case 'f':
-				params.first_ttl = tr_params("first ttl", options.optarg, 1, TR_MAX_FIRST_TTL);
-				break;
-			case 'm':
-				params.max_ttl = tr_params("max ttl", options.optarg, 1, TR_MAX_TTL);
-				break;
-			case 'P':
-				if ((params.protocol = set_protocol(options.optarg)) == 0)
-					return (1);
-				break;
-			case 'p':
-				params.port = tr_params("port", options.optarg, 1, TR_MAX_PORT);
-				break;
-			case 'q':
-				params.nprobes = tr_params("nprobes", options.optarg, 1, TR_MAX_PROBES);
-				break;
-			case 'S':
-				params.flags |= TR_FLAG_SUMMARY;
-				break;
-			case 't':
-				params.tos = tr_params("tos", options.optarg, 0, TR_MAX_TOS);
-				break;
-			case 'V':
-				(void)printf(TR_PREFIX" version 1.0 - mgama\n");
-				exit(0);
-			case 'v':
-				params.flags |= TR_FLAG_VERBOSE;
-				break;
-			case 'w':
-				params.waittime = tr_params("wait time", options.optarg, 1, TR_MAX_TIMEOUT);
-				break;
-			case 'h':
-				usage();
-				break;
-			case '?':
-            default:
-				printf("Unknown option -- %c\n", options.optopt);
-				usage();
-		}
-	}
-
-	if (argc - options.optind < 1 || argc - options.optind > 2)
-	{
-		usage();
-	}
-	target = argv[options.optind];
-	if (options.optind + 1 < argc && argv[options.optind + 1])
-	{
-		params.packet_len = tr_params("packet length", argv[options.optind + 1], 27, TR_MAX_PACKET_LEN);
-	}
+	if (req.daemon)
+		return (tr_daemon_run(&req));
 
-	int send_sock = create_socket(&params);
-	if (send_sock < 0)
-	{
-		tr_perr("socket");
+	if (tr_addrtab_init(req.params.family))
 		return (1);
-	}
-
-	if (params.flags & TR_FLAG_DEBUG)
-	{
-		(void)setsockopt(send_sock, SOL_SOCKET, SO_DEBUG, &on, sizeof(on));
-	}
-	if (params.flags & TR_FLAG_NOROUTE)
+	if (tr_open_sockets(&req.params, &send_sock, &recv_sock))
 	{
-		(void)setsockopt(send_sock, IPPROTO_IP, SO_DONTROUTE, &on, sizeof(on));
-	}
-
-	uint32_t dst_addr = get_destination_ip_addr(target, &params);
-	if (dst_addr == 0)
-	{
-		(void)fprintf(stderr, "traceroute: unknown host %s\n", target);
+		tr_addrtab_destroy();
 		return (1);
 	}
 
-	if (assign_iface(send_sock, dst_addr, &params))
-	{
-		(void)close(send_sock);
-		return (0);
-	}
-
-	if (params.tos >= 0)
-	{
-		if (setsockopt(send_sock, IPPROTO_IP, IP_TOS, &params.tos, sizeof(params.tos)) < 0)
-		{
-			perror("setsockopt IP_TOS");
-			return -1;
-		}
-	}
-	
-	int recv_sock = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-	if (recv_sock < 0)
-	{
-		tr_perr("socket");
-		(void)close(send_sock);
-		(void)close(recv_sock);
-		return (1);
-	}
-
-	if (params.flags & TR_FLAG_DEBUG)
-	{
-		(void)setsockopt(recv_sock, SOL_SOCKET, SO_DEBUG, &on, sizeof(on));
-	}
-	if (params.flags & TR_FLAG_NOROUTE)
-	{
-		(void)setsockopt(recv_sock, IPPROTO_IP, SO_DONTROUTE, &on, sizeof(on));
-	}
-
-	(void)printf(TR_PREFIX" to %s (%s), %d hops max, %d byte packets\n", target, params.dest_host, params.max_ttl, params.packet_len);
-
-	int res = trace(send_sock, recv_sock, dst_addr, &params);
+	int res = tr_request_run(&req, send_sock, recv_sock);
 	(void)close(send_sock);
 	(void)close(recv_sock);
+	tr_addrtab_destroy();
 	return (res);
 }
@@ -0,0 +1,49 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   mda.c                                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/20 10:31:18 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/20 10:31:18 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+
+/**
+ * NOTE:
+ * Découverte des chemins multiples (MDA, Multipath Detection Algorithm).
+ * Les répartiteurs de charge (ECMP) choisissent le saut suivant d'un paquet en
+ * fonction de son flux (adresses, protocole et ports): en mode --mda, toutes
+ * les probes d'un même flux ont les mêmes champs à tous les TTL (Paris
+ * traceroute), seuls l'identifiant IP et la checksum les distinguent. Chaque
+ * probe d'un saut utilise un flux différent, le numéro de probe servant
+ * d'identifiant de flux.
+ * Après avoir vu k interfaces à un saut, on envoie des probes sur de nouveaux
+ * flux jusqu'à ce que l'existence d'une k+1-ième interface, qui recevrait une
+ * part égale des flux, soit écartée avec la confiance demandée: c'est la règle
+ * d'arrêt du MDA (6, 11, 16, 21, 27... probes à 95 %).
+ */
+
+/**
+ * Nombre de probes à envoyer à un saut où `k` interfaces ont été vues, pour
+ * écarter une interface supplémentaire avec une confiance de `confidence` %:
+ * le plus petit n tel que (k / (k + 1))^n <= (1 - confiance) / (k + 1).
+ */
+uint32_t
+tr_mda_stop(uint32_t k, uint32_t confidence)
+{
+	double alpha = (100 - confidence) / 100.0 / (k + 1);
+	double ratio = (double)k / (k + 1);
+	double miss = 1.0;
+	uint32_t n = 0;
+
+	while (miss > alpha)
+	{
+		miss *= ratio;
+		n++;
+	}
+	return (n);
+}
@@ -0,0 +1,149 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   monitor.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/27 16:40:12 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/27 16:40:12 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "monitor.h"
+
+/**
+ * NOTE:
+ * Chaque saut conserve ses TR_MONITOR_HISTORY derniers échantillons dans un
+ * anneau: la mémoire ne dépend pas de la durée de la surveillance. L'entrée
+ * d'un échantillon fait sortir le plus ancien, et toutes les statistiques sont
+ * tenues à jour en temps constant (amorti pour le meilleur et le pire RTT), sans
+ * jamais reparcourir la fenêtre. Les sommes sont entières: retirer un
+ * échantillon n'accumule aucune erreur d'arrondi.
+ */
+
+static void
+hopstats_evict(struct tr_hopstats *stats, uint32_t seq)
+{
+	uint32_t rtt = stats->samples[seq & TR_MONITOR_MASK];
+
+	if (rtt == TR_MONITOR_LOST)
+		return;
+	stats->received--;
+	stats->sum -= rtt;
+	stats->sumsq -= (uint64_t)rtt * rtt;
+	if (stats->minq[stats->min_head & TR_MONITOR_MASK] == seq)
+		stats->min_head++;
+	if (stats->maxq[stats->max_head & TR_MONITOR_MASK] == seq)
+		stats->max_head++;
+}
+
+/**
+ * Ajoute le RTT d'une probe (µs), ou TR_MONITOR_LOST pour une probe perdue.
+ */
+void
+tr_hopstats_push(struct tr_hopstats *stats, uint32_t rtt_us)
+{
+	uint32_t seq = stats->seq;
+
+	if (stats->count == TR_MONITOR_HISTORY)
+		hopstats_evict(stats, seq - TR_MONITOR_HISTORY);
+	else
+		stats->count++;
+
+	stats->samples[seq & TR_MONITOR_MASK] = rtt_us;
+	stats->seq++;
+	if (rtt_us == TR_MONITOR_LOST)
+		return;
+
+	if (rtt_us > TR_MONITOR_RTT_MAX)
+		stats->samples[seq & TR_MONITOR_MASK] = rtt_us = TR_MONITOR_RTT_MAX;
+	stats->received++;
+	stats->sum += rtt_us;
+	stats->sumsq += (uint64_t)rtt_us * rtt_us;
+
+	// Les échantillons plus anciens et moins bons ne peuvent plus être en tête
+	while (stats->min_tail != stats->min_head
+		&& stats->samples[stats->minq[(stats->min_tail - 1) & TR_MONITOR_MASK] & TR_MONITOR_MASK] >= rtt_us)
+		stats->min_tail--;
+	stats->minq[stats->min_tail++ & TR_MONITOR_MASK] = seq;
+	while (stats->max_tail != stats->max_head
+		&& stats->samples[stats->maxq[(stats->max_tail - 1) & TR_MONITOR_MASK] & TR_MONITOR_MASK] <= rtt_us)
+		stats->max_tail--;
+	stats->maxq[stats->max_tail++ & TR_MONITOR_MASK] = seq;
+}
+
+/**
+ * Les accesseurs retournent TR_MONITOR_LOST lorsque la fenêtre ne contient
+ * aucune réponse.
+ */
+uint32_t
+tr_hopstats_last(const struct tr_hopstats *stats)
+{
+	if (stats->seq == 0)
+		return (TR_MONITOR_LOST);
+	return (stats->samples[(stats->seq - 1) & TR_MONITOR_MASK]);
+}
+
+uint32_t
+tr_hopstats_best(const struct tr_hopstats *stats)
+{
+	if (stats->min_head == stats->min_tail)
+		return (TR_MONITOR_LOST);
+	return (stats->samples[stats->minq[stats->min_head & TR_MONITOR_MASK] & TR_MONITOR_MASK]);
+}
+
+uint32_t
+tr_hopstats_worst(const struct tr_hopstats *stats)
+{
+	if (stats->max_head == stats->max_tail)
+		return (TR_MONITOR_LOST);
+	return (stats->samples[stats->maxq[stats->max_head & TR_MONITOR_MASK] & TR_MONITOR_MASK]);
+}
+
+uint32_t
+tr_hopstats_avg(const struct tr_hopstats *stats)
+{
+	if (stats->received == 0)
+		return (TR_MONITOR_LOST);
+	return ((uint32_t)(stats->sum / stats->received));
+}
+
+/**
+ * Écart type de la population des RTT de la fenêtre, arrondi à la microseconde
+ * inférieure.
+ */
+uint32_t
+tr_hopstats_stddev(const struct tr_hopstats *stats)
+{
+	if (stats->received == 0)
+		return (TR_MONITOR_LOST);
+
+	double mean = (double)stats->sum / stats->received;
+	double var = (double)stats->sumsq / stats->received - mean * mean;
+	if (var < 1.0)
+		return (0);
+
+	// Racine entière par la méthode de Newton, sans dépendre de libm
+	uint64_t n = (uint64_t)var;
+	uint64_t x = n;
+	uint64_t y = (x + 1) / 2;
+	while (y < x)
+	{
+		x = y;
+		y = (x + n / x) / 2;
+	}
+	return ((uint32_t)x);
+}
+
+/**
+ * Pourcentage de probes perdues dans la fenêtre.
+ */
+double
+tr_hopstats_loss(const struct tr_hopstats *stats)
+{
+	if (stats->count == 0)
+		return (0.0);
+	return ((double)(stats->count - stats->received) * 100.0 / stats->count);
+}
@@ -0,0 +1,213 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   namecache.c                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/17 14:26:12 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/17 14:26:12 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "namecache.h"
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * NOTE:
+ * Cache de noms persistant, partagé entre les exécutions successives ou
+ * simultanées de ft_traceroute. Le fichier est projeté en mémoire et sa
+ * disposition est fixe: une adresse est cherchée parmi TR_NAMECACHE_PROBES
+ * cases à partir de sa position d'origine, sans allocation ni appel système.
+ * Les lectures ne prennent aucun verrou: le compteur de séquence de l'entrée
+ * est relu après la copie, et la lecture est ignorée s'il a changé. Les
+ * écritures réservent l'entrée en rendant son compteur impair par un
+ * compare-and-swap; une entrée déjà réservée par un autre processus est
+ * simplement laissée de côté, le cache n'étant qu'une optimisation.
+ */
+
+_Static_assert(sizeof(struct tr_namecache_entry) == 256, "namecache entry layout");
+
+static inline uint32_t
+namecache_hash(uint32_t addr)
+{
+	return ((ntohl(addr) * 2654435761u) & (TR_NAMECACHE_SLOTS - 1));
+}
+
+/**
+ * Ouvre le cache, en le créant si nécessaire. Le fichier n'est jamais
+ * réinitialisé s'il existe avec un autre format: le cache est alors désactivé.
+ */
+int
+tr_namecache_open(struct tr_namecache *cache, const char *path)
+{
+	size_t size = sizeof(struct tr_namecache_entry) * (TR_NAMECACHE_SLOTS + 1);
+	struct stat st;
+
+	memset(cache, 0, sizeof(*cache));
+
+	/**
+	 * Le cache par défaut, dans un répertoire réservé à root, est partagé par
+	 * tous les utilisateurs et ouvert avec les droits de root. Un autre fichier
+	 * est ouvert avec les droits de l'utilisateur qui l'a désigné.
+	 */
+	int shared = strcmp(path, TR_NAMECACHE_PATH) == 0;
+	uid_t owner = shared ? geteuid() : getuid();
+	int fd = shared ? open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644)
+		: tr_user_open(path, O_RDWR | O_CREAT | O_NOFOLLOW, 0644);
+	if (fd < 0)
+		return (-1);
+
+	/**
+	 * La création est sérialisée par un verrou sur le fichier, afin que deux
+	 * exécutions simultanées n'initialisent pas l'en-tête en même temps.
+	 */
+	(void)flock(fd, LOCK_EX);
+	// Un fichier que d'autres peuvent modifier pourrait contenir de faux noms
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_uid != owner || (st.st_mode & (S_IWGRP | S_IWOTH)))
+		goto err;
+	if (st.st_size == 0 && ftruncate(fd, size) < 0)
+		goto err;
+	if (st.st_size != 0 && (size_t)st.st_size != size)
+		goto err;
+
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+
+	struct tr_namecache_header *header = map;
+	if (st.st_size == 0)
+	{
+		header->nslots = TR_NAMECACHE_SLOTS;
+		header->entry_size = sizeof(struct tr_namecache_entry);
+		header->version = TR_NAMECACHE_VERSION;
+		__atomic_store_n(&header->magic, TR_NAMECACHE_MAGIC, __ATOMIC_RELEASE);
+	}
+	if (header->magic != TR_NAMECACHE_MAGIC || header->version != TR_NAMECACHE_VERSION
+		|| header->nslots != TR_NAMECACHE_SLOTS || header->entry_size != sizeof(struct tr_namecache_entry))
+	{
+		(void)munmap(map, size);
+		goto err;
+	}
+	(void)flock(fd, LOCK_UN);
+	(void)close(fd);
+
+	cache->header = header;
+	// L'en-tête occupe la place d'une entrée, la table commence juste après
+	cache->entries = (struct tr_namecache_entry *)map + 1;
+	cache->size = size;
+	return (0);
+
+err:
+	(void)flock(fd, LOCK_UN);
+	(void)close(fd);
+	return (-1);
+}
+
+void
+tr_namecache_close(struct tr_namecache *cache)
+{
+	if (cache->header)
+		(void)munmap(cache->header, cache->size);
+	cache->header = NULL;
+}
+
+/**
+ * Cherche une adresse dans le cache. Retourne 1 et copie le nom si l'adresse
+ * a un nom, 0 si sa résolution a échoué récemment, -1 si elle est absente ou
+ * expirée.
+ */
+int
+tr_namecache_get(struct tr_namecache *cache, uint32_t addr, char *name, size_t namelen)
+{
+	if (cache->header == NULL || addr == 0)
+		return (-1);
+
+	time_t now = time(NULL);
+	uint32_t i = namecache_hash(addr);
+
+	for (int n = 0; n < TR_NAMECACHE_PROBES; ++n, i = (i + 1) & (TR_NAMECACHE_SLOTS - 1))
+	{
+		struct tr_namecache_entry *entry = &cache->entries[i];
+		struct tr_namecache_entry copy;
+
+		uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(&copy, entry, sizeof(copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if (copy.addr != addr)
+			continue;
+		if (copy.expires <= now)
+			return (-1);
+		if (!copy.resolved)
+			return (0);
+		if (copy.len >= namelen || copy.len >= TR_NAMECACHE_NAMELEN)
+			return (-1);
+		memcpy(name, copy.name, copy.len);
+		name[copy.len] = '\0';
+		return (1);
+	}
+	return (-1);
+}
+
+/**
+ * Enregistre le résultat d'une résolution; `name` vaut NULL en cas d'échec.
+ * L'entrée remplace celle de la même adresse, une case libre ou expirée, ou à
+ * défaut l'entrée à sa position d'origine.
+ */
+void
+tr_namecache_put(struct tr_namecache *cache, uint32_t addr, const char *name)
+{
+	if (cache->header == NULL || addr == 0)
+		return;
+
+	size_t len = name ? strlen(name) : 0;
+	// Les noms trop longs pour une entrée ne sont pas conservés
+	if (len >= TR_NAMECACHE_NAMELEN)
+		return;
+
+	time_t now = time(NULL);
+	uint32_t home = namecache_hash(addr);
+	uint32_t victim = home;
+	int found = 0;
+
+	for (int n = 0; n < TR_NAMECACHE_PROBES; ++n)
+	{
+		uint32_t i = (home + n) & (TR_NAMECACHE_SLOTS - 1);
+		struct tr_namecache_entry *entry = &cache->entries[i];
+		uint32_t entry_addr = __atomic_load_n(&entry->addr, __ATOMIC_RELAXED);
+
+		if (entry_addr == addr)
+		{
+			victim = i;
+			break;
+		}
+		if (!found && (entry_addr == 0 || __atomic_load_n(&entry->expires, __ATOMIC_RELAXED) <= now))
+		{
+			victim = i;
+			found = 1;
+		}
+	}
+
+	struct tr_namecache_entry *entry = &cache->entries[victim];
+	uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	if ((seq & 1) || !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	entry->addr = addr;
+	entry->expires = now + (name ? TR_NAMECACHE_TTL : TR_NAMECACHE_NEG_TTL);
+	entry->resolved = name != NULL;
+	entry->len = len;
+	if (name)
+		memcpy(entry->name, name, len);
+
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,482 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   options.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/25 09:41:07 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/25 09:41:07 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * NOTE:
+ * Analyse des options d'une exécution, depuis la ligne de commande ou depuis une
+ * requête d'un client du démon. Une valeur invalide ne termine jamais le
+ * processus: l'erreur est écrite sur la sortie d'erreur de l'exécution (voir
+ * tr_errout) et le code de sortie est laissé dans la requête.
+ */
+
+#include "traceroute.h"
+#include "ft_getopt.h"
+
+/**
+ * Options longues sans équivalent court.
+ */
+#define TR_OPT_TARGETS		256
+#define TR_OPT_CONCURRENCY	257
+#define TR_OPT_NAME_CACHE	258
+#define TR_OPT_STATELESS	259
+#define TR_OPT_RATE			260
+#define TR_OPT_BITRATE		261
+#define TR_OPT_BURST		262
+#define TR_OPT_ADAPTIVE		263
+#define TR_OPT_MIN_WAIT		264
+#define TR_OPT_GAP_LIMIT	265
+#define TR_OPT_LOOP_LIMIT	266
+#define TR_OPT_MDA			267
+#define TR_OPT_MDA_CONF		268
+#define TR_OPT_DOUBLETREE	269
+#define TR_OPT_STOP_SET		270
+#define TR_OPT_JSON			271
+#define TR_OPT_ARCHIVE		272
+#define TR_OPT_DAEMON		273
+#define TR_OPT_MONITOR		274
+#define TR_OPT_CYCLES		275
+#define TR_OPT_HISTOGRAMS	276
+
+static void
+usage(void)
+{
+	FILE *err = tr_errout();
+
+	(void)fprintf(err, "Usage: traceroute [-46dIrSv] [-f first_ttl] [-m max_ttl]\n");
+	(void)fprintf(err, "        [-N squeries] [-p port] [-q nqueries] [-w waittime] host [packetlen]\n");
+	(void)fprintf(err, "       traceroute [options] --targets file [--concurrency n] [packetlen]\n");
+	(void)fprintf(err, "       traceroute [options] --monitor interval [--cycles n] host [packetlen]\n");
+	(void)fprintf(err, "       traceroute --daemon socket [--name-cache file]\n");
+}
+
+/**
+ * Termine l'analyse: l'exécution s'arrête avec le code de sortie `status`.
+ */
+static int
+request_exit(struct tr_request *req, int status)
+{
+	req->status = status;
+	return (-1);
+}
+
+void
+tr_request_init(struct tr_request *req)
+{
+	struct tr_params *params = &req->params;
+
+	memset(req, 0, sizeof(*req));
+	params->packet_len = TR_DEFAULT_PACKET_LEN;
+	params->max_ttl = get_max_ttl();
+	params->first_ttl = TR_DEFAULT_FIRST_TTL;
+	params->port = TR_DEFAULT_BASE_PORT;
+	params->nprobes = TR_DEFAULT_PROBES;
+	params->squeries = TR_DEFAULT_SQUERIES;
+	params->concurrency = TR_DEFAULT_CONCURRENCY;
+	params->burst = TR_DEFAULT_BURST;
+	params->min_wait = TR_DEFAULT_MIN_WAIT;
+	params->mda_confidence = TR_MDA_DEFAULT_CONFIDENCE;
+	params->name_cache = TR_NAMECACHE_PATH;
+	params->waittime = TR_DEFAULT_TIMEOUT;
+	params->protocol = TR_PROTO_UDP;
+	params->tos = TR_DEFAULT_TOS;
+}
+
+/**
+ * Vérifie les combinaisons d'options et complète les paramètres qui en
+ * dépendent.
+ */
+static int
+request_check(struct tr_request *req, int port_set, int squeries_set, int nprobes_set)
+{
+	struct tr_params *params = &req->params;
+
+	// En TCP le port de destination est celui du service visé, les probes sont identifiées par leur port source
+	if (params->protocol == TR_PROTO_TCP)
+	{
+		params->flags &= ~TR_FLAG_FIXED_PORT;
+		if (!port_set)
+			params->port = TR_DEFAULT_TCP_PORT;
+	}
+
+	/**
+	 * Avec --mda, chaque probe d'un saut suit un flux différent: le nombre de
+	 * probes par saut est celui qu'exige la règle d'arrêt pour le nombre maximal
+	 * d'interfaces, et les probes de la première règle (6 à 95 %) sont envoyées
+	 * ensemble par défaut.
+	 */
+	if (params->flags & TR_FLAG_MDA)
+	{
+		if (params->protocol == TR_PROTO_TCP || (params->flags & TR_FLAG_FIXED_PORT))
+		{
+			tr_err("--mda is only supported with udp and icmp probes to varying ports");
+			return (-1);
+		}
+		params->nprobes = tr_mda_stop(TR_MDA_MAX_NEXTHOPS, params->mda_confidence);
+		if (params->nprobes > TR_MAX_PROBES)
+			params->nprobes = TR_MAX_PROBES;
+		if (!squeries_set)
+			params->squeries = tr_mda_stop(1, params->mda_confidence);
+	}
+
+	// Le TTL de départ de Doubletree est ramené dans l'intervalle sondé
+	if (params->doubletree)
+	{
+		if (params->flags & TR_FLAG_MDA)
+		{
+			tr_err("--doubletree can't be used with --mda");
+			return (-1);
+		}
+		if (params->doubletree < params->first_ttl)
+			params->doubletree = params->first_ttl;
+		if (params->doubletree > params->max_ttl)
+			params->doubletree = params->max_ttl;
+	}
+	else if (params->stop_set)
+	{
+		tr_err("--stop-set requires --doubletree");
+		return (-1);
+	}
+
+	/**
+	 * La surveillance continue reprend le chemin d'un seul hôte à chaque cycle:
+	 * une probe par saut et par cycle, toutes envoyées ensemble par défaut.
+	 */
+	if (params->monitor)
+	{
+		if (req->targets_path || (params->flags & (TR_FLAG_MDA | TR_FLAG_JSON)) || params->doubletree || params->archive)
+		{
+			tr_err("--monitor can't be used with --targets, --mda, --doubletree, --json or --archive");
+			return (-1);
+		}
+		if (!nprobes_set)
+			params->nprobes = 1;
+		if (!squeries_set)
+			params->squeries = TR_MAX_SQUERIES;
+	}
+	else if (params->cycles)
+	{
+		tr_err("--cycles requires --monitor");
+		return (-1);
+	}
+
+	// La sortie standard ne doit contenir que des enregistrements JSON
+	if (json_output(params->flags) && verbose(params->flags))
+	{
+		tr_err("--json can't be used with -v");
+		return (-1);
+	}
+
+	// Les probes TCP sont déjà reconnues sans état (voir tr_tcp_seq)
+	if ((params->flags & TR_FLAG_STATELESS) && params->protocol == TR_PROTO_TCP)
+	{
+		tr_err("--stateless is only supported with udp and icmp probes");
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * Une exécution ne trace qu'une famille d'adresses: sans -4 ni -6, celle de
+ * l'hôte à tracer, l'IPv4 pour un fichier de cibles.
+ */
+static int
+request_family(struct tr_request *req)
+{
+	struct tr_params *params = &req->params;
+
+	if (params->family == AF_UNSPEC)
+	{
+		params->family = req->target ? get_destination_family(req->target) : AF_INET;
+		if (params->family == AF_UNSPEC)
+		{
+			(void)fprintf(tr_errout(), "traceroute: unknown host %s\n", req->target);
+			return (-1);
+		}
+	}
+	if (params->family == AF_INET6)
+	{
+		if (params->protocol == TR_PROTO_TCP)
+		{
+			tr_err("tcp probes are not supported over IPv6");
+			return (-1);
+		}
+		if (params->flags & TR_FLAG_MDA)
+		{
+			tr_err("--mda is not supported over IPv6");
+			return (-1);
+		}
+		if (params->flags & TR_FLAG_STATELESS)
+		{
+			tr_err("--stateless is not supported over IPv6");
+			return (-1);
+		}
+		// Les fichiers ne contiennent que des adresses IPv4
+		if (params->stop_set)
+		{
+			tr_err("--stop-set is not supported over IPv6");
+			return (-1);
+		}
+		if (params->histograms)
+		{
+			tr_err("--histograms is not supported over IPv6");
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+/**
+ * Analyse les options et les arguments d'une exécution. Retourne 0 si la trace
+ * doit être lancée, -1 si l'exécution s'arrête là avec le code de sortie placé
+ * dans `req->status` (erreur, -h ou -V).
+ */
+int
+tr_request_parse(struct tr_request *req, int argc, char **argv)
+{
+	struct tr_params *params = &req->params;
+	int ch;
+	int val;
+	int port_set = 0;
+	int squeries_set = 0;
+	int nprobes_set = 0;
+
+	struct getopt_list_s optlist[] = {
+		{"ipv4", '4', OPTPARSE_NONE},
+		{"ipv6", '6', OPTPARSE_NONE},
+		{"debug", 'd', OPTPARSE_NONE},
+		{"first", 'f', OPTPARSE_REQUIRED},
+		{"help", 'h', OPTPARSE_NONE},
+		{"icmp", 'I', OPTPARSE_NONE},
+		{"max-hops", 'm', OPTPARSE_REQUIRED},
+		{"sim-queries", 'N', OPTPARSE_REQUIRED},
+		{"protocol", 'P', OPTPARSE_REQUIRED},
+		{"port", 'p', OPTPARSE_REQUIRED},
+		{"queries", 'q', OPTPARSE_REQUIRED},
+		{"noroute", 'r', OPTPARSE_NONE},
+		{"summary", 'S', OPTPARSE_NONE},
+		{"tos", 't', OPTPARSE_REQUIRED},
+		{"udp", 'U', OPTPARSE_NONE},
+		{"version", 'V', OPTPARSE_NONE},
+		{"verbose", 'v', OPTPARSE_NONE},
+		{"wait", 'w', OPTPARSE_REQUIRED},
+		{"targets", TR_OPT_TARGETS, OPTPARSE_REQUIRED},
+		{"concurrency", TR_OPT_CONCURRENCY, OPTPARSE_REQUIRED},
+		{"name-cache", TR_OPT_NAME_CACHE, OPTPARSE_REQUIRED},
+		{"stateless", TR_OPT_STATELESS, OPTPARSE_NONE},
+		{"rate", TR_OPT_RATE, OPTPARSE_REQUIRED},
+		{"bitrate", TR_OPT_BITRATE, OPTPARSE_REQUIRED},
+		{"burst", TR_OPT_BURST, OPTPARSE_REQUIRED},
+		{"adaptive", TR_OPT_ADAPTIVE, OPTPARSE_NONE},
+		{"min-wait", TR_OPT_MIN_WAIT, OPTPARSE_REQUIRED},
+		{"gap-limit", TR_OPT_GAP_LIMIT, OPTPARSE_REQUIRED},
+		{"loop-limit", TR_OPT_LOOP_LIMIT, OPTPARSE_REQUIRED},
+		{"mda", TR_OPT_MDA, OPTPARSE_NONE},
+		{"mda-confidence", TR_OPT_MDA_CONF, OPTPARSE_REQUIRED},
+		{"doubletree", TR_OPT_DOUBLETREE, OPTPARSE_REQUIRED},
+		{"stop-set", TR_OPT_STOP_SET, OPTPARSE_REQUIRED},
+		{"json", TR_OPT_JSON, OPTPARSE_NONE},
+		{"archive", TR_OPT_ARCHIVE, OPTPARSE_REQUIRED},
+		{"daemon", TR_OPT_DAEMON, OPTPARSE_REQUIRED},
+		{"monitor", TR_OPT_MONITOR, OPTPARSE_REQUIRED},
+		{"cycles", TR_OPT_CYCLES, OPTPARSE_REQUIRED},
+		{"histograms", TR_OPT_HISTOGRAMS, OPTPARSE_REQUIRED},
+		{0}
+	};
+	struct getopt_s options;
+
+	ft_getopt_init(&options, argv);
+	while ((ch = ft_getopt(&options, optlist, NULL)) != -1) {
+		// Une option numérique invalide a déjà été signalée par tr_params()
+		int bad = 0;
+
+		switch (ch) {
+			case '4':
+				params->family = AF_INET;
+				break;
+			case '6':
+				params->family = AF_INET6;
+				break;
+			case 'I':
+				params->protocol = TR_PROTO_ICMP;
+				break;
+			case 'd':
+				params->flags |= TR_FLAG_DEBUG;
+				break;
+			case 'r':
+				params->flags |= TR_FLAG_NOROUTE;
+				break;
+			case 'U':
+				params->protocol = TR_PROTO_UDP;
+				params->port = 53;
+				params->flags |= TR_FLAG_FIXED_PORT;
+				break;
+			case 'f':
+				bad = (val = tr_params("first ttl", options.optarg, 1, TR_MAX_FIRST_TTL)) < 0;
+				params->first_ttl = val;
+				break;
+			case 'm':
+				bad = (val = tr_params("max ttl", options.optarg, 1, TR_MAX_TTL)) < 0;
+				params->max_ttl = val;
+				break;
+			case 'N':
+				bad = (val = tr_params("sim queries", options.optarg, 1, TR_MAX_SQUERIES)) < 0;
+				params->squeries = val;
+				squeries_set = 1;
+				break;
+			case 'P':
+				bad = (params->protocol = set_protocol(options.optarg)) == 0;
+				break;
+			case 'p':
+				bad = (val = tr_params("port", options.optarg, 1, TR_MAX_PORT)) < 0;
+				params->port = val;
+				port_set = 1;
+				break;
+			case 'q':
+				bad = (val = tr_params("nprobes", options.optarg, 1, TR_MAX_PROBES)) < 0;
+				params->nprobes = val;
+				nprobes_set = 1;
+				break;
+			case 'S':
+				params->flags |= TR_FLAG_SUMMARY;
+				break;
+			case 't':
+				bad = (params->tos = tr_params("tos", options.optarg, 0, TR_MAX_TOS)) < 0;
+				break;
+			case 'V':
+				(void)fprintf(tr_out(), TR_PREFIX" version 1.0 - mgama\n");
+				return (request_exit(req, 0));
+			case 'v':
+				params->flags |= TR_FLAG_VERBOSE;
+				break;
+			case 'w':
+				bad = (params->waittime = tr_time_params("wait time", options.optarg, 1, TR_MAX_TIMEOUT)) == 0;
+				break;
+			case TR_OPT_TARGETS:
+				req->targets_path = options.optarg;
+				break;
+			case TR_OPT_CONCURRENCY:
+				bad = (val = tr_params("concurrency", options.optarg, 1, TR_MAX_CONCURRENCY)) < 0;
+				params->concurrency = val;
+				break;
+			case TR_OPT_NAME_CACHE:
+				params->name_cache = strcmp(options.optarg, "none") == 0 ? NULL : options.optarg;
+				break;
+			case TR_OPT_STATELESS:
+				params->flags |= TR_FLAG_STATELESS;
+				break;
+			case TR_OPT_RATE:
+				bad = (val = tr_params("rate", options.optarg, 1, TR_MAX_RATE)) < 0;
+				params->rate = val;
+				break;
+			case TR_OPT_BITRATE:
+				bad = (params->bitrate = tr_rate_params("bitrate", options.optarg)) == 0;
+				break;
+			case TR_OPT_BURST:
+				bad = (val = tr_params("burst", options.optarg, 1, TR_MAX_BURST)) < 0;
+				params->burst = val;
+				break;
+			case TR_OPT_ADAPTIVE:
+				params->flags |= TR_FLAG_ADAPTIVE;
+				break;
+			case TR_OPT_MIN_WAIT:
+				bad = (params->min_wait = tr_time_params("min wait", options.optarg, 1, TR_MAX_TIMEOUT)) == 0;
+				break;
+			case TR_OPT_GAP_LIMIT:
+				bad = (val = tr_params("gap limit", options.optarg, 1, TR_MAX_TTL)) < 0;
+				params->gap_limit = val;
+				break;
+			case TR_OPT_LOOP_LIMIT:
+				bad = (val = tr_params("loop limit", options.optarg, 1, TR_MAX_TTL)) < 0;
+				params->loop_limit = val;
+				break;
+			case TR_OPT_MDA:
+				params->flags |= TR_FLAG_MDA | TR_FLAG_STATELESS;
+				break;
+			case TR_OPT_MDA_CONF:
+				bad = (val = tr_params("mda confidence", options.optarg, TR_MDA_MIN_CONFIDENCE, TR_MDA_MAX_CONFIDENCE)) < 0;
+				params->mda_confidence = val;
+				break;
+			case TR_OPT_DOUBLETREE:
+				bad = (val = tr_params("doubletree ttl", options.optarg, 1, TR_MAX_TTL)) < 0;
+				params->doubletree = val;
+				break;
+			case TR_OPT_STOP_SET:
+				params->stop_set = options.optarg;
+				break;
+			case TR_OPT_JSON:
+				params->flags |= TR_FLAG_JSON;
+				break;
+			case TR_OPT_ARCHIVE:
+				params->archive = options.optarg;
+				break;
+			case TR_OPT_DAEMON:
+				req->daemon = options.optarg;
+				break;
+			case TR_OPT_MONITOR:
+				bad = (params->monitor = tr_time_params("monitor interval", options.optarg, 1, TR_MAX_TIMEOUT)) == 0;
+				break;
+			case TR_OPT_CYCLES:
+				bad = (val = tr_params("cycles", options.optarg, 1, TR_MAX_CYCLES)) < 0;
+				params->cycles = val;
+				break;
+			case TR_OPT_HISTOGRAMS:
+				params->histograms = options.optarg;
+				break;
+			case 'h':
+				usage();
+				return (request_exit(req, 64));
+			case '?':
+            default:
+				(void)fprintf(tr_out(), "Unknown option -- %c\n", options.optopt);
+				usage();
+				return (request_exit(req, 64));
+		}
+		if (bad)
+			return (request_exit(req, 1));
+	}
+
+	if (request_check(req, port_set, squeries_set, nprobes_set))
+		return (request_exit(req, 1));
+
+	// Le démon ne trace rien lui-même: chaque client envoie sa propre requête
+	if (req->daemon)
+	{
+		if (options.optind < argc || req->targets_path)
+		{
+			usage();
+			return (request_exit(req, 64));
+		}
+		return (0);
+	}
+
+	/**
+	 * En mode multi-cibles les hôtes sont lus depuis le fichier de cibles,
+	 * seule la taille des paquets peut être donnée en argument.
+	 */
+	int nargs = req->targets_path ? 0 : 1;
+	if (argc - options.optind < nargs || argc - options.optind > nargs + 1)
+	{
+		usage();
+		return (request_exit(req, 64));
+	}
+	req->target = req->targets_path ? NULL : argv[options.optind];
+	if (options.optind + nargs < argc && argv[options.optind + nargs])
+	{
+		if ((val = tr_params("packet length", argv[options.optind + nargs], 27, TR_MAX_PACKET_LEN)) < 0)
+			return (request_exit(req, 1));
+		params->packet_len = val;
+	}
+
+	if (request_family(req))
+		return (request_exit(req, 1));
+	return (0);
+}
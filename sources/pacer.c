@@ -0,0 +1,120 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   pacer.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/19 09:15:02 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/19 09:15:02 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "pacer.h"
+
+#include <sys/timerfd.h>
+
+/**
+ * NOTE:
+ * Les limites en paquets et en bits par seconde sont ramenées à un unique
+ * intervalle entre deux probes, toutes les probes d'une exécution ayant la
+ * même taille: la plus contraignante des deux l'emporte.
+ * Le crédit est compté en nanosecondes, la roue de timers (à la milliseconde)
+ * étant trop grossière pour espacer des probes envoyées à plusieurs milliers
+ * par seconde.
+ */
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+}
+
+/**
+ * Initialise le limiteur; `pps` et `bps` valent 0 lorsqu'ils ne sont pas
+ * limités, le limiteur laisse alors passer toutes les probes. `wire_len` est
+ * la taille d'une probe sur le réseau, en-tête IP compris.
+ */
+int
+tr_pacer_init(struct tr_pacer *pacer, uint64_t pps, uint64_t bps, uint32_t burst, size_t wire_len)
+{
+	memset(pacer, 0, sizeof(*pacer));
+	pacer->tfd = -1;
+
+	if (pps)
+		pacer->interval = 1000000000 / pps;
+	if (bps && (uint64_t)wire_len * 8 * 1000000000 / bps > pacer->interval)
+		pacer->interval = (uint64_t)wire_len * 8 * 1000000000 / bps;
+	if (pacer->interval == 0)
+		return (0);
+
+	pacer->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (pacer->tfd < 0)
+	{
+		tr_perr("timerfd_create");
+		return (-1);
+	}
+	pacer->capacity = pacer->interval * (burst ? burst : 1);
+	pacer->tokens = pacer->capacity;
+	pacer->last = now_ns();
+	return (0);
+}
+
+void
+tr_pacer_destroy(struct tr_pacer *pacer)
+{
+	if (pacer->tfd >= 0)
+		(void)close(pacer->tfd);
+	pacer->tfd = -1;
+}
+
+/**
+ * Consomme un jeton et retourne 1 si une probe peut être envoyée maintenant.
+ * Sinon retourne 0 et arme le timerfd à la date où le prochain jeton sera
+ * disponible.
+ */
+int
+tr_pacer_take(struct tr_pacer *pacer)
+{
+	if (pacer->interval == 0)
+		return (1);
+
+	uint64_t now = now_ns();
+	pacer->tokens += now - pacer->last;
+	if (pacer->tokens > pacer->capacity)
+		pacer->tokens = pacer->capacity;
+	pacer->last = now;
+
+	if (pacer->tokens >= pacer->interval)
+	{
+		pacer->tokens -= pacer->interval;
+		return (1);
+	}
+	if (pacer->armed)
+		return (0);
+
+	uint64_t at = now + pacer->interval - pacer->tokens;
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = at / 1000000000;
+	its.it_value.tv_nsec = at % 1000000000;
+	if (timerfd_settime(pacer->tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+		pacer->armed = 1;
+	return (0);
+}
+
+/**
+ * Acquitte l'expiration du timerfd.
+ */
+void
+tr_pacer_ack(struct tr_pacer *pacer)
+{
+	uint64_t count;
+
+	(void)!read(pacer->tfd, &count, sizeof(count));
+	pacer->armed = 0;
+}
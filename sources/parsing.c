@@ -24,20 +24,105 @@ isstringdigit(const char *str)
 	return (1);
 }
 
+/**
+ * Lit un entier compris entre `min` et `max`, positifs. Retourne -1 après avoir
+ * signalé une valeur invalide.
+ */
 int
 tr_params(const char *key, const char *val, int min, int max)
 {
 	if (!isstringdigit(val)) {
 		tr_bad_value(key, val);
+		return (-1);
 	}
 	int pval = atoi(val);
 	if (pval < min) {
-		(void)fprintf(stderr, TR_PREFIX": %s must be > %d\n", key, min - 1);
-		exit(1);
+		(void)fprintf(tr_errout(), TR_PREFIX": %s must be > %d\n", key, min - 1);
+		return (-1);
 	}
 	if (pval > max) {
-		(void)fprintf(stderr, TR_PREFIX": %s must be <= %d\n", key, max);
-		exit(1);
+		(void)fprintf(tr_errout(), TR_PREFIX": %s must be <= %d\n", key, max);
+		return (-1);
 	}
 	return (pval);
 }
+
+/**
+ * Lit un débit, éventuellement suivi d'un multiplicateur k, M ou G (puissances
+ * de 1000), par exemple 100M pour 100 000 000. Retourne 0 pour une valeur
+ * invalide.
+ */
+uint64_t
+tr_rate_params(const char *key, const char *val)
+{
+	char *end;
+
+	if (!isdigit(*val))
+	{
+		tr_bad_value(key, val);
+		return (0);
+	}
+	errno = 0;
+	uint64_t rate = strtoull(val, &end, 10);
+	uint64_t mult = 1;
+	switch (*end)
+	{
+	case 'k': case 'K':
+		mult = 1000ULL;
+		end++;
+		break;
+	case 'm': case 'M':
+		mult = 1000000ULL;
+		end++;
+		break;
+	case 'g': case 'G':
+		mult = 1000000000ULL;
+		end++;
+		break;
+	}
+	if (errno || *end || rate == 0 || rate > UINT64_MAX / mult)
+	{
+		tr_bad_value(key, val);
+		return (0);
+	}
+	return (rate * mult);
+}
+
+/**
+ * Lit une durée en millisecondes: un nombre de secondes, éventuellement
+ * décimal (0.25), ou un nombre de millisecondes suivi de `ms` (250ms).
+ * Retourne 0 pour une valeur invalide, `min` étant toujours positif.
+ */
+uint32_t
+tr_time_params(const char *key, const char *val, uint32_t min, uint32_t max)
+{
+	char *end;
+
+	if (!isdigit(*val))
+	{
+		tr_bad_value(key, val);
+		return (0);
+	}
+	errno = 0;
+	double time = strtod(val, &end);
+	if (strcmp(end, "ms") == 0)
+		;
+	else if (*end == '\0' || strcmp(end, "s") == 0)
+		time *= 1000;
+	else
+		errno = EINVAL;
+	if (errno)
+	{
+		tr_bad_value(key, val);
+		return (0);
+	}
+	if (time < min) {
+		(void)fprintf(tr_errout(), TR_PREFIX": %s must be >= %ums\n", key, min);
+		return (0);
+	}
+	if (time > max) {
+		(void)fprintf(tr_errout(), TR_PREFIX": %s must be <= %ums\n", key, max);
+		return (0);
+	}
+	return ((uint32_t)time);
+}
@@ -13,8 +13,249 @@
 #include "traceroute.h"
 #include "debug.h"
 
+/**
+ * NOTE:
+ * Les probes sont construites à partir d'un modèle préparé une seule fois
+ * (voir tr_template_init): le contenu n'est ni réalloué ni remis à zéro pour
+ * chaque probe, et la checksum ICMP est mise à jour de façon incrémentale au lieu
+ * d'être recalculée sur tout le paquet.
+ */
+
+/**
+ * Modèle du mode sans état: le paquet IP complet, dont seuls l'en-tête IP,
+ * l'en-tête UDP ou ICMP et les deux premiers octets de la charge utile sont
+ * propres à chaque probe (voir tr_template_stateless).
+ */
+static int
+tr_template_init_stateless(struct tr_template *tmpl, struct tr_params *params)
+{
+	size_t l4_len = params->protocol == TR_PROTO_UDP ? sizeof(struct udphdr) + params->packet_len : params->packet_len;
+
+	tmpl->len = sizeof(struct ip) + l4_len;
+	tmpl->packet = calloc(1, tmpl->len);
+	if (tmpl->packet == NULL)
+	{
+		tr_perr("calloc");
+		return (-1);
+	}
+
+	// Le noyau complète la checksum IP, et l'adresse source si elle est nulle
+	struct ip *ip = (struct ip *)tmpl->packet;
+	ip->ip_v   = 4;
+	ip->ip_hl  = sizeof(struct ip) / 4;
+	ip->ip_tos = params->tos >= 0 ? params->tos : 0;
+	ip->ip_len = htons(tmpl->len);
+	ip->ip_p   = params->protocol == TR_PROTO_UDP ? IPPROTO_UDP : IPPROTO_ICMP;
+
+	uint8_t *l4 = tmpl->packet + sizeof(struct ip);
+	if (params->protocol == TR_PROTO_UDP)
+	{
+		struct udphdr *udp = (struct udphdr *)l4;
+
+		udp->uh_sport = htons(tr_stateless_sport());
+		udp->uh_ulen  = htons(l4_len);
+		tmpl->payload_sum = htons(IPPROTO_UDP) + udp->uh_ulen;
+	}
+	else
+	{
+		struct icmp *icmp_hdr = (struct icmp *)l4;
+
+		icmp_hdr->icmp_type = ICMP_ECHO;
+		icmp_hdr->icmp_id   = htons(tr_ident());
+
+		// Les répartiteurs de charge lisent type, code et checksum à la place des ports
+		tmpl->flow_cksum = (params->flags & TR_FLAG_MDA) != 0;
+	}
+	tmpl->payload_sum += inet_csum_scalar(tmpl->packet + TR_STATELESS_HDRLEN, tmpl->len - TR_STATELESS_HDRLEN);
+	return (0);
+}
+
+int
+tr_template_init(struct tr_template *tmpl, struct tr_params *params)
+{
+	tmpl->tcp_sum = 0;
+	tmpl->payload_sum = 0;
+	tmpl->flow_cksum = 0;
+	tmpl->family = params->family;
+	if (params->flags & TR_FLAG_STATELESS)
+		return (tr_template_init_stateless(tmpl, params));
+
+	// Les probes TCP sont de simples SYN, sans charge utile
+	tmpl->len = params->protocol == TR_PROTO_TCP ? sizeof(struct tcphdr) : params->packet_len;
+	tmpl->packet = calloc(1, tmpl->len);
+	if (tmpl->packet == NULL)
+	{
+		tr_perr("calloc");
+		return (-1);
+	}
+
+	if (params->protocol == TR_PROTO_ICMP && params->family == AF_INET6)
+	{
+		/**
+		 * Un message Echo Request ICMPv6 a la même disposition qu'en ICMP. Sa
+		 * checksum couvre un pseudo-en-tête IPv6 et est calculée par le noyau
+		 * pour les sockets ICMPv6 bruts (RFC 3542).
+		 */
+		struct icmp6_hdr *icmp6 = (struct icmp6_hdr *)tmpl->packet;
+
+		icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
+		icmp6->icmp6_id   = htons(tr_ident());
+	}
+	else if (params->protocol == TR_PROTO_ICMP)
+	{
+		struct icmp *icmp_hdr = (struct icmp *)tmpl->packet;
+
+		icmp_hdr->icmp_type = ICMP_ECHO;
+		icmp_hdr->icmp_code = 0;
+		icmp_hdr->icmp_id   = htons(tr_ident());
+		icmp_hdr->icmp_seq  = 0;
+		icmp_hdr->icmp_cksum = 0;
+		icmp_hdr->icmp_cksum = inet_checksum(tmpl->packet, tmpl->len);
+	}
+	else if (params->protocol == TR_PROTO_TCP)
+	{
+		struct tcphdr *tcph = (struct tcphdr *)tmpl->packet;
+
+		tcph->th_dport = htons(params->port);
+		tcph->th_ack   = 0;
+		tcph->th_off   = sizeof(struct tcphdr) / 4;	// data offset in 32-bit words
+		tcph->th_flags = TH_SYN;					// SYN flag
+		tcph->th_win   = htons(64240);
+
+		/**
+		 * Le pseudo-header inclut des informations de l'en-tête IP
+		 * nécessaires pour le calcul de la checksum TCP: seuls le protocole et
+		 * la longueur sont communs à toutes les probes.
+		 */
+		tmpl->tcp_sum = inet_csum_scalar(tcph, sizeof(struct tcphdr)) + htons(IPPROTO_TCP) + htons(sizeof(struct tcphdr));
+	}
+	return (0);
+}
+
+void
+tr_template_destroy(struct tr_template *tmpl)
+{
+	free(tmpl->packet);
+	tmpl->packet = NULL;
+}
+
+/**
+ * Taille d'une probe sur le réseau, en-tête IP compris.
+ */
+size_t
+tr_template_wire_len(const struct tr_template *tmpl, struct tr_params *params)
+{
+	size_t ip_len = params->family == AF_INET6 ? sizeof(struct ip6_hdr) : sizeof(struct ip);
+
+	// En mode sans état le modèle contient déjà l'en-tête IP
+	if (params->flags & TR_FLAG_STATELESS)
+		return (tmpl->len);
+	if (params->protocol == TR_PROTO_UDP)
+		return (ip_len + sizeof(struct udphdr) + tmpl->len);
+	return (ip_len + tmpl->len);
+}
+
+/**
+ * Définit le TTL (nombre de sauts en IPv6) des paquets envoyés par le socket.
+ */
+void
+tr_set_ttl(int sock, int family, int ttl)
+{
+	if (family == AF_INET6)
+		(void)setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
+	else
+		(void)setsockopt(sock, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
+}
+
+/**
+ * Construit l'en-tête ICMP d'une probe à partir de celui du modèle: seul le
+ * numéro de séquence change, la checksum est ajustée en conséquence (RFC 1624).
+ */
+void
+tr_template_icmp(const struct tr_template *tmpl, struct icmp *icmp_hdr, uint16_t seq)
+{
+	memcpy(icmp_hdr, tmpl->packet, ICMP_MINLEN);
+	icmp_hdr->icmp_seq = htons(seq);
+	icmp_hdr->icmp_cksum = cksum_update(icmp_hdr->icmp_cksum, 0, icmp_hdr->icmp_seq);
+}
+
+/**
+ * Construit l'en-tête TCP d'une probe: le port source identifie la probe et le
+ * numéro de séquence permet de reconnaître nos probes dans les réponses (voir
+ * tr_tcp_seq). La checksum est complétée à partir de la somme du modèle.
+ */
+void
+tr_template_tcp(const struct tr_template *tmpl, struct tcphdr *tcph, uint32_t src_addr, uint32_t dst_addr, uint16_t sport)
+{
+	memcpy(tcph, tmpl->packet, sizeof(struct tcphdr));
+	tcph->th_sport = htons(sport);
+	tcph->th_seq   = htonl(tr_tcp_seq(sport));
+
+	uint64_t sum = tmpl->tcp_sum + src_addr + dst_addr + tcph->th_sport + tcph->th_seq;
+	tcph->th_sum = (uint16_t)~inet_csum_fold(sum);
+}
+
+/**
+ * Heure courante en unités de TR_STATELESS_TICK_NS, modulo 2^16: la checksum
+ * d'une probe ne peut porter que 16 bits, les RTT sont donc connus modulo
+ * 2^16 * TR_STATELESS_TICK_NS (environ 6,5 secondes).
+ */
+uint16_t
+tr_stateless_ticks(const struct timespec *ts)
+{
+	return ((uint16_t)(((uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec) / TR_STATELESS_TICK_NS));
+}
+
+/**
+ * Construit l'en-tête d'une probe du mode sans état: l'identifiant IP porte le
+ * TTL et le numéro de probe, la checksum UDP ou ICMP l'heure d'envoi. Les deux
+ * octets qui suivent l'en-tête sont choisis pour que la somme du message soit
+ * nulle, la checksum est ainsi valide quelle que soit la valeur portée.
+ * En ICMP le numéro de séquence porte aussi le TTL et le numéro de probe, la
+ * réponse de la destination (Echo Reply) ne citant pas l'en-tête IP. Avec
+ * --mda, la checksum ICMP porte le numéro de flux, constant à tous les TTL.
+ */
+void
+tr_template_stateless(const struct tr_template *tmpl, uint8_t *header, uint32_t src_addr, uint32_t dst_addr, uint32_t ttl, uint32_t probe, uint16_t port)
+{
+	struct timespec now;
+	struct ip *ip = (struct ip *)header;
+	uint8_t *l4 = header + sizeof(struct ip);
+	uint16_t *fudge = (uint16_t *)(l4 + ICMP_MINLEN);
+	uint64_t sum = tmpl->payload_sum;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	uint16_t sent = tr_stateless_ticks(&now);
+
+	memcpy(header, tmpl->packet, TR_STATELESS_HDRLEN);
+	ip->ip_ttl = ttl;
+	ip->ip_id  = htons(ttl << 8 | probe);
+	ip->ip_src.s_addr = src_addr;
+	ip->ip_dst.s_addr = dst_addr;
+
+	if (ip->ip_p == IPPROTO_UDP)
+	{
+		struct udphdr *udp = (struct udphdr *)l4;
+
+		udp->uh_dport = htons(port);
+		udp->uh_sum   = htons(sent);
+		sum += src_addr + dst_addr;
+	}
+	else
+	{
+		struct icmp *icmp_hdr = (struct icmp *)l4;
+
+		icmp_hdr->icmp_seq   = ip->ip_id;
+		icmp_hdr->icmp_cksum = htons(tmpl->flow_cksum ? probe : sent);
+	}
+
+	*fudge = 0;
+	sum += inet_csum_scalar(l4, ICMP_MINLEN);
+	*fudge = (uint16_t)~inet_csum_fold(sum);
+}
+
 static int
-send_probe_udp(int send_sock, uint32_t dst_addr, uint16_t current_port, struct tr_params *params)
+send_probe_udp(int send_sock, uint32_t dst_addr, uint16_t current_port, const struct tr_template *tmpl)
 {
 	/**
 	 * Les trames UDP suivent la structure suivante :
@@ -26,90 +267,34 @@ send_probe_udp(int send_sock, uint32_t dst_addr, uint16_t current_port, struct t
 	 * │ payload (données)          │
 	 * └────────────────────────────┘
 	 */
-	uint8_t payload[TR_MAX_PACKET_LEN];
-
-	memset(payload, 0, params->packet_len);
-
-	struct sockaddr_in dst;
-	memset(&dst, 0, sizeof(dst));
+	union tr_sockaddr dst;
+	socklen_t dst_len = tr_sockaddr_set(&dst, dst_addr, current_port);
 
-	dst.sin_family = AF_INET;
-	dst.sin_addr = *(struct in_addr *)&dst_addr;
-	dst.sin_port = htons(current_port);
-
-	return (sendto(send_sock, payload, params->packet_len, 0, (struct sockaddr*)&dst, sizeof(dst)));
+	return (sendto(send_sock, tmpl->packet, tmpl->len, 0, &dst.sa, dst_len));
 }
 
 static int
-send_probe_tcp(int send_sock, uint32_t dst_addr, uint16_t current_port, struct tr_params *params)
+send_probe_tcp(int send_sock, uint32_t src_addr, uint32_t dst_addr, uint16_t current_port, const struct tr_template *tmpl)
 {
 	/**
-	 * INFO:
-	 * Cette fonction est un test d'une implémentation basique d'envoi de paquets TCP SYN
+	 * Les probes TCP sont des segments SYN vers le port du service visé: ils
+	 * traversent les pare-feux qui ne laissent passer que ce service. Le noyau
+	 * construit l'en-tête IP, on ne fournit que l'en-tête TCP.
 	 */
-
 	struct tcphdr tcph;
-	memset(&tcph, 0, sizeof(tcph));
-
-	srand((unsigned)time(NULL) ^ (unsigned)getpid());
-	// Génère un port source aléatoire entre 1024 et 65535
-	uint16_t src_port = (uint16_t)(1024 + (rand() % (65535-1024)));
-
-	tcph.th_sport = htons(src_port);
-	tcph.th_dport = htons(current_port);
-	tcph.th_seq   = htonl((uint32_t)rand());
-	tcph.th_ack   = 0;
-	tcph.th_off   = sizeof(struct tcphdr) / 4;	// data offset in 32-bit words
-	tcph.th_flags = TH_SYN;						// SYN flag
-	tcph.th_win   = htons(64240);
-	tcph.th_urp   = 0;
-	tcph.th_sum   = 0;
-
-	/**
-	 * Le pseudo-header inclut des informations de l'en-tête IP
-	 * nécessaires pour le calcul de la checksum TCP.
-	 */
-	struct {
-		uint32_t saddr;
-		uint32_t daddr;
-		uint8_t  zero;
-		uint8_t  proto;
-		uint16_t tcp_len;
-	} psh;
-
-	psh.saddr = params->local_addr;
-	psh.daddr = dst_addr;
-	psh.zero  = 0;
-	psh.proto = IPPROTO_TCP;
-	psh.tcp_len = htons(sizeof(struct tcphdr));
-
-	size_t psize = sizeof(psh) + sizeof(struct tcphdr);
-	uint8_t pbuf[sizeof(psh) + sizeof(struct tcphdr)];
-
-	memcpy(pbuf, &psh, sizeof(psh));
-	memcpy(pbuf + sizeof(psh), &tcph, sizeof(struct tcphdr));
-
-	tcph.th_sum = tcp_checksum(pbuf, psize);
-
-	size_t packet_len = sizeof(struct tcphdr);
-	uint8_t packet[sizeof(struct tcphdr)];
-	memcpy(packet, &tcph, sizeof(struct tcphdr));
+	tr_template_tcp(tmpl, &tcph, src_addr, dst_addr, current_port);
 
 	struct sockaddr_in dst;
 	memset(&dst, 0, sizeof(dst));
 	dst.sin_family = AF_INET;
 	dst.sin_addr.s_addr = dst_addr;
-	dst.sin_port = tcph.th_dport;
 
-	return (sendto(send_sock, packet, packet_len, 0, (struct sockaddr *)&dst, sizeof(dst)));
+	return (sendto(send_sock, &tcph, sizeof(tcph), 0, (struct sockaddr *)&dst, sizeof(dst)));
 }
 
 static int
-send_probe_icmp(int send_sock, uint32_t dst_addr, uint16_t current_port, struct tr_params *params)
+send_probe_icmp(int send_sock, uint32_t dst_addr, uint16_t current_port, const struct tr_template *tmpl)
 {
-	(void)current_port;
-	(void)params;
-
 	/**
 	 * Les trames ICMP suivent la structure suivante :
 	 * ┌────────────────────────────┐
@@ -125,30 +310,26 @@ send_probe_icmp(int send_sock, uint32_t dst_addr, uint16_t current_port, struct
 	 * │ payload (facultatif)       │
 	 * └────────────────────────────┘
 	 */
-	struct icmp icmp_hdr;
-	memset(&icmp_hdr, 0, sizeof(icmp_hdr));
-
-	icmp_hdr.icmp_type = ICMP_ECHO;
-	icmp_hdr.icmp_code = 0;
-	icmp_hdr.icmp_id   = htons(getpid() & 0xFFFF);
-	icmp_hdr.icmp_seq  = htons(current_port);
-
-	uint8_t packet[TR_MAX_PACKET_LEN];
-	size_t packet_data = params->packet_len - sizeof(icmp_hdr);
-
-	memcpy(packet, &icmp_hdr, sizeof(icmp_hdr));
-	memset(packet + sizeof(icmp_hdr), 0, packet_data);
+	// Seuls ICMP_MINLEN octets sont envoyés, mais le tampon doit contenir une struct icmp
+	struct icmp header;
+	tr_template_icmp(tmpl, &header, current_port);
 
-	struct icmp *icmp_packet = (struct icmp *)packet;
-	icmp_packet->icmp_cksum = icmp_checksum(packet, params->packet_len);
+	union tr_sockaddr dst;
+	socklen_t dst_len = tr_sockaddr_set(&dst, dst_addr, 0);
 
-	struct sockaddr_in dst;
-	memset(&dst, 0, sizeof(dst));
-
-	dst.sin_family = AF_INET;
-	dst.sin_addr = *(struct in_addr *)&dst_addr;
+	// L'en-tête est envoyé avec la charge utile du modèle, sans copie du paquet
+	struct iovec iov[2] = {
+		{ .iov_base = &header, .iov_len = ICMP_MINLEN },
+		{ .iov_base = tmpl->packet + ICMP_MINLEN, .iov_len = tmpl->len - ICMP_MINLEN },
+	};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &dst;
+	msg.msg_namelen = dst_len;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
 
-	return (sendto(send_sock, packet, params->packet_len, 0, (struct sockaddr *)&dst, sizeof(dst)));
+	return (sendmsg(send_sock, &msg, 0));
 }
 
 static int
@@ -167,18 +348,156 @@ send_probe_gre(int send_sock, uint32_t dst_addr, uint16_t current_port, struct t
 }
 
 int
-send_probe(int send_sock, uint32_t dst_addr, uint16_t current_port, struct tr_params *params)
+send_probe(int send_sock, uint32_t src_addr, uint32_t dst_addr, uint16_t current_port, const struct tr_template *tmpl, struct tr_params *params)
 {
 	switch (params->protocol)
 	{
 	case TR_PROTO_UDP:
-		return (send_probe_udp(send_sock, dst_addr, current_port, params));
+		return (send_probe_udp(send_sock, dst_addr, current_port, tmpl));
 	case TR_PROTO_TCP:
-		return (send_probe_tcp(send_sock, dst_addr, current_port, params));
+		return (send_probe_tcp(send_sock, src_addr, dst_addr, current_port, tmpl));
 	case TR_PROTO_ICMP:
-		return (send_probe_icmp(send_sock, dst_addr, current_port, params));
+		return (send_probe_icmp(send_sock, dst_addr, current_port, tmpl));
 	case TR_PROTO_GRE:
 		return (send_probe_gre(send_sock, dst_addr, current_port, params));
 	}
 	return (0);
 }
+
+/**
+ * NOTE:
+ * Envoi groupé des probes: un lot de probes, éventuellement de TTL différents,
+ * est envoyé par un unique appel à sendmmsg(). Le TTL de chaque message est
+ * transmis par un message de contrôle IP_TTL plutôt que par un setsockopt()
+ * par saut.
+ * La charge utile du modèle est partagée par tous les messages du lot, seul
+ * l'en-tête ICMP ou TCP est propre à chaque probe.
+ */
+
+int
+tr_batch_supported(struct tr_params *params)
+{
+	return (params->protocol == TR_PROTO_UDP || params->protocol == TR_PROTO_ICMP || params->protocol == TR_PROTO_TCP);
+}
+
+void
+tr_batch_init(struct tr_sendbatch *batch, const struct tr_template *tmpl)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->tmpl = tmpl;
+}
+
+void
+tr_batch_add(struct tr_sendbatch *batch, uint32_t src_addr, uint32_t dst_addr, uint32_t ttl, uint16_t current_port, uint32_t tag, struct tr_params *params)
+{
+	size_t i = batch->count++;
+	struct msghdr *msg = &batch->msgs[i].msg_hdr;
+
+	memset(msg, 0, sizeof(*msg));
+	msg->msg_name = &batch->dst[i];
+	msg->msg_namelen = tr_sockaddr_set(&batch->dst[i], dst_addr, 0);
+	msg->msg_iov = batch->iov[i];
+
+	if (params->flags & TR_FLAG_STATELESS)
+	{
+		// Le tag est l'index de la probe dans sa trace
+		tr_template_stateless(batch->tmpl, batch->header[i], src_addr, dst_addr, ttl, tag % params->nprobes, current_port);
+
+		batch->iov[i][0].iov_base = batch->header[i];
+		batch->iov[i][0].iov_len = TR_STATELESS_HDRLEN;
+		batch->iov[i][1].iov_base = batch->tmpl->packet + TR_STATELESS_HDRLEN;
+		batch->iov[i][1].iov_len = batch->tmpl->len - TR_STATELESS_HDRLEN;
+		msg->msg_iovlen = 2;
+	}
+	else if (params->protocol == TR_PROTO_ICMP)
+	{
+		struct icmp *icmp_hdr = (struct icmp *)batch->header[i];
+
+		tr_template_icmp(batch->tmpl, icmp_hdr, current_port);
+
+		batch->iov[i][0].iov_base = icmp_hdr;
+		batch->iov[i][0].iov_len = ICMP_MINLEN;
+		batch->iov[i][1].iov_base = batch->tmpl->packet + ICMP_MINLEN;
+		batch->iov[i][1].iov_len = batch->tmpl->len - ICMP_MINLEN;
+		msg->msg_iovlen = 2;
+	}
+	else if (params->protocol == TR_PROTO_TCP)
+	{
+		struct tcphdr *tcph = (struct tcphdr *)batch->header[i];
+
+		tr_template_tcp(batch->tmpl, tcph, src_addr, dst_addr, current_port);
+
+		batch->iov[i][0].iov_base = tcph;
+		batch->iov[i][0].iov_len = sizeof(struct tcphdr);
+		msg->msg_iovlen = 1;
+	}
+	else
+	{
+		msg->msg_namelen = tr_sockaddr_set(&batch->dst[i], dst_addr, current_port);
+		batch->iov[i][0].iov_base = batch->tmpl->packet;
+		batch->iov[i][0].iov_len = batch->tmpl->len;
+		msg->msg_iovlen = 1;
+	}
+
+	msg->msg_control = batch->control[i].buf;
+	msg->msg_controllen = sizeof(batch->control[i].buf);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = batch->tmpl->family == AF_INET6 ? IPPROTO_IPV6 : IPPROTO_IP;
+	cmsg->cmsg_type = batch->tmpl->family == AF_INET6 ? IPV6_HOPLIMIT : IP_TTL;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	*(int *)CMSG_DATA(cmsg) = ttl;
+
+	batch->tag[i] = tag;
+	batch->ret[i] = -1;
+}
+
+/**
+ * Envoi probe par probe lorsque le noyau ne supporte pas sendmmsg() ou le TTL
+ * en message de contrôle: le TTL est alors défini sur le socket.
+ */
+static void
+batch_flush_fallback(struct tr_sendbatch *batch, int send_sock, size_t from)
+{
+	for (size_t i = from; i < batch->count; ++i)
+	{
+		struct msghdr *msg = &batch->msgs[i].msg_hdr;
+		int ttl = *(int *)CMSG_DATA(CMSG_FIRSTHDR(msg));
+
+		if (ttl != batch->current_ttl)
+		{
+			tr_set_ttl(send_sock, batch->tmpl->family, ttl);
+			batch->current_ttl = ttl;
+		}
+		msg->msg_control = NULL;
+		msg->msg_controllen = 0;
+		batch->ret[i] = sendmsg(send_sock, msg, 0);
+	}
+}
+
+void
+tr_batch_flush(struct tr_sendbatch *batch, int send_sock)
+{
+	size_t off = 0;
+
+	while (off < batch->count && !batch->fallback)
+	{
+		int sent = sendmmsg(send_sock, batch->msgs + off, batch->count - off, 0);
+		if (sent < 0)
+		{
+			if (errno == ENOSYS || (errno == EINVAL && off == 0))
+			{
+				batch->fallback = 1;
+				break;
+			}
+			// Le message en erreur est ignoré, on reprend l'envoi au suivant
+			batch->ret[off++] = -1;
+			continue;
+		}
+		for (int i = 0; i < sent; ++i, ++off)
+			batch->ret[off] = batch->msgs[off].msg_len;
+	}
+
+	if (batch->fallback)
+		batch_flush_fallback(batch, send_sock, off);
+}
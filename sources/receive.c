@@ -0,0 +1,185 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   receive.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/17 09:40:15 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/17 09:40:15 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+/**
+ * NOTE:
+ * Le socket de réception étant brut, il reçoit toutes les trames ICMP reçues par
+ * le système. Plutôt que de lire une trame par réveil, on vide le socket par
+ * lots de TR_RECV_BATCH trames avec recvmmsg(), dans des tampons alloués une
+ * seule fois au démarrage.
+ */
+
+int
+tr_ring_init(struct tr_recvring *ring, int recv_sock)
+{
+	int size = TR_RECV_SOCKBUF;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->buffers = malloc(TR_RECV_BATCH * TR_RECV_BUFLEN);
+	if (ring->buffers == NULL)
+	{
+		tr_perr("malloc");
+		return (-1);
+	}
+
+	for (int i = 0; i < TR_RECV_BATCH; ++i)
+	{
+		ring->iov[i].iov_base = ring->buffers + i * TR_RECV_BUFLEN;
+		ring->iov[i].iov_len = TR_RECV_BUFLEN;
+	}
+
+	/**
+	 * Agrandit le tampon de réception du socket afin d'absorber les rafales de
+	 * réponses lorsque de nombreuses probes sont en vol. SO_RCVBUFFORCE permet
+	 * de dépasser la limite système, on se rabat sur SO_RCVBUF sinon.
+	 */
+	if (setsockopt(recv_sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+		(void)setsockopt(recv_sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	return (0);
+}
+
+void
+tr_ring_destroy(struct tr_recvring *ring)
+{
+	free(ring->buffers);
+	ring->buffers = NULL;
+}
+
+/**
+ * Lit jusqu'à TR_RECV_BATCH trames sans bloquer, retourne le nombre de trames
+ * lues, 0 si le socket est vide.
+ */
+int
+tr_ring_drain(struct tr_recvring *ring, int recv_sock)
+{
+	for (int i = 0; i < TR_RECV_BATCH; ++i)
+	{
+		struct msghdr *msg = &ring->msgs[i].msg_hdr;
+
+		memset(msg, 0, sizeof(*msg));
+		msg->msg_name = &ring->from[i];
+		msg->msg_namelen = sizeof(ring->from[i]);
+		msg->msg_iov = &ring->iov[i];
+		msg->msg_iovlen = 1;
+		msg->msg_control = ring->control[i].buf;
+		msg->msg_controllen = sizeof(ring->control[i].buf);
+	}
+
+	int n = recvmmsg(recv_sock, ring->msgs, TR_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if (n < 0)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			tr_perr("recvmmsg");
+		return (0);
+	}
+	return (n);
+}
+
+/**
+ * Récupère l'horodatage noyau (SO_TIMESTAMPNS) de la i-ème trame du lot.
+ */
+int
+tr_ring_timestamp(struct tr_recvring *ring, int i, struct timespec *ts)
+{
+	struct msghdr *msg = &ring->msgs[i].msg_hdr;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+			return (1);
+		}
+	}
+	return (0);
+}
+
+/**
+ * NOTE:
+ * Les RTT mesurés avec clock_gettime() en espace utilisateur incluent la latence
+ * d'ordonnancement et de réveil du processus. On demande donc au noyau d'horodater
+ * les probes au moment de leur émission par le pilote (SO_TIMESTAMPING) et les
+ * réponses à leur arrivée (SO_TIMESTAMPNS).
+ * Retourne 1 si l'horodatage d'émission est disponible.
+ */
+int
+tr_timestamping_enable(int send_sock, int recv_sock)
+{
+	int on = 1;
+	int flags = SOF_TIMESTAMPING_TX_SOFTWARE
+		| SOF_TIMESTAMPING_SOFTWARE
+		| SOF_TIMESTAMPING_OPT_ID
+		| SOF_TIMESTAMPING_OPT_TSONLY;
+
+	(void)setsockopt(recv_sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+
+	if (setsockopt(send_sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+		return (0);
+	return (1);
+}
+
+/**
+ * Lit un horodatage d'émission dans la file d'erreurs du socket d'envoi.
+ * Retourne 1 si un horodatage a été lu, 0 si la file est vide, -1 si le message
+ * lu n'est pas un horodatage.
+ */
+int
+tr_txstamp_read(int send_sock, uint32_t *key, struct timespec *ts)
+{
+	/**
+	 * Lorsque le socket horodate aussi les trames reçues (socket TCP), le message
+	 * d'erreur porte en plus un horodatage SCM_TIMESTAMPNS.
+	 */
+	union {
+		char			buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+		struct cmsghdr	align;
+	} control;
+	uint8_t data[64];
+	struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+	struct msghdr msg;
+	int found = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	if (recvmsg(send_sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+		return (0);
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+		{
+			struct scm_timestamping *tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+			// L'horodatage logiciel est le premier des trois
+			*ts = tss->ts[0];
+			found |= 1;
+		}
+		else if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+			|| (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+		{
+			struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+				continue;
+			*key = serr->ee_data;
+			found |= 2;
+		}
+	}
+	return (found == 3 ? 1 : -1);
+}
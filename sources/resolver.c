@@ -0,0 +1,281 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   resolver.c                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/17 09:44:03 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/17 09:44:03 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "resolver.h"
+
+#include <sys/eventfd.h>
+
+/**
+ * NOTE:
+ * getnameinfo() est bloquant et une requête PTR sans réponse peut prendre
+ * plusieurs secondes: appelé entre deux probes, il retarde toute la trace.
+ * Les résolutions sont donc confiées à des threads et le thread principal
+ * continue d'envoyer et de recevoir des probes. Chaque adresse n'est résolue
+ * qu'une seule fois, y compris en cas d'échec (cache négatif), ce qui évite de
+ * relancer une requête pour chaque probe d'un routeur sans nom.
+ * Les résultats sont aussi conservés dans un cache persistant (voir namecache.c)
+ * consulté avant toute résolution, qui évite aux exécutions suivantes de
+ * résoudre à nouveau les mêmes routeurs. Ce cache n'est indexé que par des
+ * adresses IPv4: en IPv6, les noms ne sont conservés qu'en mémoire.
+ */
+
+static inline uint32_t
+name_hash(uint32_t addr, uint32_t mask)
+{
+	return ((ntohl(addr) * 2654435761u) & mask);
+}
+
+/**
+ * Effectue la résolution inverse d'une adresse; NULL si aucun nom n'est associé.
+ */
+static char *
+resolve_addr(const struct tr_name *entry)
+{
+	char hbuf[NI_MAXHOST];
+	union tr_sockaddr sa;
+	socklen_t salen;
+
+	memset(&sa, 0, sizeof(sa));
+	if (entry->family == AF_INET6)
+	{
+		sa.sin6.sin6_family = AF_INET6;
+		sa.sin6.sin6_addr = entry->addr6;
+		salen = sizeof(sa.sin6);
+	}
+	else
+	{
+		sa.sin.sin_family = AF_INET;
+		sa.sin.sin_addr.s_addr = entry->addr;
+		salen = sizeof(sa.sin);
+	}
+
+	/**
+	 * Grace au rDNS (reverse DNS), on peut essayer de récupérer le nom
+	 * de l'hôte à partir de son adresse IP.
+	 */
+	if (getnameinfo(&sa.sa, salen, hbuf, sizeof(hbuf), NULL, 0, NI_NAMEREQD) != 0)
+		return (NULL);
+	return (strdup(hbuf));
+}
+
+static void *
+resolver_worker(void *arg)
+{
+	struct tr_resolver *resolver = arg;
+	uint64_t one = 1;
+
+	(void)pthread_mutex_lock(&resolver->lock);
+	for (;;)
+	{
+		while (!resolver->stop && resolver->jobs_head == NULL)
+			(void)pthread_cond_wait(&resolver->cond, &resolver->lock);
+		if (resolver->stop)
+			break;
+
+		struct tr_name *entry = resolver->jobs_head;
+		resolver->jobs_head = entry->next_job;
+		if (resolver->jobs_head == NULL)
+			resolver->jobs_tail = NULL;
+		(void)pthread_mutex_unlock(&resolver->lock);
+
+		char *name = resolve_addr(entry);
+		if (entry->family == AF_INET)
+			tr_namecache_put(&resolver->cache, entry->addr, name);
+
+		(void)pthread_mutex_lock(&resolver->lock);
+		entry->name = name;
+		entry->state = name ? TR_NAME_RESOLVED : TR_NAME_FAILED;
+		(void)!write(resolver->efd, &one, sizeof(one));
+	}
+	(void)pthread_mutex_unlock(&resolver->lock);
+	return (NULL);
+}
+
+int
+tr_resolver_init(struct tr_resolver *resolver, const char *cache_path)
+{
+	memset(resolver, 0, sizeof(*resolver));
+
+	// Sans cache persistant utilisable, les noms sont seulement conservés en mémoire
+	if (cache_path)
+		(void)tr_namecache_open(&resolver->cache, cache_path);
+
+	resolver->size = TR_RESOLVER_MIN_SIZE;
+	resolver->table = calloc(resolver->size, sizeof(struct tr_name *));
+	if (resolver->table == NULL)
+	{
+		tr_perr("calloc");
+		tr_namecache_close(&resolver->cache);
+		return (-1);
+	}
+
+	resolver->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (resolver->efd < 0)
+	{
+		tr_perr("eventfd");
+		tr_namecache_close(&resolver->cache);
+		free(resolver->table);
+		return (-1);
+	}
+
+	(void)pthread_mutex_init(&resolver->lock, NULL);
+	(void)pthread_cond_init(&resolver->cond, NULL);
+
+	for (int i = 0; i < TR_RESOLVER_THREADS; ++i)
+	{
+		if (pthread_create(&resolver->threads[i], NULL, resolver_worker, resolver) != 0)
+			break;
+		resolver->nthreads++;
+	}
+	if (resolver->nthreads == 0)
+	{
+		tr_err("Can't start name resolver");
+		tr_resolver_destroy(resolver);
+		return (-1);
+	}
+	return (0);
+}
+
+void
+tr_resolver_destroy(struct tr_resolver *resolver)
+{
+	(void)pthread_mutex_lock(&resolver->lock);
+	resolver->stop = 1;
+	(void)pthread_cond_broadcast(&resolver->cond);
+	(void)pthread_mutex_unlock(&resolver->lock);
+
+	// Les threads terminent la résolution en cours avant de s'arrêter
+	for (int i = 0; i < resolver->nthreads; ++i)
+		(void)pthread_join(resolver->threads[i], NULL);
+
+	for (uint32_t i = 0; i < resolver->size; ++i)
+	{
+		if (resolver->table[i] == NULL)
+			continue;
+		free(resolver->table[i]->name);
+		free(resolver->table[i]);
+	}
+	free(resolver->table);
+	(void)close(resolver->efd);
+	tr_namecache_close(&resolver->cache);
+	(void)pthread_cond_destroy(&resolver->cond);
+	(void)pthread_mutex_destroy(&resolver->lock);
+}
+
+/**
+ * Double la taille du cache lorsqu'il est rempli à plus de moitié.
+ */
+static int
+resolver_grow(struct tr_resolver *resolver)
+{
+	uint32_t size = resolver->size * 2;
+	struct tr_name **table = calloc(size, sizeof(struct tr_name *));
+	if (table == NULL)
+		return (-1);
+
+	for (uint32_t i = 0; i < resolver->size; ++i)
+	{
+		struct tr_name *entry = resolver->table[i];
+		if (entry == NULL)
+			continue;
+		uint32_t j = name_hash(entry->addr, size - 1);
+		while (table[j])
+			j = (j + 1) & (size - 1);
+		table[j] = entry;
+	}
+	free(resolver->table);
+	resolver->table = table;
+	resolver->size = size;
+	return (0);
+}
+
+/**
+ * Cherche le nom associé à `addr`. Si l'adresse est inconnue, sa résolution est
+ * lancée en arrière-plan et TR_NAME_PENDING est retourné: l'eventfd du résolveur
+ * est signalé dès qu'elle se termine. `name` vaut NULL si l'adresse n'a pas de nom.
+ */
+int
+tr_resolver_lookup(struct tr_resolver *resolver, uint32_t addr, const char **name)
+{
+	uint32_t mask = resolver->size - 1;
+	uint32_t i = name_hash(addr, mask);
+	int state;
+
+	*name = NULL;
+	while (resolver->table[i] && resolver->table[i]->addr != addr)
+		i = (i + 1) & mask;
+
+	struct tr_name *entry = resolver->table[i];
+	if (entry)
+	{
+		(void)pthread_mutex_lock(&resolver->lock);
+		state = entry->state;
+		*name = entry->name;
+		(void)pthread_mutex_unlock(&resolver->lock);
+		return (state);
+	}
+
+	// Une adresse que l'on ne peut pas mettre en cache est affichée sans nom
+	if ((resolver->count + 1) * 2 > resolver->size && resolver_grow(resolver))
+		return (TR_NAME_FAILED);
+	if ((entry = calloc(1, sizeof(struct tr_name))) == NULL)
+		return (TR_NAME_FAILED);
+	entry->addr = addr;
+	entry->state = TR_NAME_PENDING;
+	// Les threads ne consultent pas la table des adresses, qui peut être déplacée
+	entry->family = tr_addr_family();
+	if (entry->family == AF_INET6)
+		entry->addr6 = *tr_addr_get(addr);
+
+	char hbuf[TR_NAMECACHE_NAMELEN];
+	int cached = entry->family == AF_INET ? tr_namecache_get(&resolver->cache, addr, hbuf, sizeof(hbuf)) : -1;
+	if (cached >= 0)
+	{
+		entry->name = cached ? strdup(hbuf) : NULL;
+		entry->state = entry->name ? TR_NAME_RESOLVED : TR_NAME_FAILED;
+	}
+
+	mask = resolver->size - 1;
+	i = name_hash(addr, mask);
+	while (resolver->table[i])
+		i = (i + 1) & mask;
+	resolver->table[i] = entry;
+	resolver->count++;
+
+	if (entry->state != TR_NAME_PENDING)
+	{
+		*name = entry->name;
+		return (entry->state);
+	}
+
+	(void)pthread_mutex_lock(&resolver->lock);
+	if (resolver->jobs_tail)
+		resolver->jobs_tail->next_job = entry;
+	else
+		resolver->jobs_head = entry;
+	resolver->jobs_tail = entry;
+	(void)pthread_cond_signal(&resolver->cond);
+	(void)pthread_mutex_unlock(&resolver->lock);
+	return (TR_NAME_PENDING);
+}
+
+/**
+ * Acquitte les notifications de fin de résolution.
+ */
+void
+tr_resolver_ack(struct tr_resolver *resolver)
+{
+	uint64_t count;
+
+	(void)!read(resolver->efd, &count, sizeof(count));
+}
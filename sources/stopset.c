@@ -0,0 +1,158 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   stopset.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/21 14:05:37 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/21 14:05:37 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "stopset.h"
+
+static inline uint32_t
+stopset_hash(uint64_t key, uint32_t mask)
+{
+	return ((uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask);
+}
+
+int
+tr_stopset_init(struct tr_stopset *set)
+{
+	set->mask = TR_STOPSET_MIN_SIZE - 1;
+	set->count = 0;
+	set->keys = calloc(TR_STOPSET_MIN_SIZE, sizeof(uint64_t));
+	if (set->keys == NULL)
+	{
+		tr_perr("calloc");
+		return (-1);
+	}
+	return (0);
+}
+
+void
+tr_stopset_destroy(struct tr_stopset *set)
+{
+	free(set->keys);
+	set->keys = NULL;
+}
+
+/**
+ * Double la taille de la table lorsqu'elle est remplie à plus de moitié.
+ */
+static int
+stopset_grow(struct tr_stopset *set)
+{
+	uint32_t size = (set->mask + 1) * 2;
+	uint64_t *keys = calloc(size, sizeof(uint64_t));
+	if (keys == NULL)
+		return (-1);
+
+	for (uint32_t i = 0; i <= set->mask; ++i)
+	{
+		if (set->keys[i] == 0)
+			continue;
+		uint32_t j = stopset_hash(set->keys[i], size - 1);
+		while (keys[j])
+			j = (j + 1) & (size - 1);
+		keys[j] = set->keys[i];
+	}
+	free(set->keys);
+	set->keys = keys;
+	set->mask = size - 1;
+	return (0);
+}
+
+int
+tr_stopset_add(struct tr_stopset *set, uint64_t key)
+{
+	if ((set->count + 1) * 2 > set->mask + 1 && stopset_grow(set))
+		return (-1);
+
+	uint32_t i = stopset_hash(key, set->mask);
+	while (set->keys[i] && set->keys[i] != key)
+		i = (i + 1) & set->mask;
+	if (set->keys[i] == 0)
+	{
+		set->keys[i] = key;
+		set->count++;
+	}
+	return (0);
+}
+
+int
+tr_stopset_has(const struct tr_stopset *set, uint64_t key)
+{
+	uint32_t i = stopset_hash(key, set->mask);
+
+	while (set->keys[i])
+	{
+		if (set->keys[i] == key)
+			return (1);
+		i = (i + 1) & set->mask;
+	}
+	return (0);
+}
+
+/**
+ * Charge un ensemble de couples (interface, destination) enregistré par
+ * tr_stopset_save(): une ligne par couple, les deux adresses séparées par
+ * une espace. Un fichier absent correspond à un ensemble vide.
+ */
+int
+tr_stopset_load(struct tr_stopset *set, const char *path)
+{
+	char line[2 * INET_ADDRSTRLEN + 2];
+	char a[INET_ADDRSTRLEN];
+	char b[INET_ADDRSTRLEN];
+	struct in_addr ia, ib;
+
+	FILE *file = tr_user_fopen(path, "r");
+	if (file == NULL)
+	{
+		if (errno == ENOENT)
+			return (0);
+		tr_perr(path);
+		return (-1);
+	}
+
+	while (fgets(line, sizeof(line), file))
+	{
+		if (sscanf(line, "%15s %15s", a, b) != 2 || !inet_aton(a, &ia) || !inet_aton(b, &ib))
+			continue;
+		if (ia.s_addr && tr_stopset_add(set, tr_stopset_key(ia.s_addr, ib.s_addr)))
+			break;
+	}
+	(void)fclose(file);
+	return (0);
+}
+
+int
+tr_stopset_save(const struct tr_stopset *set, const char *path)
+{
+	char a[INET_ADDRSTRLEN];
+	char b[INET_ADDRSTRLEN];
+
+	FILE *file = tr_user_fopen(path, "w");
+	if (file == NULL)
+	{
+		tr_perr(path);
+		return (-1);
+	}
+
+	for (uint32_t i = 0; i <= set->mask; ++i)
+	{
+		uint64_t key = set->keys[i];
+		if (key == 0)
+			continue;
+		uint32_t ia = key >> 32;
+		uint32_t ib = (uint32_t)key;
+		(void)inet_ntop(AF_INET, &ia, a, sizeof(a));
+		(void)inet_ntop(AF_INET, &ib, b, sizeof(b));
+		(void)fprintf(file, "%s %s\n", a, b);
+	}
+	return (fclose(file));
+}
@@ -12,6 +12,8 @@
 
 #include "traceroute.h"
 
+#include <sys/fsuid.h>
+
 void
 check_privileges(void)
 {
@@ -22,6 +24,46 @@ check_privileges(void)
 	}
 }
 
+/**
+ * NOTE:
+ * L'exécutable est setuid root: les fichiers désignés par l'utilisateur
+ * (cibles, ensemble d'arrêt, histogrammes, archive, cache de noms) sont ouverts
+ * avec ses propres droits, l'uid et le gid réels, et non avec ceux de root.
+ * Seuls les droits d'accès aux fichiers changent le temps de l'ouverture
+ * (setfsuid), propres au thread appelant: les sockets RAW restent disponibles
+ * et les autres requêtes du démon ne sont pas affectées.
+ */
+int
+tr_user_open(const char *path, int flags, mode_t mode)
+{
+	(void)setfsgid(getgid());
+	(void)setfsuid(getuid());
+	int fd = open(path, flags | O_CLOEXEC, mode);
+	int err = errno;
+	(void)setfsuid(geteuid());
+	(void)setfsgid(getegid());
+	errno = err;
+	return (fd);
+}
+
+/**
+ * Équivalent de fopen() avec les droits de l'utilisateur, en lecture ("r") ou
+ * en écriture ("w").
+ */
+FILE *
+tr_user_fopen(const char *path, const char *mode)
+{
+	int writing = mode[0] == 'w';
+	int fd = tr_user_open(path, writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (fd < 0)
+		return (NULL);
+
+	FILE *file = fdopen(fd, mode);
+	if (file == NULL)
+		(void)close(fd);
+	return (file);
+}
+
 int
 get_max_ttl(void)
 {
@@ -38,3 +80,46 @@ get_max_ttl(void)
 	return (30);
 #endif /* __APPLE__ */
 }
+
+/**
+ * NOTE:
+ * Contexte de l'exécution en cours. Le démon sert chaque requête dans son propre
+ * thread: la sortie et les erreurs d'une requête sont écrites sur la connexion
+ * du client, et ses probes portent un identifiant distinct de celui des autres
+ * requêtes, là où une exécution en ligne de commande utilise son PID.
+ */
+static __thread FILE	*session_out = NULL;
+static __thread FILE	*session_err = NULL;
+static __thread int		session_ident = -1;
+
+void
+tr_session_set(FILE *out, FILE *err, uint16_t ident)
+{
+	session_out = out;
+	session_err = err;
+	session_ident = ident;
+}
+
+FILE *
+tr_out(void)
+{
+	return (session_out ? session_out : stdout);
+}
+
+FILE *
+tr_errout(void)
+{
+	return (session_err ? session_err : stderr);
+}
+
+/**
+ * Identifiant des probes de l'exécution: identifiant ICMP Echo, 16 bits de poids
+ * fort des numéros de séquence TCP et port source des probes sans état.
+ */
+uint16_t
+tr_ident(void)
+{
+	if (session_ident < 0)
+		return (getpid() & 0xFFFF);
+	return (session_ident);
+}
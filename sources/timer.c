@@ -0,0 +1,242 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   timer.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/16 14:21:09 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/16 14:21:09 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+#include "timer.h"
+
+/**
+ * NOTE:
+ * Chaque timer est rangé dans une liste doublement chaînée correspondant à sa
+ * date d'expiration: le niveau 0 contient les timers expirant dans les 64
+ * prochaines millisecondes (une case par milliseconde), le niveau 1 ceux
+ * expirant dans les 64 * 64 prochaines (une case par tranche de 64 ms), etc.
+ * Lorsque le niveau 0 fait un tour complet, la case suivante du niveau 1 est
+ * redistribuée dans le niveau 0 (cascade), et ainsi de suite.
+ * L'ajout et l'annulation d'un timer se font donc en temps constant, quel que
+ * soit le nombre de timers en attente.
+ */
+
+uint64_t
+tr_now_ms(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static inline void
+list_init(struct tr_timer *head)
+{
+	head->next = head;
+	head->prev = head;
+}
+
+static inline void
+list_append(struct tr_timer *head, struct tr_timer *timer)
+{
+	timer->prev = head->prev;
+	timer->next = head;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+static inline void
+list_unlink(struct tr_timer *timer)
+{
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+void
+tr_timer_wheel_init(struct tr_timer_wheel *wheel, uint64_t now)
+{
+	wheel->now = now;
+	wheel->pending = 0;
+	for (int level = 0; level < TR_TIMER_LEVELS; ++level)
+	{
+		for (int slot = 0; slot < TR_TIMER_SLOTS; ++slot)
+			list_init(&wheel->slots[level][slot]);
+	}
+}
+
+void
+tr_timer_init(struct tr_timer *timer, void (*callback)(struct tr_timer *), void *data)
+{
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->expires = 0;
+	timer->callback = callback;
+	timer->data = data;
+}
+
+int
+tr_timer_pending(struct tr_timer *timer)
+{
+	return (timer->next != NULL);
+}
+
+/**
+ * Range le timer dans la case correspondant à sa date d'expiration. Lors d'une
+ * cascade, un timer expirant au tick courant est rangé dans la case du niveau 0
+ * qui est traitée juste après.
+ */
+static void
+wheel_insert(struct tr_timer_wheel *wheel, struct tr_timer *timer)
+{
+	uint64_t expires = timer->expires;
+	uint64_t delta = expires - wheel->now;
+	if (delta > TR_TIMER_MAX_DELTA)
+		expires = wheel->now + TR_TIMER_MAX_DELTA;
+
+	int level = 0;
+	while (level < TR_TIMER_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TR_TIMER_SLOT_BITS)))
+		level++;
+
+	int slot = (expires >> (level * TR_TIMER_SLOT_BITS)) & TR_TIMER_SLOT_MASK;
+	list_append(&wheel->slots[level][slot], timer);
+}
+
+void
+tr_timer_add(struct tr_timer_wheel *wheel, struct tr_timer *timer, uint64_t expires)
+{
+	if (tr_timer_pending(timer))
+		tr_timer_cancel(wheel, timer);
+
+	// Un timer déjà expiré sera traité au prochain tick
+	if (expires <= wheel->now)
+		expires = wheel->now + 1;
+
+	timer->expires = expires;
+	wheel_insert(wheel, timer);
+	wheel->pending++;
+}
+
+void
+tr_timer_cancel(struct tr_timer_wheel *wheel, struct tr_timer *timer)
+{
+	if (!tr_timer_pending(timer))
+		return;
+	list_unlink(timer);
+	wheel->pending--;
+}
+
+/**
+ * Redistribue les timers d'une case d'un niveau supérieur dans les niveaux inférieurs.
+ */
+static void
+wheel_cascade(struct tr_timer_wheel *wheel, int level, int slot)
+{
+	struct tr_timer list;
+	struct tr_timer *head = &wheel->slots[level][slot];
+
+	if (head->next == head)
+		return;
+
+	// On détache la liste entière avant de la redistribuer
+	list.next = head->next;
+	list.prev = head->prev;
+	list.next->prev = &list;
+	list.prev->next = &list;
+	list_init(head);
+
+	while (list.next != &list)
+	{
+		struct tr_timer *timer = list.next;
+		list_unlink(timer);
+		wheel_insert(wheel, timer);
+	}
+}
+
+/**
+ * Avance la roue jusqu'à `now` en déclenchant tous les timers expirés.
+ */
+void
+tr_timer_advance(struct tr_timer_wheel *wheel, uint64_t now)
+{
+	while (wheel->now < now)
+	{
+		if (wheel->pending == 0)
+		{
+			wheel->now = now;
+			break;
+		}
+
+		uint64_t tick = ++wheel->now;
+
+		/**
+		 * Lorsqu'un niveau fait un tour complet, la case courante du niveau
+		 * supérieur est redistribuée.
+		 */
+		for (int level = 1; level < TR_TIMER_LEVELS; ++level)
+		{
+			if ((tick >> ((level - 1) * TR_TIMER_SLOT_BITS)) & TR_TIMER_SLOT_MASK)
+				break;
+			wheel_cascade(wheel, level, (tick >> (level * TR_TIMER_SLOT_BITS)) & TR_TIMER_SLOT_MASK);
+		}
+
+		struct tr_timer *head = &wheel->slots[0][tick & TR_TIMER_SLOT_MASK];
+		while (head->next != head)
+		{
+			struct tr_timer *timer = head->next;
+			list_unlink(timer);
+			wheel->pending--;
+
+			// Un timer plafonné au niveau maximal n'est pas encore arrivé à échéance
+			if (timer->expires > tick)
+			{
+				wheel_insert(wheel, timer);
+				wheel->pending++;
+				continue;
+			}
+			timer->callback(timer);
+		}
+	}
+}
+
+/**
+ * Retourne le nombre de millisecondes avant la prochaine échéance possible:
+ * expiration d'un timer du niveau 0 ou cascade d'une case non vide d'un niveau
+ * supérieur. Retourne -1 si aucun timer n'est en attente.
+ * Tous les niveaux sont consultés: la première case non vide d'un niveau peut
+ * être à presque un tour complet, alors qu'un niveau supérieur redistribue ses
+ * timers bien avant.
+ */
+int64_t
+tr_timer_next(struct tr_timer_wheel *wheel)
+{
+	if (wheel->pending == 0)
+		return (-1);
+
+	int64_t next = -1;
+
+	for (int level = 0; level < TR_TIMER_LEVELS; ++level)
+	{
+		int shift = level * TR_TIMER_SLOT_BITS;
+		uint64_t base = wheel->now >> shift;
+
+		for (int offset = 1; offset <= TR_TIMER_SLOTS; ++offset)
+		{
+			int slot = (base + offset) & TR_TIMER_SLOT_MASK;
+			if (wheel->slots[level][slot].next == &wheel->slots[level][slot])
+				continue;
+
+			int64_t delta = (int64_t)(((base + offset) << shift) - wheel->now);
+			if (next < 0 || delta < next)
+				next = delta;
+			break;
+		}
+	}
+	return (next);
+}
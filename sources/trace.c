@@ -0,0 +1,2042 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   trace.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/16 10:12:04 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/16 10:12:04 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "traceroute.h"
+
+/**
+ * NOTE:
+ * Les probes ne sont plus envoyées une par une: jusqu'à `squeries` probes
+ * peuvent être en vol simultanément, tous TTL confondus. Chaque réponse est
+ * rattachée à sa probe grâce au port (ou numéro de séquence) qui encode le
+ * couple (ttl, probe), et l'affichage est fait dans l'ordre des sauts dès que
+ * les probes précédentes sont résolues.
+ * Avec `squeries` à 1 (par défaut) le comportement est celui du traceroute
+ * classique, une probe après l'autre.
+ * Les réponses sont attendues via une boucle epoll et chaque probe en vol arme
+ * un timer dans la roue du moteur: les expirations sont traitées par lots à
+ * chaque réveil, sans appel système propre à chaque probe.
+ */
+
+static int
+get_probe_port(uint32_t ttl, uint32_t probe, struct tr_params *params)
+{
+	if (params->flags & TR_FLAG_FIXED_PORT)
+	{
+		return (params->port);
+	}
+	// Avec --mda le port identifie le flux, le même à tous les TTL
+	if (params->flags & TR_FLAG_MDA)
+		return (params->port + probe);
+	return (tr_probe_base(params) + ttl * params->nprobes + probe);
+}
+
+static inline uint32_t
+slot_ttl(struct tr_trace *trace, uint32_t slot)
+{
+	return (trace->params->first_ttl + slot / trace->params->nprobes);
+}
+
+static inline uint32_t
+slot_probe(struct tr_trace *trace, uint32_t slot)
+{
+	return (slot % trace->params->nprobes);
+}
+
+static void trace_expire(struct tr_timer *timer);
+static void trace_next_cycle(struct tr_timer *timer);
+
+/**
+ * Met la trace en attente d'un jeton du limiteur de débit: elle sera traitée
+ * à nouveau au réveil du limiteur (voir engine_on_pacer).
+ */
+static void
+trace_pace(struct tr_trace *trace)
+{
+	struct tr_engine *engine = trace->engine;
+
+	if (trace->paced)
+		return;
+	trace->paced = 1;
+	trace->next_paced = NULL;
+	if (engine->paced_tail)
+		engine->paced_tail->next_paced = trace;
+	else
+		engine->paced_head = trace;
+	engine->paced_tail = trace;
+}
+
+static void
+trace_unpace(struct tr_trace *trace)
+{
+	struct tr_engine *engine = trace->engine;
+	struct tr_trace **link = &engine->paced_head;
+	struct tr_trace *prev = NULL;
+
+	if (!trace->paced)
+		return;
+	while (*link != trace)
+	{
+		prev = *link;
+		link = &(*link)->next_paced;
+	}
+	*link = trace->next_paced;
+	if (engine->paced_tail == trace)
+		engine->paced_tail = prev;
+	trace->paced = 0;
+}
+
+/**
+ * Ajoute la trace à la liste des traces à traiter au prochain tour de boucle.
+ */
+static void
+trace_touch(struct tr_trace *trace)
+{
+	if (trace->dirty)
+		return;
+	trace->dirty = 1;
+	trace->next_dirty = trace->engine->dirty;
+	trace->engine->dirty = trace;
+}
+
+/**
+ * Retire la trace de la liste des traces à traiter, avant sa destruction.
+ */
+static void
+trace_untouch(struct tr_trace *trace)
+{
+	struct tr_trace **link = &trace->engine->dirty;
+
+	if (!trace->dirty)
+		return;
+	while (*link != trace)
+		link = &(*link)->next_dirty;
+	*link = trace->next_dirty;
+	trace->dirty = 0;
+}
+
+static int
+trace_init(struct tr_trace *trace, struct tr_engine *engine, uint32_t dst_addr, struct tr_params *params)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->engine = engine;
+	trace->params = params;
+	trace->dst_addr = dst_addr;
+	trace->out = engine->out;
+	tr_timer_init(&trace->cycle_timer, trace_next_cycle, trace);
+
+	if (params->first_ttl > params->max_ttl)
+		return (0);
+
+	// Les statistiques de chaque saut couvrent toute la surveillance, en mémoire bornée
+	uint32_t nhops = params->max_ttl - params->first_ttl + 1;
+	if (params->monitor && (trace->hops = calloc(nhops, sizeof(struct tr_hopstats))) == NULL)
+		goto err;
+	if ((summary(params->flags) || params->monitor) && (trace->hists = calloc(nhops, sizeof(struct tr_histogram))) == NULL)
+		goto err;
+	trace->cycle_start = tr_now_ms();
+
+	trace->nslots = nhops * params->nprobes;
+	trace->end = trace->nslots;
+	trace->probes = calloc(trace->nslots, sizeof(struct tr_probe));
+	if (trace->probes == NULL)
+		goto err;
+	for (uint32_t i = 0; i < trace->nslots; ++i)
+		tr_timer_init(&trace->probes[i].timer, trace_expire, trace);
+
+	/**
+	 * Avec un port fixe, les réponses ne permettent pas de distinguer les probes
+	 * entre elles, on ne peut donc en avoir qu'une seule en vol.
+	 */
+	trace->window = params->squeries;
+	if (params->flags & TR_FLAG_FIXED_PORT)
+		trace->window = 1;
+
+	/**
+	 * Avec Doubletree, la trace commence au TTL demandé: les sauts suivants
+	 * sont sondés en avant, puis les sauts précédents en arrière.
+	 */
+	if (params->doubletree)
+	{
+		trace->back_hops = params->doubletree - params->first_ttl;
+		trace->next_send = trace->back_hops * params->nprobes;
+	}
+	return (0);
+
+err:
+	tr_perr("calloc");
+	free(trace->hops);
+	free(trace->hists);
+	trace->hops = NULL;
+	trace->hists = NULL;
+	return (-1);
+}
+
+static void
+trace_destroy(struct tr_trace *trace)
+{
+	struct tr_engine *engine = trace->engine;
+
+	// Les horodatages encore attendus ne doivent plus référencer les probes libérées
+	for (int i = 0; i < TR_TXMAP_SIZE; ++i)
+	{
+		if (engine->txmap[i] >= trace->probes && engine->txmap[i] < trace->probes + trace->nslots)
+			engine->txmap[i] = NULL;
+	}
+	tr_timer_cancel(&engine->wheel, &trace->cycle_timer);
+	free(trace->probes);
+	trace->probes = NULL;
+	free(trace->hops);
+	free(trace->hists);
+	trace->hops = NULL;
+	trace->hists = NULL;
+	if (trace->out != engine->out)
+	{
+		(void)fclose(trace->out);
+		free(trace->outbuf);
+	}
+	free(trace->host);
+}
+
+/**
+ * Retrouve la probe en vol correspondant au port extrait d'une réponse.
+ */
+static struct tr_probe *
+trace_lookup(struct tr_trace *trace, uint16_t port)
+{
+	struct tr_params *params = trace->params;
+
+	if (params->flags & TR_FLAG_FIXED_PORT)
+	{
+		if (port != params->port)
+			return (NULL);
+		for (uint32_t i = trace->next_print; i < trace->next_send; ++i)
+		{
+			if (trace->probes[i].state == TR_PROBE_SENT)
+				return (&trace->probes[i]);
+		}
+		return (NULL);
+	}
+
+	// Le calcul est fait modulo 2^16 afin de suivre le débordement éventuel des ports
+	uint16_t slot = port - (uint16_t)(tr_probe_base(params) + params->first_ttl * params->nprobes);
+	if (slot >= trace->end || trace->probes[slot].state != TR_PROBE_SENT)
+		return (NULL);
+	return (&trace->probes[slot]);
+}
+
+/**
+ * Lorsque la destination répond pour un saut, les sauts suivants sont inutiles:
+ * les probes correspondantes sont abandonnées.
+ */
+static void
+trace_truncate(struct tr_trace *trace, uint32_t ttl)
+{
+	uint32_t end = (ttl - trace->params->first_ttl + 1) * trace->params->nprobes;
+
+	if (end >= trace->end)
+		return;
+
+	for (uint32_t i = end; i < trace->next_send; ++i)
+	{
+		if (trace->probes[i].state == TR_PROBE_SENT)
+		{
+			tr_timer_cancel(&trace->engine->wheel, &trace->probes[i].timer);
+			trace->inflight--;
+		}
+		trace->probes[i].state = TR_PROBE_CANCELLED;
+	}
+	trace->end = end;
+	if (trace->next_send > end)
+		trace->next_send = end;
+}
+
+/**
+ * NOTE:
+ * En mode adaptatif (--adaptive), le délai d'attente des probes est déduit des
+ * RTT déjà mesurés sur le chemin, comme le délai de retransmission de TCP
+ * (RFC 6298): RTT lissé plus quatre fois sa variation, borné par --min-wait
+ * et -w. Tant qu'aucune réponse n'a été reçue, le délai est celui de -w.
+ */
+
+static uint32_t
+trace_timeout(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+
+	if (!(params->flags & TR_FLAG_ADAPTIVE) || trace->srtt == 0)
+		return (params->waittime);
+
+	// La variation est au moins d'une milliseconde, la résolution de la roue de timers
+	uint32_t var = trace->rttvar * 4 > 1000 ? trace->rttvar * 4 : 1000;
+	uint32_t timeout = (trace->srtt + var + 999) / 1000;
+	if (timeout < params->min_wait)
+		timeout = params->min_wait;
+	if (timeout > params->waittime)
+		timeout = params->waittime;
+	return (timeout);
+}
+
+static void
+trace_sample_rtt(struct tr_trace *trace, struct tr_probe *probe)
+{
+	struct timespec start = probe->start;
+	struct timespec end = probe->end;
+
+	// Même source que l'affichage: les horodatages noyau lorsqu'ils sont disponibles
+	if ((probe->tx_ts.tv_sec || probe->tx_ts.tv_nsec) && (probe->rx_ts.tv_sec || probe->rx_ts.tv_nsec))
+	{
+		start = probe->tx_ts;
+		end = probe->rx_ts;
+	}
+
+	int64_t rtt = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+	if (rtt <= 0)
+		rtt = 1;
+	if (rtt > UINT32_MAX / 8)
+		rtt = UINT32_MAX / 8;
+
+	if (trace->srtt == 0)
+	{
+		trace->srtt = rtt;
+		trace->rttvar = rtt / 2;
+		return;
+	}
+	uint32_t delta = trace->srtt > rtt ? trace->srtt - rtt : rtt - trace->srtt;
+	trace->rttvar = (3 * trace->rttvar + delta) / 4;
+	trace->srtt = (7 * trace->srtt + rtt) / 8;
+}
+
+static void
+trace_arm(struct tr_trace *trace, struct tr_probe *probe)
+{
+	struct tr_engine *engine = trace->engine;
+	uint64_t start_ms = (uint64_t)probe->start.tv_sec * 1000 + probe->start.tv_nsec / 1000000;
+
+	/**
+	 * Le noyau numérote les horodatages d'émission dans l'ordre des envois réussis,
+	 * on retient le numéro attribué à la probe pour l'y associer à la réception.
+	 */
+	if (engine->tx_stamping)
+	{
+		probe->tx_key = engine->tx_key++;
+		engine->txmap[probe->tx_key & TR_TXMAP_MASK] = probe;
+	}
+
+	probe->state = TR_PROBE_SENT;
+	trace->inflight++;
+	engine->probes_sent++;
+	tr_timer_add(&trace->engine->wheel, &probe->timer, start_ms + trace_timeout(trace));
+}
+
+/**
+ * Envoie le lot de probes en attente et arme le timer de chacune d'elles.
+ */
+static void
+trace_flush(struct tr_trace *trace)
+{
+	struct tr_sendbatch *batch = &trace->engine->batch;
+	struct timespec start;
+
+	if (batch->count == 0)
+		return;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	tr_batch_flush(batch, trace->engine->send_sock);
+	trace_touch(trace);
+
+	for (size_t i = 0; i < batch->count; ++i)
+	{
+		struct tr_probe *probe = &trace->probes[batch->tag[i]];
+
+		probe->start = start;
+		if ((probe->ret = batch->ret[i]) <= 0)
+		{
+			probe->state = TR_PROBE_FAILED;
+			continue;
+		}
+		trace_arm(trace, probe);
+	}
+	batch->count = 0;
+}
+
+/**
+ * Nombre d'interfaces distinctes ayant répondu au saut commençant à `hop`.
+ */
+static uint32_t
+hop_interfaces(struct tr_trace *trace, uint32_t hop)
+{
+	uint32_t count = 0;
+
+	for (uint32_t i = hop; i < hop + trace->params->nprobes; ++i)
+	{
+		struct tr_probe *probe = &trace->probes[i];
+		if (probe->state != TR_PROBE_REPLIED)
+			continue;
+
+		uint32_t j = hop;
+		while (j < i && !(trace->probes[j].state == TR_PROBE_REPLIED && trace->probes[j].from == probe->from))
+			j++;
+		count += j == i;
+	}
+	return (count);
+}
+
+static int
+hop_busy(struct tr_trace *trace, uint32_t hop)
+{
+	for (uint32_t i = hop; i < hop + trace->params->nprobes; ++i)
+	{
+		if (trace->probes[i].state == TR_PROBE_SENT)
+			return (1);
+	}
+	return (0);
+}
+
+/**
+ * Indique si la règle d'arrêt du MDA exige encore la probe `slot`, compte tenu
+ * des interfaces déjà vues à son saut.
+ */
+static int
+mda_wants(struct tr_trace *trace, uint32_t slot)
+{
+	uint32_t k = hop_interfaces(trace, slot - slot_probe(trace, slot));
+
+	if (k == 0)
+		k = 1;
+	if (k > TR_MDA_MAX_NEXTHOPS)
+		k = TR_MDA_MAX_NEXTHOPS;
+	return (slot_probe(trace, slot) < trace->engine->mda_stop[k]);
+}
+
+/**
+ * Passe à la probe suivante du sondage en arrière.
+ */
+static void
+trace_back_next(struct tr_trace *trace)
+{
+	if (++trace->back_probe < trace->params->nprobes)
+		return;
+	trace->back_probe = 0;
+	trace->back_hops--;
+	// Les sauts suivants ont été abandonnés (voir trace_stop_backward)
+	if (trace->back_hops && trace->probes[(trace->back_hops - 1) * trace->params->nprobes].state == TR_PROBE_CANCELLED)
+		trace->back_hops = 0;
+}
+
+static void
+trace_send(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+	struct tr_engine *engine = trace->engine;
+
+	// Surveillance continue: rien n'est envoyé avant le début du cycle suivant
+	if (tr_timer_pending(&trace->cycle_timer))
+		return;
+
+	while (trace->inflight + engine->batch.count < trace->window)
+	{
+		uint32_t slot;
+
+		if (trace->next_send < trace->end)
+		{
+			if ((params->flags & TR_FLAG_MDA) && !mda_wants(trace, trace->next_send))
+			{
+				/**
+				 * Toutes les probes exigées par la règle d'arrêt ont été envoyées:
+				 * on attend leurs réponses, une nouvelle interface pouvant en exiger
+				 * d'autres, puis on passe au saut suivant.
+				 */
+				uint32_t hop = trace->next_send - slot_probe(trace, trace->next_send);
+				trace_flush(trace);
+				if (hop_busy(trace, hop))
+					break;
+				while (trace->next_send < hop + params->nprobes && trace->next_send < trace->end)
+					trace->probes[trace->next_send++].state = TR_PROBE_CANCELLED;
+				continue;
+			}
+			slot = trace->next_send;
+		}
+		else if (trace->back_hops)
+		{
+			// Sondage en arrière (Doubletree), du TTL de départ vers le premier saut
+			slot = (trace->back_hops - 1) * params->nprobes + trace->back_probe;
+			// La destination a pu être atteinte avant le TTL de départ
+			if (slot >= trace->end)
+			{
+				trace_back_next(trace);
+				continue;
+			}
+		}
+		else
+			break;
+
+		if (!tr_pacer_take(&engine->pacer))
+		{
+			trace_pace(trace);
+			break;
+		}
+
+		if (trace->next_send < trace->end)
+			trace->next_send++;
+		else
+			trace_back_next(trace);
+
+		uint32_t ttl = slot_ttl(trace, slot);
+		struct tr_probe *probe = &trace->probes[slot];
+
+		// Le port est calculé en fonction du TTL et du numéro de probe afin d'être unique
+		probe->port = get_probe_port(ttl, slot_probe(trace, slot), params);
+
+		if (engine->batching)
+		{
+			tr_batch_add(&engine->batch, trace->src_addr, trace->dst_addr, ttl, probe->port, slot, params);
+			if (engine->batch.count == TR_SEND_BATCH)
+				trace_flush(trace);
+			continue;
+		}
+
+		/**
+		 * Sans envoi groupé, le TTL est défini sur le socket d'envoi, les probes
+		 * étant envoyées dans l'ordre il n'est modifié qu'une fois par saut.
+		 */
+		if (ttl != trace->current_ttl)
+		{
+			tr_set_ttl(engine->send_sock, params->family, ttl);
+			trace->current_ttl = ttl;
+		}
+
+		(void)clock_gettime(CLOCK_MONOTONIC, &probe->start);
+
+		if ((probe->ret = send_probe(engine->send_sock, trace->src_addr, trace->dst_addr, probe->port, &engine->tmpl, params)) <= 0)
+		{
+			probe->state = TR_PROBE_FAILED;
+			continue;
+		}
+		trace_arm(trace, probe);
+	}
+	trace_flush(trace);
+}
+
+/**
+ * Cherche un routeur du saut `ttl` ayant déjà répondu à un saut antérieur,
+ * hors saut précédent: certains routeurs répondent sur deux sauts consécutifs
+ * sans qu'il s'agisse d'une boucle. Retourne l'index de la probe, ou -1.
+ */
+static int
+trace_find_loop(struct tr_trace *trace, uint32_t ttl, uint32_t *seen_ttl)
+{
+	struct tr_params *params = trace->params;
+	uint32_t hop = (ttl - params->first_ttl) * params->nprobes;
+
+	for (uint32_t i = hop; i < hop + params->nprobes; ++i)
+	{
+		struct tr_probe *probe = &trace->probes[i];
+		if (probe->state != TR_PROBE_REPLIED || probe->reached || probe->from == 0)
+			continue;
+		for (uint32_t j = 0; j + params->nprobes < hop; ++j)
+		{
+			if (trace->probes[j].state == TR_PROBE_REPLIED && trace->probes[j].from == probe->from)
+			{
+				*seen_ttl = slot_ttl(trace, j);
+				return (i);
+			}
+		}
+	}
+	return (-1);
+}
+
+/**
+ * Appelée à la fin de l'affichage de chaque saut: arrête la trace après
+ * `gap_limit` sauts muets consécutifs, ou lorsque `loop_limit` sauts ont
+ * répondu depuis un routeur déjà rencontré plus tôt sur le chemin.
+ */
+static void
+trace_check_stop(struct tr_trace *trace, uint32_t ttl, int silent)
+{
+	struct tr_params *params = trace->params;
+	uint32_t seen_ttl;
+	int looping;
+
+	trace->gap = silent ? trace->gap + 1 : 0;
+	if (params->gap_limit && trace->gap >= params->gap_limit)
+	{
+		if (!json_output(params->flags))
+			(void)fprintf(trace->out, "stopped: %u consecutive silent hops\n", trace->gap);
+		trace->stop = TR_STOP_GAP;
+		trace_truncate(trace, ttl);
+		return;
+	}
+
+	if (params->loop_limit == 0 || (looping = trace_find_loop(trace, ttl, &seen_ttl)) < 0)
+		return;
+	if (++trace->loops < params->loop_limit)
+		return;
+	char addr[TR_ADDRSTRLEN];
+	if (!json_output(params->flags))
+		(void)fprintf(trace->out, "stopped: routing loop, %s already seen at hop %u\n",
+			tr_addr_ntop(trace->probes[looping].from, addr, sizeof(addr)), seen_ttl);
+	trace->stop = TR_STOP_LOOP;
+	trace->stop_addr = trace->probes[looping].from;
+	trace_truncate(trace, ttl);
+}
+
+static int
+probe_answered(struct tr_probe *probe)
+{
+	return (probe->state == TR_PROBE_REPLIED && (probe->icmp_type == ICMP_TIMXCEED || probe->reached));
+}
+
+/**
+ * Nom de l'émetteur d'une réponse, NULL s'il n'en a pas ou n'est pas encore connu.
+ */
+static const char *
+probe_name(struct tr_trace *trace, struct tr_probe *probe)
+{
+	const char *name = NULL;
+
+	if (probe->state == TR_PROBE_REPLIED && probe->from)
+		(void)tr_resolver_lookup(&trace->engine->resolver, probe->from, &name);
+	return (name);
+}
+
+/**
+ * RTT d'une probe arrondi à la microseconde, plafonné à celui des statistiques.
+ */
+static uint32_t
+probe_rtt_us(struct tr_probe *probe)
+{
+	double rtt_us = tr_probe_rtt(probe) * 1000.0;
+
+	if (rtt_us <= 0.0)
+		return (0);
+	if (rtt_us >= TR_HIST_MAX)
+		return (TR_HIST_MAX);
+	return ((uint32_t)(rtt_us + 0.5));
+}
+
+/**
+ * Ajoute le RTT d'une probe ayant reçu une réponse à l'histogramme de son saut
+ * (-S, --monitor) et à celui du routeur qui a répondu (--histograms). Chaque
+ * probe est comptée une fois, lorsqu'elle est affichée.
+ */
+static void
+trace_record(struct tr_trace *trace, struct tr_probe *probe)
+{
+	struct tr_histogram *hist;
+
+	if (probe->state != TR_PROBE_REPLIED)
+		return;
+	if (trace->hists)
+		tr_histogram_record(&trace->hists[(probe - trace->probes) / trace->params->nprobes], probe_rtt_us(probe));
+	if (trace->engine->histtab.addrs && probe->from && (hist = tr_histtab_get(&trace->engine->histtab, probe->from)))
+		tr_histogram_record(hist, probe_rtt_us(probe));
+}
+
+/**
+ * Enregistrements --json d'un saut du mode --mda: une probe par flux, puis le
+ * bilan du saut.
+ */
+static void
+trace_json_mda_hop(struct tr_trace *trace, uint32_t hop, uint32_t sent, uint32_t replied)
+{
+	struct tr_params *params = trace->params;
+
+	for (uint32_t i = hop; i < hop + params->nprobes; ++i)
+	{
+		struct tr_probe *probe = &trace->probes[i];
+		if (probe->state != TR_PROBE_CANCELLED)
+			tr_json_probe(trace, slot_ttl(trace, hop), i - hop, probe, probe_name(trace, probe));
+	}
+	tr_json_hop(trace, slot_ttl(trace, hop), sent, sent - replied);
+}
+
+/**
+ * NOTE:
+ * Les champs d'une ligne sont assemblés dans le tampon de la sortie (stdout, ou
+ * la connexion d'un client du démon), qui n'est vidé qu'ici et à la fin de
+ * chaque trace. Vers un terminal, il est vidé après chaque passe d'affichage,
+ * afin que les RTT apparaissent dès leur réception. Vers un tube ou un fichier
+ * (tamponné par blocs, voir main), il ne l'est qu'à la fin de chaque saut: un
+ * saut coûte un appel à write() au lieu d'un par champ. Les traces du mode
+ * multi-cibles écrivent dans leur propre tampon, recopié d'un bloc à leur fin.
+ */
+static void
+trace_flush_output(struct tr_trace *trace, int hop_done)
+{
+	if (trace->out != trace->engine->out)
+		return;
+	if (hop_done || trace->engine->tty)
+		(void)fflush(trace->out);
+}
+
+/**
+ * Affichage d'un saut en mode --mda, une fois toutes ses probes terminées:
+ * chaque interface est affichée une seule fois, suivie des RTT des flux
+ * qui l'ont traversée.
+ */
+static void
+trace_render_mda(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+
+	while (trace->next_print < trace->end)
+	{
+		uint32_t hop = trace->next_print;
+		uint32_t last = hop + params->nprobes;
+		uint32_t sent = 0;
+		uint32_t replied = 0;
+		const char *name;
+
+		for (uint32_t i = hop; i < last; ++i)
+		{
+			struct tr_probe *probe = &trace->probes[i];
+			if (probe->state == TR_PROBE_IDLE || probe->state == TR_PROBE_SENT)
+				return;
+			sent += probe->state != TR_PROBE_CANCELLED;
+			if (!probe_answered(probe))
+				continue;
+			replied++;
+			if (tr_resolver_lookup(&trace->engine->resolver, probe->from, &name) == TR_NAME_PENDING)
+			{
+				trace->resolving = 1;
+				return;
+			}
+		}
+
+		for (uint32_t i = hop; i < last; ++i)
+			trace_record(trace, &trace->probes[i]);
+
+		if (json_output(params->flags))
+		{
+			trace_json_mda_hop(trace, hop, sent, replied);
+			trace_flush_output(trace, 1);
+			trace->next_print = last;
+			trace_check_stop(trace, slot_ttl(trace, hop), replied == 0);
+			continue;
+		}
+
+		(void)fprintf(trace->out, "%2d  ", slot_ttl(trace, hop));
+		for (uint32_t i = 0; replied == 0 && i < sent; ++i)
+			(void)fprintf(trace->out, "* ");
+
+		int first = 1;
+		for (uint32_t i = hop; i < last; ++i)
+		{
+			struct tr_probe *probe = &trace->probes[i];
+			if (!probe_answered(probe))
+				continue;
+
+			uint32_t j = hop;
+			while (j < i && !(probe_answered(&trace->probes[j]) && trace->probes[j].from == probe->from))
+				j++;
+			if (j < i)
+				continue;
+
+			if (!first)
+				(void)fprintf(trace->out, "%s%s", "\n", "    ");
+			(void)tr_resolver_lookup(&trace->engine->resolver, probe->from, &name);
+			print_router_name(trace->out, probe->from, name);
+			for (j = i; j < last; ++j)
+			{
+				if (probe_answered(&trace->probes[j]) && trace->probes[j].from == probe->from)
+					print_probe_rtt(trace->out, &trace->probes[j]);
+			}
+			first = 0;
+		}
+
+		if (summary(params->flags))
+		{
+			double loss_percent = ((double)(sent - replied) / (double)sent) * 100.0;
+			(void)fprintf(trace->out, "(%.0f%% loss)", loss_percent);
+			print_rtt_summary(trace->out, &trace->hists[hop / params->nprobes]);
+		}
+		(void)fprintf(trace->out, "\n");
+		trace_flush_output(trace, 1);
+		trace->next_print = last;
+		trace_check_stop(trace, slot_ttl(trace, hop), replied == 0);
+	}
+}
+
+/**
+ * NOTE:
+ * Surveillance continue (--monitor): le premier cycle découvre le chemin, qui
+ * s'arrête à la destination ou aux limites --gap-limit et --loop-limit. Les
+ * cycles suivants sondent à nouveau ces seuls sauts, toutes les probes d'un
+ * cycle étant envoyées ensemble, et reprennent un intervalle après le début du
+ * cycle précédent (aussitôt s'il a duré plus longtemps). Les probes d'un cycle
+ * alimentent les statistiques glissantes de leur saut (voir monitor.c), et un
+ * rapport est affiché à la fin de chaque cycle.
+ */
+
+/**
+ * Les probes terminées du cycle alimentent les statistiques de leur saut,
+ * dans l'ordre des sauts.
+ */
+static void
+trace_render_monitor(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+
+	while (trace->next_print < trace->end)
+	{
+		uint32_t slot = trace->next_print;
+		struct tr_probe *probe = &trace->probes[slot];
+		struct tr_hopstats *stats = &trace->hops[slot / params->nprobes];
+
+		if (probe->state == TR_PROBE_IDLE || probe->state == TR_PROBE_SENT)
+			break;
+
+		if (slot_probe(trace, slot) == 0)
+			trace->losses = 0;
+		if (probe->state == TR_PROBE_REPLIED)
+		{
+			stats->addr = probe->from;
+			stats->sent++;
+			tr_hopstats_push(stats, probe_rtt_us(probe));
+			trace_record(trace, probe);
+		}
+		else if (probe->state != TR_PROBE_CANCELLED)
+		{
+			stats->sent++;
+			tr_hopstats_push(stats, TR_MONITOR_LOST);
+			trace->losses++;
+		}
+		trace->next_print++;
+
+		if (trace->cycle == 0 && slot_probe(trace, slot) == params->nprobes - 1)
+			trace_check_stop(trace, slot_ttl(trace, slot), trace->losses == params->nprobes);
+	}
+}
+
+static void
+print_monitor_rtt(FILE *out, uint32_t rtt_us)
+{
+	if (rtt_us == TR_MONITOR_LOST)
+		(void)fprintf(out, " %8s", "*");
+	else
+		(void)fprintf(out, " %8.3f", rtt_us / 1000.0);
+}
+
+/**
+ * Rapport de la surveillance, affiché à la fin de chaque cycle: en place sur
+ * un terminal, à la suite du précédent sinon. La perte et les RTT portent sur
+ * les TR_MONITOR_HISTORY dernières probes de chaque saut, Snt sur toute la
+ * surveillance, ainsi que les percentiles et la gigue ajoutés par -S.
+ */
+static void
+trace_report(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+	FILE *out = trace->out;
+	char ip_str[TR_ADDRSTRLEN];
+	char router[NI_MAXHOST + TR_ADDRSTRLEN + 4];
+
+	if (trace->engine->tty)
+		(void)fprintf(out, "\033[H\033[2J");
+	else if (trace->cycle > 1)
+		(void)fprintf(out, "\n");
+	(void)fprintf(out, TR_PREFIX" to %s (%s), cycle %u, every %u ms\n", trace->host,
+		tr_addr_ntop(trace->dst_addr, ip_str, sizeof(ip_str)), trace->cycle, params->monitor);
+	(void)fprintf(out, "%-44s %6s %5s %8s %8s %8s %8s %8s", "", "Loss%", "Snt", "Last", "Avg", "Best", "Wrst", "StDev");
+	if (summary(params->flags))
+		(void)fprintf(out, " %8s %8s %8s %8s", "P50", "P90", "P99", "Jttr");
+	(void)fprintf(out, "\n");
+
+	for (uint32_t hop = 0; hop * params->nprobes < trace->end; ++hop)
+	{
+		struct tr_hopstats *stats = &trace->hops[hop];
+		const char *name = NULL;
+
+		if (stats->addr == 0)
+			(void)snprintf(router, sizeof(router), "*");
+		else
+		{
+			// Le rapport n'attend pas le résolveur: le nom apparaîtra au cycle suivant
+			(void)tr_resolver_lookup(&trace->engine->resolver, stats->addr, &name);
+			(void)tr_addr_ntop(stats->addr, ip_str, sizeof(ip_str));
+			(void)snprintf(router, sizeof(router), "%s (%s)", name ? name : ip_str, ip_str);
+		}
+		(void)fprintf(out, "%2u  %-40s %5.1f%% %5llu", params->first_ttl + hop, router,
+			tr_hopstats_loss(stats), (unsigned long long)stats->sent);
+		print_monitor_rtt(out, tr_hopstats_last(stats));
+		print_monitor_rtt(out, tr_hopstats_avg(stats));
+		print_monitor_rtt(out, tr_hopstats_best(stats));
+		print_monitor_rtt(out, tr_hopstats_worst(stats));
+		print_monitor_rtt(out, tr_hopstats_stddev(stats));
+		if (summary(params->flags))
+		{
+			const struct tr_histogram *hist = &trace->hists[hop];
+			print_monitor_rtt(out, hist->count ? tr_histogram_percentile(hist, 50) : TR_MONITOR_LOST);
+			print_monitor_rtt(out, hist->count ? tr_histogram_percentile(hist, 90) : TR_MONITOR_LOST);
+			print_monitor_rtt(out, hist->count ? tr_histogram_percentile(hist, 99) : TR_MONITOR_LOST);
+			print_monitor_rtt(out, hist->count ? tr_histogram_jitter(hist) : TR_MONITOR_LOST);
+		}
+		(void)fprintf(out, "\n");
+	}
+}
+
+/**
+ * Fin d'un cycle: le rapport est affiché et le cycle suivant programmé.
+ * Retourne 0 lorsque la trace est terminée: sans surveillance, après le dernier
+ * cycle (--cycles), ou lorsque la sortie a été fermée (client du démon parti).
+ */
+static int
+trace_cycle(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+
+	if (!params->monitor)
+		return (0);
+
+	trace->cycle++;
+	trace_report(trace);
+	trace_flush_output(trace, 1);
+	if ((params->cycles && trace->cycle >= params->cycles) || ferror(trace->out))
+		return (0);
+
+	// Les probes au-delà du chemin découvert restent abandonnées
+	for (uint32_t i = 0; i < trace->end; ++i)
+	{
+		memset(&trace->probes[i], 0, sizeof(struct tr_probe));
+		tr_timer_init(&trace->probes[i].timer, trace_expire, trace);
+	}
+	trace->next_send = 0;
+	trace->next_print = 0;
+
+	uint64_t now = tr_now_ms();
+	trace->cycle_start += params->monitor;
+	if (trace->cycle_start < now)
+		trace->cycle_start = now;
+	tr_timer_add(&trace->engine->wheel, &trace->cycle_timer, trace->cycle_start);
+	return (1);
+}
+
+/**
+ * Affiche les probes résolues dans l'ordre des sauts, en s'arrêtant à la première
+ * probe encore en attente d'une réponse.
+ */
+static void
+trace_render(struct tr_trace *trace)
+{
+	struct tr_params *params = trace->params;
+
+	if (params->flags & TR_FLAG_MDA)
+	{
+		trace_render_mda(trace);
+		trace_flush_output(trace, 0);
+		return;
+	}
+	if (params->monitor)
+	{
+		trace_render_monitor(trace);
+		return;
+	}
+
+	while (trace->next_print < trace->end)
+	{
+		uint32_t slot = trace->next_print;
+		struct tr_probe *probe = &trace->probes[slot];
+
+		if (probe->state == TR_PROBE_IDLE)
+			break;
+
+		// Sauts abandonnés par le sondage en arrière (Doubletree)
+		if (!trace->hop_open && probe->state == TR_PROBE_CANCELLED)
+		{
+			char addr[TR_ADDRSTRLEN];
+			if (json_output(params->flags))
+			{
+				if (slot_ttl(trace, slot) == trace->back_skip_ttl)
+					tr_json_skip(trace);
+			}
+			else if (slot_ttl(trace, slot) == trace->back_skip_ttl && trace->back_skip_ttl + 1 == trace->back_stop_ttl)
+				(void)fprintf(trace->out, "skipped: hop %u, %s already seen at hop %u\n", trace->back_skip_ttl,
+					tr_addr_ntop(trace->back_stop_addr, addr, sizeof(addr)), trace->back_stop_ttl);
+			else if (slot_ttl(trace, slot) == trace->back_skip_ttl)
+				(void)fprintf(trace->out, "skipped: hops %u to %u, %s already seen at hop %u\n",
+					trace->back_skip_ttl, trace->back_stop_ttl - 1,
+					tr_addr_ntop(trace->back_stop_addr, addr, sizeof(addr)), trace->back_stop_ttl);
+			trace->next_print += params->nprobes;
+			continue;
+		}
+
+		if (!trace->hop_open)
+		{
+			if (!json_output(params->flags))
+				(void)fprintf(trace->out, "%2d  ", slot_ttl(trace, slot));
+			trace->hop_open = 1;
+			trace->last_addr_reached = 0;
+			trace->losses = 0;
+		}
+
+		if (probe->state == TR_PROBE_SENT)
+			break;
+
+		if (json_output(params->flags))
+		{
+			const char *name;
+			if (probe_answered(probe) && tr_resolver_lookup(&trace->engine->resolver, probe->from, &name) == TR_NAME_PENDING)
+			{
+				trace->resolving = 1;
+				break;
+			}
+			tr_json_probe(trace, slot_ttl(trace, slot), slot_probe(trace, slot), probe, probe_name(trace, probe));
+			trace->losses += probe->state == TR_PROBE_TIMEOUT;
+			trace_record(trace, probe);
+		}
+		else if (probe->state == TR_PROBE_FAILED)
+		{
+			fprintf(trace->out, TR_PREFIX": wrote %s %u chars, ret=%d", trace->host, params->packet_len, probe->ret);
+		}
+		else if (probe->state == TR_PROBE_TIMEOUT)
+		{
+			(void)fprintf(trace->out, "* ");
+			trace->losses++;
+		}
+		else if (probe->state == TR_PROBE_REPLIED)
+		{
+			/**
+			 * Lorsque le TTL est atteint, le router envoie un message ICMP de type 11 (Time Exceeded).
+			 * Lorsque la destination est atteinte, elle envoie un message ICMP de type 0 (Echo Reply)
+			 * ou de type 3 (Destination Unreachable) code 3 (Port Unreachable), et en TCP
+			 * un segment SYN-ACK ou RST.
+			 */
+			if (probe->icmp_type == ICMP_TIMXCEED || probe->reached)
+			{
+				if (trace->last_addr_reached != probe->from)
+				{
+					/**
+					 * L'affichage de la trace est suspendu jusqu'à ce que le nom
+					 * du routeur soit connu; les probes continuent d'être envoyées
+					 * et reçues pendant ce temps.
+					 */
+					const char *name;
+					if (tr_resolver_lookup(&trace->engine->resolver, probe->from, &name) == TR_NAME_PENDING)
+					{
+						trace->resolving = 1;
+						break;
+					}
+					if (trace->last_addr_reached != 0)
+						(void)fprintf(trace->out, "%s%s", "\n", "    ");
+					print_router_name(trace->out, probe->from, name);
+					trace->last_addr_reached = probe->from;
+				}
+				print_probe_rtt(trace->out, probe);
+			}
+			trace_record(trace, probe);
+		}
+
+		trace->next_print++;
+
+		if (slot_probe(trace, slot) == params->nprobes - 1)
+		{
+			if (json_output(params->flags))
+				tr_json_hop(trace, slot_ttl(trace, slot), params->nprobes, trace->losses);
+			else
+			{
+				if (summary(params->flags))
+				{
+					double loss_percent = ((double)trace->losses / (double)params->nprobes) * 100.0;
+					(void)fprintf(trace->out, "(%.0f%% loss)", loss_percent);
+					print_rtt_summary(trace->out, &trace->hists[slot / params->nprobes]);
+				}
+				(void)fprintf(trace->out, "\n");
+			}
+			trace_flush_output(trace, 1);
+			trace->hop_open = 0;
+			trace_check_stop(trace, slot_ttl(trace, slot), trace->losses == params->nprobes);
+		}
+	}
+	trace_flush_output(trace, 0);
+}
+
+/**
+ * Retrouve la trace active vers une destination.
+ */
+static struct tr_trace *
+engine_find(struct tr_engine *engine, uint32_t dst_addr)
+{
+	uint32_t i = (ntohl(dst_addr) * 2654435761u) & engine->table_mask;
+
+	while (engine->table[i])
+	{
+		if (engine->table[i]->dst_addr == dst_addr)
+			return (engine->table[i]);
+		i = (i + 1) & engine->table_mask;
+	}
+	return (NULL);
+}
+
+static void
+engine_insert(struct tr_engine *engine, struct tr_trace *trace)
+{
+	uint32_t i = (ntohl(trace->dst_addr) * 2654435761u) & engine->table_mask;
+
+	while (engine->table[i])
+		i = (i + 1) & engine->table_mask;
+	engine->table[i] = trace;
+	engine->nactive++;
+}
+
+/**
+ * Retire une trace de la table en décalant les entrées suivantes afin de ne pas
+ * interrompre les séquences de sondage linéaire.
+ */
+static void
+engine_remove(struct tr_engine *engine, struct tr_trace *trace)
+{
+	uint32_t i = (ntohl(trace->dst_addr) * 2654435761u) & engine->table_mask;
+
+	while (engine->table[i] != trace)
+		i = (i + 1) & engine->table_mask;
+	engine->table[i] = NULL;
+	engine->nactive--;
+
+	for (uint32_t j = (i + 1) & engine->table_mask; engine->table[j]; j = (j + 1) & engine->table_mask)
+	{
+		uint32_t home = (ntohl(engine->table[j]->dst_addr) * 2654435761u) & engine->table_mask;
+		// L'entrée j peut occuper la case libérée si sa position d'origine la précède
+		if (((j - home) & engine->table_mask) >= ((j - i) & engine->table_mask))
+		{
+			engine->table[i] = engine->table[j];
+			engine->table[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+/**
+ * NOTE:
+ * Doubletree: les premiers sauts sont communs à toutes les traces issues d'une
+ * même machine, et les derniers à toutes les traces vers une même destination.
+ * Chaque trace commence donc à un TTL intermédiaire (--doubletree) et s'arrête:
+ * - en arrière, dès qu'un routeur répond au TTL auquel une trace précédente
+ *   l'a déjà vu (ensemble local), le chemin jusqu'à lui étant connu;
+ * - en avant, dès qu'un routeur a déjà été vu sur le chemin vers la même
+ *   destination (ensemble global, éventuellement partagé via --stop-set).
+ * Les ensembles ne sont complétés que par les traces terminées, afin que les
+ * traces menées en parallèle ne s'arrêtent pas sur des sauts qu'aucune
+ * n'aurait finalement affichés.
+ */
+
+static void
+trace_stop_backward(struct tr_trace *trace, uint32_t ttl, uint32_t from)
+{
+	struct tr_params *params = trace->params;
+	uint32_t end = (ttl - params->first_ttl) * params->nprobes;
+
+	// Les sauts déjà affichés, même en partie, sont conservés
+	uint32_t start = (trace->next_print / params->nprobes + trace->hop_open) * params->nprobes;
+	if (start >= end)
+		return;
+
+	for (uint32_t i = start; i < end; ++i)
+	{
+		if (trace->probes[i].state == TR_PROBE_SENT)
+		{
+			tr_timer_cancel(&trace->engine->wheel, &trace->probes[i].timer);
+			trace->inflight--;
+		}
+		trace->probes[i].state = TR_PROBE_CANCELLED;
+	}
+	// Les probes restantes du saut connu sont encore envoyées
+	if (trace->back_hops <= ttl - params->first_ttl)
+		trace->back_hops = 0;
+	trace->back_skip_ttl = slot_ttl(trace, start);
+	trace->back_stop_ttl = ttl;
+	trace->back_stop_addr = from;
+}
+
+static void
+trace_check_stopsets(struct tr_trace *trace, uint32_t ttl, uint32_t from)
+{
+	struct tr_engine *engine = trace->engine;
+
+	if (ttl < trace->params->doubletree)
+	{
+		if (ttl > trace->back_stop_ttl && tr_stopset_has(&engine->local_stop, tr_stopset_key(from, ttl)))
+			trace_stop_backward(trace, ttl, from);
+		return;
+	}
+	// Un saut plus proche peut encore avancer l'arrêt
+	if (trace->stop != TR_STOP_NONE && trace->stop != TR_STOP_STOP_SET)
+		return;
+	if ((ttl - trace->params->first_ttl + 1) * trace->params->nprobes >= trace->end)
+		return;
+	if (tr_stopset_has(&engine->global_stop, tr_stopset_key(from, trace->dst_addr)))
+	{
+		trace->stop = TR_STOP_STOP_SET;
+		trace->stop_addr = from;
+		trace_truncate(trace, ttl);
+	}
+}
+
+/**
+ * Enregistre la réponse à une probe. Lorsque la destination est atteinte, les
+ * sauts suivants sont abandonnés.
+ */
+static void
+probe_reply(struct tr_trace *trace, struct tr_probe *probe, uint32_t from, int reached, struct timespec *end, struct timespec *rx_ts)
+{
+	struct tr_engine *engine = trace->engine;
+
+	tr_timer_cancel(&engine->wheel, &probe->timer);
+	probe->state = TR_PROBE_REPLIED;
+	probe->reached = reached;
+	probe->from = from;
+	probe->end = *end;
+	if (rx_ts)
+		probe->rx_ts = *rx_ts;
+	trace_sample_rtt(trace, probe);
+	trace->inflight--;
+	trace_touch(trace);
+
+	// La résolution du nom est lancée dès la réception, bien avant l'affichage
+	const char *name;
+	(void)tr_resolver_lookup(&engine->resolver, probe->from, &name);
+
+	uint32_t ttl = slot_ttl(trace, probe - trace->probes);
+	if (reached)
+	{
+		trace->stop = TR_STOP_REACHED;
+		trace_truncate(trace, ttl);
+	}
+	else if (engine->params->doubletree && from)
+		trace_check_stopsets(trace, ttl, from);
+}
+
+/**
+ * Retrouve la probe à laquelle répond un message ICMP en mode sans état: le
+ * TTL, le numéro de probe et l'heure d'envoi sont décodés de la citation, le
+ * RTT est donc calculé sans l'heure d'envoi enregistrée par la probe.
+ */
+static struct tr_probe *
+stateless_lookup(struct tr_engine *engine, struct icmp *icmp, size_t icmp_len, uint32_t from, struct timespec *end, struct tr_trace **trace)
+{
+	struct tr_params *params = engine->params;
+	struct tr_stateless_id id;
+
+	if (tr_stateless_decode(icmp, icmp_len, params, &id) || id.ttl < params->first_ttl || id.probe >= params->nprobes)
+		return (NULL);
+	if ((*trace = engine_find(engine, id.dst_addr ? id.dst_addr : from)) == NULL)
+		return (NULL);
+
+	uint32_t slot = (id.ttl - params->first_ttl) * params->nprobes + id.probe;
+	if (slot >= (*trace)->end || (*trace)->probes[slot].state != TR_PROBE_SENT)
+		return (NULL);
+
+	struct tr_probe *probe = &(*trace)->probes[slot];
+	if (!id.timed)
+		return (probe);
+
+	uint64_t rtt = (uint16_t)(tr_stateless_ticks(end) - id.sent) * (uint64_t)TR_STATELESS_TICK_NS;
+	uint64_t end_ns = (uint64_t)end->tv_sec * 1000000000 + end->tv_nsec;
+	probe->start.tv_sec = (end_ns - rtt) / 1000000000;
+	probe->start.tv_nsec = (end_ns - rtt) % 1000000000;
+	return (probe);
+}
+
+/**
+ * Traite une trame reçue par le socket de réception.
+ */
+static void
+engine_receive(struct tr_engine *engine, uint8_t *buff, size_t n, union tr_sockaddr *from, struct timespec *end, struct timespec *rx_ts)
+{
+	struct tr_params *params = engine->params;
+
+	/**
+	 * Le packet reçu est une trame IP contenant un message ICMP, lui même
+	 * contenant la requête initiale.
+	 * ┌─────────────────────────────────────────┐
+	 * │ IP header                               │  ← ip
+	 * ├─────────────────────────────────────────┤
+	 * │ ICMP header (type=X, code=X)            │  ← icmp
+	 * ├─────────────────────────────────────────┤
+	 * │ Inner IP header (paquet original)       │  ← inner_ip
+	 * ├─────────────────────────────────────────┤
+	 * │ Proto header (paquet original)          │  ← inner_udp
+	 * └─────────────────────────────────────────┘
+	 */
+	if (n < sizeof(struct ip))
+		return;
+
+	struct ip *ip = (struct ip *)buff;
+	size_t ip_header_len = ip->ip_hl * 4;
+	if (n < ip_header_len)
+		return;
+
+	// Le contenu ICMP commence après l'en-tête IP
+	struct icmp *icmp = (struct icmp *)(buff + ip_header_len);
+
+	/**
+	 * Un message ICMP altéré pourrait être attribué à la mauvaise probe. La
+	 * checksum ne peut être vérifiée que si le message a été reçu en entier.
+	 */
+	if (ntohs(ip->ip_len) <= n && !inet_checksum_verify(icmp, n - ip_header_len))
+		return;
+
+	/**
+	 * Application du filtre de validation des réponses ICMP reçues
+	 * en fonction du protocole utilisé pour envoyer les probes, puis
+	 * aiguillage vers la trace correspondant à la destination de la probe.
+	 */
+	uint32_t dst_addr = 0;
+	struct tr_trace *trace = NULL;
+	struct tr_probe *probe = NULL;
+
+	if (params->flags & TR_FLAG_STATELESS)
+	{
+		probe = stateless_lookup(engine, icmp, n - ip_header_len, from->sin.sin_addr.s_addr, end, &trace);
+		rx_ts = NULL;
+	}
+	else
+	{
+		int port = get_response_port(icmp, n - ip_header_len, params, &dst_addr);
+
+		if (port >= 0)
+			trace = engine_find(engine, dst_addr ? dst_addr : from->sin.sin_addr.s_addr);
+		if (trace)
+			probe = trace_lookup(trace, port);
+	}
+	if (probe == NULL)
+	{
+		if (verbose(params->flags))
+		{
+			print_verbose_response(engine->out, (uint8_t *)ip, n);
+		}
+		return;
+	}
+
+	int reached = icmp->icmp_type == ICMP_ECHOREPLY || (icmp->icmp_type == ICMP_UNREACH && icmp->icmp_code == ICMP_UNREACH_PORT);
+	probe->icmp_type = icmp->icmp_type;
+	probe->icmp_code = icmp->icmp_code;
+	probe_reply(trace, probe, from->sin.sin_addr.s_addr, reached, end, rx_ts);
+}
+
+/**
+ * Traite un message reçu par le socket ICMPv6. Le noyau ne transmet pas l'en-tête
+ * IPv6 et a déjà vérifié la checksum: la trame commence à l'en-tête ICMPv6.
+ */
+static void
+engine_receive6(struct tr_engine *engine, uint8_t *buff, size_t n, union tr_sockaddr *from, struct timespec *end, struct timespec *rx_ts)
+{
+	struct tr_params *params = engine->params;
+	struct icmp6_hdr *icmp6 = (struct icmp6_hdr *)buff;
+	uint32_t dst_addr = 0;
+	struct tr_trace *trace = NULL;
+	struct tr_probe *probe = NULL;
+
+	int port = get_response_port6(icmp6, n, params, &dst_addr);
+	if (port >= 0)
+		trace = engine_find(engine, dst_addr ? dst_addr : tr_addr_find(&from->sin6.sin6_addr));
+	if (trace)
+		probe = trace_lookup(trace, port);
+	if (probe == NULL)
+	{
+		if (verbose(params->flags))
+		{
+			print_verbose_response6(engine->out, &from->sin6.sin6_addr, buff, n);
+		}
+		return;
+	}
+
+	// Les types ICMPv6 sont ramenés à leurs équivalents ICMP (voir struct tr_probe)
+	int reached = icmp6->icmp6_type == ICMP6_ECHO_REPLY
+		|| (icmp6->icmp6_type == ICMP6_DST_UNREACH && icmp6->icmp6_code == ICMP6_DST_UNREACH_NOPORT);
+	if (icmp6->icmp6_type == ICMP6_TIME_EXCEEDED)
+		probe->icmp_type = ICMP_TIMXCEED;
+	else if (icmp6->icmp6_type == ICMP6_DST_UNREACH)
+		probe->icmp_type = ICMP_UNREACH;
+	else
+		probe->icmp_type = ICMP_ECHOREPLY;
+	probe->icmp_code = icmp6->icmp6_code;
+	probe_reply(trace, probe, tr_sockaddr_addr(from), reached, end, rx_ts);
+}
+
+/**
+ * Traite un segment reçu par le socket TCP: seuls les SYN-ACK et RST de la
+ * destination, acquittant une de nos probes, sont retenus.
+ */
+static void
+engine_receive_tcp(struct tr_engine *engine, uint8_t *buff, size_t n, union tr_sockaddr *from, struct timespec *end, struct timespec *rx_ts)
+{
+	if (n < sizeof(struct ip))
+		return;
+
+	struct ip *ip = (struct ip *)buff;
+	size_t ip_header_len = ip->ip_hl * 4;
+	if (n < ip_header_len)
+		return;
+
+	int port = get_tcp_reply_port((struct tcphdr *)(buff + ip_header_len), n - ip_header_len, engine->params);
+	if (port < 0)
+		return;
+
+	// La réponse provient de la destination elle-même
+	struct tr_trace *trace = engine_find(engine, from->sin.sin_addr.s_addr);
+	struct tr_probe *probe = trace ? trace_lookup(trace, port) : NULL;
+	if (probe == NULL)
+		return;
+
+	probe->icmp_type = 0;
+	probe->icmp_code = 0;
+	probe_reply(trace, probe, from->sin.sin_addr.s_addr, 1, end, rx_ts);
+}
+
+/**
+ * Appelé par la roue de timers lorsque le délai d'attente d'une probe est dépassé.
+ */
+static void
+trace_expire(struct tr_timer *timer)
+{
+	struct tr_trace *trace = timer->data;
+	struct tr_probe *probe = tr_container_of(timer, struct tr_probe, timer);
+
+	probe->state = TR_PROBE_TIMEOUT;
+	trace->inflight--;
+	trace_touch(trace);
+}
+
+/**
+ * Début du cycle suivant de la surveillance continue.
+ */
+static void
+trace_next_cycle(struct tr_timer *timer)
+{
+	trace_touch(timer->data);
+}
+
+/**
+ * Associe les horodatages d'émission en attente dans la file d'erreurs du socket
+ * d'envoi à leurs probes.
+ */
+static void
+engine_drain_txstamps(struct tr_engine *engine)
+{
+	uint32_t key;
+	struct timespec ts;
+	int r;
+
+	if (!engine->tx_stamping)
+		return;
+
+	while ((r = tr_txstamp_read(engine->send_sock, &key, &ts)) != 0)
+	{
+		if (r < 0)
+			continue;
+
+		struct tr_probe *probe = engine->txmap[key & TR_TXMAP_MASK];
+		if (probe && probe->tx_key == key)
+		{
+			probe->tx_ts = ts;
+			engine->txmap[key & TR_TXMAP_MASK] = NULL;
+		}
+	}
+}
+
+static void
+engine_on_error(struct tr_evsource *source, uint32_t events)
+{
+	(void)events;
+	engine_drain_txstamps(source->data);
+}
+
+typedef void	(*engine_receive_fn)(struct tr_engine *engine, uint8_t *buff, size_t n, union tr_sockaddr *from, struct timespec *end, struct timespec *rx_ts);
+
+/**
+ * Les trames reçues sont confiées par lots au filtre de validation, jusqu'à ce
+ * que le socket soit vide. Retourne le nombre de trames lues.
+ */
+static uint64_t
+engine_drain(struct tr_engine *engine, struct tr_recvring *ring, int sock, engine_receive_fn receive)
+{
+	uint64_t count = 0;
+	int n;
+
+	do
+	{
+		struct timespec end;
+		struct timespec rx_ts;
+
+		if ((n = tr_ring_drain(ring, sock)) <= 0)
+			break;
+
+		(void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+		for (int i = 0; i < n; ++i)
+		{
+			count++;
+			if (ring->msgs[i].msg_len == 0)
+				continue;
+			int stamped = tr_ring_timestamp(ring, i, &rx_ts);
+			receive(engine, ring->iov[i].iov_base, ring->msgs[i].msg_len, &ring->from[i], &end, stamped ? &rx_ts : NULL);
+		}
+	} while (n == TR_RECV_BATCH);
+	return (count);
+}
+
+static void
+engine_on_recv(struct tr_evsource *source, uint32_t events)
+{
+	struct tr_engine *engine = source->data;
+
+	(void)events;
+
+	// Les horodatages d'émission doivent être connus avant de traiter les réponses
+	engine_drain_txstamps(engine);
+	engine->rx_packets += engine_drain(engine, &engine->ring, source->fd,
+		engine->params->family == AF_INET6 ? engine_receive6 : engine_receive);
+}
+
+/**
+ * En TCP le socket d'envoi reçoit aussi les réponses de la destination, en plus
+ * des horodatages d'émission de sa file d'erreurs.
+ */
+static void
+engine_on_send_sock(struct tr_evsource *source, uint32_t events)
+{
+	struct tr_engine *engine = source->data;
+
+	engine_drain_txstamps(engine);
+	if (events & TR_EV_READ)
+		(void)engine_drain(engine, &engine->tcp_ring, source->fd, engine_receive_tcp);
+}
+
+/**
+ * Un jeton est disponible: les traces en attente reprennent leurs envois dans
+ * l'ordre où elles ont été bloquées.
+ */
+static void
+engine_on_pacer(struct tr_evsource *source, uint32_t events)
+{
+	struct tr_engine *engine = source->data;
+	struct tr_trace *trace = engine->paced_head;
+
+	(void)events;
+	tr_pacer_ack(&engine->pacer);
+	engine->paced_head = NULL;
+	engine->paced_tail = NULL;
+	while (trace)
+	{
+		struct tr_trace *next = trace->next_paced;
+		trace->paced = 0;
+		trace_touch(trace);
+		trace = next;
+	}
+}
+
+/**
+ * Reprend l'affichage des traces qui attendaient un nom.
+ */
+static void
+engine_on_resolved(struct tr_evsource *source, uint32_t events)
+{
+	struct tr_engine *engine = source->data;
+
+	(void)events;
+	tr_resolver_ack(&engine->resolver);
+
+	for (uint32_t i = 0; i <= engine->table_mask; ++i)
+	{
+		struct tr_trace *trace = engine->table[i];
+		if (trace && trace->resolving)
+		{
+			trace->resolving = 0;
+			trace_touch(trace);
+		}
+	}
+}
+
+static int
+engine_init(struct tr_engine *engine, int send_sock, int recv_sock, uint32_t concurrency, struct tr_params *params)
+{
+	memset(engine, 0, sizeof(*engine));
+	engine->params = params;
+	engine->out = tr_out();
+	engine->tty = isatty(fileno(engine->out));
+	engine->send_sock = send_sock;
+	engine->recv_sock = recv_sock;
+	engine->concurrency = concurrency;
+
+	// La table est au moins deux fois plus grande que le nombre de traces actives
+	uint32_t size = 1;
+	while (size < concurrency * 2)
+		size <<= 1;
+	engine->table_mask = size - 1;
+	engine->table = calloc(size, sizeof(struct tr_trace *));
+	if (engine->table == NULL)
+	{
+		tr_perr("calloc");
+		return (-1);
+	}
+
+	if (tr_evloop_init(&engine->loop))
+	{
+		free(engine->table);
+		return (-1);
+	}
+	tr_timer_wheel_init(&engine->wheel, tr_now_ms());
+
+	if (tr_template_init(&engine->tmpl, params))
+		goto err_loop;
+
+	if (params->flags & TR_FLAG_MDA)
+	{
+		for (uint32_t k = 1; k <= TR_MDA_MAX_NEXTHOPS; ++k)
+			engine->mda_stop[k] = tr_mda_stop(k, params->mda_confidence);
+	}
+
+	if (tr_pacer_init(&engine->pacer, params->rate, params->bitrate, params->burst, tr_template_wire_len(&engine->tmpl, params)))
+	{
+		tr_template_destroy(&engine->tmpl);
+		goto err_loop;
+	}
+
+	if (params->doubletree)
+	{
+		if (tr_stopset_init(&engine->local_stop) || tr_stopset_init(&engine->global_stop))
+			goto err_template;
+		if (params->stop_set && tr_stopset_load(&engine->global_stop, params->stop_set))
+			goto err_template;
+	}
+
+	if (params->archive && tr_archive_open(&engine->archive, params->archive, params))
+		goto err_template;
+
+	if (params->histograms && (tr_histtab_init(&engine->histtab) || tr_histtab_load(&engine->histtab, params->histograms)))
+		goto err_template;
+
+	if (tr_batch_supported(params))
+	{
+		tr_batch_init(&engine->batch, &engine->tmpl);
+		engine->batching = 1;
+	}
+
+	if (tr_ring_init(&engine->ring, recv_sock))
+		goto err_template;
+	if (params->protocol == TR_PROTO_TCP && tr_ring_init(&engine->tcp_ring, send_sock))
+		goto err_ring;
+
+	// Le cache persistant n'est indexé que par des adresses IPv4
+	if (tr_resolver_init(&engine->resolver, params->family == AF_INET ? params->name_cache : NULL))
+		goto err_ring;
+	engine->resolver_source.fd = engine->resolver.efd;
+	engine->resolver_source.handler = engine_on_resolved;
+	engine->resolver_source.data = engine;
+	if (tr_evloop_add(&engine->loop, &engine->resolver_source, TR_EV_READ))
+		goto err_resolver;
+
+	// En mode sans état l'heure d'envoi est portée par la probe elle-même
+	if (!(params->flags & TR_FLAG_STATELESS))
+		engine->tx_stamping = tr_timestamping_enable(send_sock, recv_sock);
+
+	/**
+	 * La file d'erreurs est signalée par EPOLLERR, toujours surveillé par epoll:
+	 * aucun autre événement n'est demandé sur le socket d'envoi, sauf en TCP où
+	 * il reçoit les réponses de la destination.
+	 */
+	engine->err_source.fd = send_sock;
+	engine->err_source.handler = engine_on_error;
+	engine->err_source.data = engine;
+	if (params->protocol == TR_PROTO_TCP)
+	{
+		int on = 1;
+		(void)setsockopt(send_sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+		(void)tr_filter_attach_tcp(send_sock, params);
+		engine->err_source.handler = engine_on_send_sock;
+		if (tr_evloop_add(&engine->loop, &engine->err_source, TR_EV_READ))
+			goto err_resolver;
+	}
+	else if (engine->tx_stamping)
+		(void)tr_evloop_add(&engine->loop, &engine->err_source, 0);
+
+	engine->pacer_source.fd = engine->pacer.tfd;
+	engine->pacer_source.handler = engine_on_pacer;
+	engine->pacer_source.data = engine;
+	if (engine->pacer.tfd >= 0 && tr_evloop_add(&engine->loop, &engine->pacer_source, TR_EV_READ))
+		goto err_resolver;
+
+	engine->recv_source.fd = recv_sock;
+	engine->recv_source.handler = engine_on_recv;
+	engine->recv_source.data = engine;
+	if (tr_evloop_add(&engine->loop, &engine->recv_source, TR_EV_READ))
+		goto err_resolver;
+	return (0);
+
+err_resolver:
+	tr_resolver_destroy(&engine->resolver);
+err_ring:
+	tr_ring_destroy(&engine->tcp_ring);
+	tr_ring_destroy(&engine->ring);
+err_template:
+	tr_histtab_destroy(&engine->histtab);
+	tr_archive_close(&engine->archive);
+	tr_stopset_destroy(&engine->global_stop);
+	tr_stopset_destroy(&engine->local_stop);
+	tr_pacer_destroy(&engine->pacer);
+	tr_template_destroy(&engine->tmpl);
+err_loop:
+	tr_evloop_close(&engine->loop);
+	free(engine->table);
+	return (-1);
+}
+
+static void
+engine_destroy(struct tr_engine *engine)
+{
+	tr_resolver_destroy(&engine->resolver);
+	tr_ring_destroy(&engine->tcp_ring);
+	tr_ring_destroy(&engine->ring);
+	tr_pacer_destroy(&engine->pacer);
+	if (engine->params->stop_set && engine->global_stop.keys)
+		(void)tr_stopset_save(&engine->global_stop, engine->params->stop_set);
+	tr_stopset_destroy(&engine->global_stop);
+	tr_stopset_destroy(&engine->local_stop);
+	tr_archive_close(&engine->archive);
+	if (engine->params->histograms && engine->histtab.addrs)
+		(void)tr_histtab_save(&engine->histtab, engine->params->histograms);
+	tr_histtab_destroy(&engine->histtab);
+	tr_template_destroy(&engine->tmpl);
+	tr_evloop_close(&engine->loop);
+	free(engine->table);
+}
+
+/**
+ * Crée une trace vers `dst_addr` et l'ajoute aux traces actives. En mode
+ * multi-cibles la sortie est accumulée en mémoire et écrite d'un bloc à la fin
+ * de la trace, afin que les résultats des différentes cibles ne se mélangent pas.
+ */
+static struct tr_trace *
+engine_start(struct tr_engine *engine, char *host, uint32_t dst_addr, int buffered)
+{
+	struct tr_trace *trace = malloc(sizeof(struct tr_trace));
+	if (trace == NULL)
+	{
+		tr_perr("malloc");
+		free(host);
+		return (NULL);
+	}
+	if (trace_init(trace, engine, dst_addr, engine->params))
+	{
+		free(host);
+		free(trace);
+		return (NULL);
+	}
+	trace->host = host;
+
+	// En TCP l'adresse source entre dans la checksum: elle dépend de la route vers la cible
+	trace->src_addr = engine->params->local_addr;
+	if (trace->src_addr == 0 && (engine->params->protocol == TR_PROTO_TCP || (engine->params->flags & TR_FLAG_STATELESS)))
+		trace->src_addr = get_source_ip_addr(dst_addr);
+
+	// Les enregistrements --json portent leur destination et sont écrits au fil de l'eau
+	if (json_output(engine->params->flags))
+		tr_json_trace(trace);
+	else if (buffered)
+	{
+		trace->out = open_memstream(&trace->outbuf, &trace->outlen);
+		if (trace->out == NULL)
+		{
+			tr_perr("open_memstream");
+			trace->out = engine->out;
+			trace_destroy(trace);
+			free(trace);
+			return (NULL);
+		}
+		print_trace_header(trace->out, host, dst_addr, engine->params);
+	}
+
+	engine_insert(engine, trace);
+	trace_touch(trace);
+	return (trace);
+}
+
+/**
+ * Ajoute les routeurs d'une trace terminée aux ensembles d'arrêt de Doubletree.
+ * Un ensemble plein n'empêche que des arrêts, la trace reste valide.
+ */
+static void
+engine_learn(struct tr_engine *engine, struct tr_trace *trace)
+{
+	for (uint32_t i = 0; i < trace->end; ++i)
+	{
+		struct tr_probe *probe = &trace->probes[i];
+		if (probe->state != TR_PROBE_REPLIED || probe->reached || probe->from == 0)
+			continue;
+		(void)tr_stopset_add(&engine->local_stop, tr_stopset_key(probe->from, slot_ttl(trace, i)));
+		(void)tr_stopset_add(&engine->global_stop, tr_stopset_key(probe->from, trace->dst_addr));
+	}
+
+	if (trace->stop == TR_STOP_STOP_SET && !json_output(engine->params->flags))
+	{
+		char addr[TR_ADDRSTRLEN];
+		char dst[TR_ADDRSTRLEN];
+		(void)fprintf(trace->out, "stopped: %s already seen on the path to %s\n",
+			tr_addr_ntop(trace->stop_addr, addr, sizeof(addr)), tr_addr_ntop(trace->dst_addr, dst, sizeof(dst)));
+	}
+}
+
+static void
+engine_finish(struct tr_engine *engine, struct tr_trace *trace)
+{
+	engine_remove(engine, trace);
+	trace_untouch(trace);
+	trace_unpace(trace);
+
+	if (engine->params->doubletree)
+		engine_learn(engine, trace);
+
+	int status = 0;
+	if (trace->stop == TR_STOP_NONE)
+		trace->stop = TR_STOP_MAX_TTL;
+	else if (trace->stop == TR_STOP_GAP)
+		status = TR_EXIT_GAP;
+	else if (trace->stop == TR_STOP_LOOP)
+		status = TR_EXIT_LOOP;
+	if (status > engine->status)
+		engine->status = status;
+
+	if (engine->archive.fp)
+		(void)tr_archive_trace(&engine->archive, trace);
+
+	if (json_output(engine->params->flags))
+		tr_json_done(trace);
+	// Le bloc d'une trace tamponnée est écrit d'un seul appel, sans se mêler aux autres
+	if (trace->out != engine->out)
+	{
+		(void)fflush(trace->out);
+		(void)fwrite(trace->outbuf, 1, trace->outlen, engine->out);
+	}
+	(void)fflush(engine->out);
+	trace_destroy(trace);
+	free(trace);
+}
+
+/**
+ * Lit la prochaine cible du fichier de cibles: une cible par ligne, les lignes
+ * vides et les commentaires (#) sont ignorés.
+ */
+static char *
+read_target(struct tr_engine *engine)
+{
+	char line[NI_MAXHOST + 2];
+
+	while (fgets(line, sizeof(line), engine->targets))
+	{
+		engine->target_line++;
+		char *start = line;
+		while (isspace((unsigned char)*start))
+			start++;
+		char *end = start + strcspn(start, "# \t\r\n");
+		*end = '\0';
+		if (*start)
+			return (strdup(start));
+	}
+	return (NULL);
+}
+
+/**
+ * Retire de la file d'attente la première cible qui n'est plus en cours de
+ * trace, NULL s'il n'y en a aucune.
+ */
+static struct tr_target *
+engine_unqueue(struct tr_engine *engine)
+{
+	struct tr_target **link = &engine->pending;
+
+	while (*link && engine_find(engine, (*link)->dst_addr))
+		link = &(*link)->next;
+
+	struct tr_target *target = *link;
+	if (target == NULL)
+		return (NULL);
+	*link = target->next;
+	if (engine->pending_tail == &target->next)
+		engine->pending_tail = link;
+	engine->npending--;
+	return (target);
+}
+
+static int
+engine_queue(struct tr_engine *engine, char *host, uint32_t dst_addr)
+{
+	struct tr_target *target = malloc(sizeof(struct tr_target));
+	if (target == NULL)
+	{
+		tr_perr("malloc");
+		return (-1);
+	}
+	target->host = host;
+	target->dst_addr = dst_addr;
+	target->next = NULL;
+	if (engine->pending == NULL)
+		engine->pending_tail = &engine->pending;
+	*engine->pending_tail = target;
+	engine->pending_tail = &target->next;
+	engine->npending++;
+	return (0);
+}
+
+/**
+ * Démarre de nouvelles traces tant que la limite de concurrence le permet.
+ * Une cible déjà en cours de trace est mise en attente jusqu'à la fin de la
+ * trace précédente, les réponses ne pouvant être aiguillées que par destination;
+ * les cibles suivantes sont admises sans l'attendre.
+ */
+static void
+engine_admit(struct tr_engine *engine)
+{
+	struct tr_params scratch = *engine->params;
+
+	while (engine->nactive < engine->concurrency)
+	{
+		struct tr_target *target = engine_unqueue(engine);
+		if (target)
+		{
+			(void)engine_start(engine, target->host, target->dst_addr, 1);
+			free(target);
+			continue;
+		}
+
+		if (engine->targets == NULL || engine->npending >= TR_MAX_PENDING)
+			return;
+
+		char *host = read_target(engine);
+		if (host == NULL)
+		{
+			engine->targets = NULL;
+			return;
+		}
+
+		uint32_t dst_addr = get_destination_ip_addr(host, &scratch);
+		if (dst_addr == 0)
+		{
+			// Le contenu du fichier n'est pas recopié: il peut ne pas être lisible par l'utilisateur
+			(void)fprintf(tr_errout(), "traceroute: targets line %u: unknown host\n", engine->target_line);
+			free(host);
+			continue;
+		}
+
+		if (engine_find(engine, dst_addr) == NULL)
+			(void)engine_start(engine, host, dst_addr, 1);
+		else if (engine_queue(engine, host, dst_addr))
+			free(host);
+	}
+}
+
+/**
+ * Boucle principale: seules les traces concernées par un événement (réponse,
+ * expiration, envoi) sont traitées à chaque tour.
+ */
+static void
+engine_run(struct tr_engine *engine)
+{
+	engine_admit(engine);
+
+	while (engine->nactive > 0)
+	{
+		while (engine->dirty)
+		{
+			struct tr_trace *trace = engine->dirty;
+			engine->dirty = trace->next_dirty;
+			trace->dirty = 0;
+
+			trace_send(trace);
+			trace_render(trace);
+			if (trace->next_print >= trace->end)
+			{
+				if (trace_cycle(trace))
+					continue;
+				engine_finish(engine, trace);
+				engine_admit(engine);
+				continue;
+			}
+			// Aucune probe en vol (échecs d'envoi): on passe directement aux suivantes
+			if (trace->inflight == 0 && !trace->resolving && !trace->paced && !tr_timer_pending(&trace->cycle_timer))
+				trace_touch(trace);
+		}
+		if (engine->nactive == 0)
+			break;
+
+		/**
+		 * On attend jusqu'à la prochaine échéance de la roue de timers, puis on
+		 * déclenche d'un coup toutes les expirations survenues pendant l'attente.
+		 */
+		if (tr_evloop_wait(&engine->loop, (int)tr_timer_next(&engine->wheel)) < 0)
+			break;
+		tr_timer_advance(&engine->wheel, tr_now_ms());
+	}
+
+	if (engine->params->doubletree && verbose(engine->params->flags))
+		(void)fprintf(engine->out, "%llu probes sent\n", (unsigned long long)engine->probes_sent);
+
+	if (engine->filtered && verbose(engine->params->flags))
+	{
+		uint64_t icmp_in = tr_filter_icmp_in(engine->params->family) - engine->icmp_in;
+		(void)fprintf(engine->out, "%llu ICMP packets discarded by filter\n",
+			(unsigned long long)(icmp_in > engine->rx_packets ? icmp_in - engine->rx_packets : 0));
+	}
+}
+
+int
+trace(int send_sock, int recv_sock, uint32_t dst_addr, struct tr_params *params)
+{
+	struct tr_engine engine;
+
+	if (engine_init(&engine, send_sock, recv_sock, 1, params))
+		return (1);
+
+	if ((engine.filtered = tr_filter_attach(recv_sock, dst_addr, params)))
+		engine.icmp_in = tr_filter_icmp_in(params->family);
+
+	if (engine_start(&engine, strdup(params->dest_host), dst_addr, 0) == NULL)
+	{
+		engine_destroy(&engine);
+		return (1);
+	}
+
+	engine_run(&engine);
+	engine_destroy(&engine);
+	return (engine.status);
+}
+
+/**
+ * NOTE:
+ * Mode multi-cibles: les cibles sont lues depuis un fichier (ou l'entrée standard)
+ * et tracées simultanément, dans la limite de `concurrency` traces actives, sur
+ * les mêmes sockets d'envoi et de réception. Les réponses sont aiguillées vers
+ * leur trace par l'adresse de destination citée, puis vers leur probe par le port.
+ */
+int
+trace_targets(int send_sock, int recv_sock, FILE *targets, struct tr_params *params)
+{
+	struct tr_engine engine;
+
+	if (engine_init(&engine, send_sock, recv_sock, params->concurrency, params))
+		return (1);
+
+	if ((engine.filtered = tr_filter_attach(recv_sock, 0, params)))
+		engine.icmp_in = tr_filter_icmp_in(params->family);
+
+	engine.targets = targets;
+	engine_run(&engine);
+
+	while (engine.pending)
+	{
+		struct tr_target *target = engine.pending;
+		engine.pending = target->next;
+		free(target->host);
+		free(target);
+	}
+	engine_destroy(&engine);
+	return (engine.status);
+}
@@ -14,37 +14,42 @@
 #include "debug.h"
 
 static int
-is_valid_udp_response(struct icmp *icmp, uint32_t current_port, struct tr_params *params)
+get_udp_response_port(struct icmp *icmp, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr)
 {
 	/**
 	 * Lorsque le TTL expire, le routeur envoie un message ICMP de type 11 (Time Exceeded),
 	 * est inclue dans le réponse ICMP la requête IP originale ayant provoqué le message ICMP,
 	 * ce qui permet d'identifier la probe correspondante.
 	 */
+	if (icmp_len < ICMP_MINLEN + sizeof(struct ip))
+		return (-1);
+
 	struct ip *inner_ip = (struct ip *)(icmp->icmp_data);
-	int inner_len = inner_ip->ip_hl * 4;
+	size_t inner_len = inner_ip->ip_hl * 4;
+	if (icmp_len < ICMP_MINLEN + inner_len + sizeof(struct udphdr))
+		return (-1);
+
 	// On récupère le contenu UDP de la requête originale
 	struct udphdr *inner_udp = (struct udphdr *)((uint8_t *)inner_ip + inner_len);
 
-	uint16_t dport = ntohs(inner_udp->uh_dport);
-
 	// On s'assure que le protocole de la requête correspond bien à de l'UDP
 	if (params->protocol == TR_PROTO_UDP && inner_ip->ip_p != IPPROTO_UDP)
 	{
-		return (0);
+		return (-1);
 	}
 
-	// On s'assure ensuite que le port de destination correspond bien à celui de la probe envoyée
-	if (dport != current_port)
-	{
-		return (0);
-	}
+	// Une autre requête du démon peut tracer la même cible depuis un autre port source
+	if (params->sport && inner_udp->uh_sport != htons(params->sport))
+		return (-1);
+
+	*dst_addr = inner_ip->ip_dst.s_addr;
 
-	return (1);
+	// Le port de destination identifie la probe envoyée
+	return (ntohs(inner_udp->uh_dport));
 }
 
 static int
-is_valid_icmp_response(struct icmp *icmp, uint32_t current_port, struct tr_params *params)
+get_icmp_response_port(struct icmp *icmp, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr)
 {
 	(void)params;
 
@@ -53,16 +58,15 @@ is_valid_icmp_response(struct icmp *icmp, uint32_t current_port, struct tr_param
 		/**
 		 * Lorsque la destination est atteinte, elle envoie un message ICMP de type 0 (Echo Reply).
 		 * On s'assure que les informations contenues dans trame ICMP recues correspondent à la probe envoyée
-		 * en comparant les identifiants et les numéros de séquence.
+		 * en comparant les identifiants, le numéro de séquence identifie la probe.
 		 */
 
-		if (icmp->icmp_id != htons(getpid() & 0xFFFF))
-			return (0);
-
-		if (icmp->icmp_seq != htons(current_port))
-			return (0);
+		if (icmp->icmp_id != htons(tr_ident()))
+			return (-1);
 
-		return (1);
+		// La destination est l'émetteur de la réponse, connu de l'appelant
+		*dst_addr = 0;
+		return (ntohs(icmp->icmp_seq));
 	}
 	else if (icmp->icmp_type == ICMP_TIMXCEED)
 	{
@@ -71,8 +75,13 @@ is_valid_icmp_response(struct icmp *icmp, uint32_t current_port, struct tr_param
 		 * est inclue dans le réponse ICMP la requête IP originale ayant provoqué le message ICMP,
 		 * ce qui permet d'identifier la probe correspondante.
 		 */
+		if (icmp_len < ICMP_MINLEN + sizeof(struct ip))
+			return (-1);
+
 		struct ip *inner_ip = (struct ip *)(icmp->icmp_data);
-		int inner_len = inner_ip->ip_hl * 4;
+		size_t inner_len = inner_ip->ip_hl * 4;
+		if (icmp_len < ICMP_MINLEN + inner_len + ICMP_MINLEN)
+			return (-1);
 
 		// Extraction de la trame ICMP originale renvoyée par le routeur
 		struct icmp *inner_icmp = (struct icmp *)((uint8_t *)inner_ip + inner_len);
@@ -80,33 +89,244 @@ is_valid_icmp_response(struct icmp *icmp, uint32_t current_port, struct tr_param
 		// On s'assure que les informations contenues dans trame ICMP recues correspondent à la probe envoyée
 
 		if (inner_icmp->icmp_type != ICMP_ECHO)
-			return (0);
+			return (-1);
+
+		if (inner_icmp->icmp_id != htons(tr_ident()))
+			return (-1);
+
+		*dst_addr = inner_ip->ip_dst.s_addr;
+		return (ntohs(inner_icmp->icmp_seq));
+	}
+
+	return (-1);
+}
+
+/**
+ * NOTE:
+ * Les probes TCP sont reconnues sans conserver d'état: le port source identifie
+ * la probe, et le numéro de séquence porte l'identifiant de l'exécution dans ses
+ * 16 bits de poids fort et le port source dans ses 16 bits de poids faible.
+ * Les messages ICMP citent les 8 premiers octets du segment (ports et numéro de
+ * séquence), et la destination acquitte le numéro de séquence + 1 dans son
+ * SYN-ACK ou son RST.
+ */
+uint32_t
+tr_tcp_seq(uint16_t sport)
+{
+	return ((uint32_t)tr_ident() << 16 | sport);
+}
+
+static int
+get_tcp_response_port(struct icmp *icmp, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr)
+{
+	(void)params;
+
+	if (icmp->icmp_type != ICMP_TIMXCEED && icmp->icmp_type != ICMP_UNREACH)
+		return (-1);
+
+	if (icmp_len < ICMP_MINLEN + sizeof(struct ip))
+		return (-1);
+
+	struct ip *inner_ip = (struct ip *)(icmp->icmp_data);
+	size_t inner_len = inner_ip->ip_hl * 4;
+	// Seuls les 8 premiers octets du segment sont garantis dans la citation
+	if (icmp_len < ICMP_MINLEN + inner_len + 8)
+		return (-1);
+
+	if (inner_ip->ip_p != IPPROTO_TCP)
+		return (-1);
 
-		if (inner_icmp->icmp_id != htons(getpid() & 0xFFFF))
-			return (0);
+	struct tcphdr *inner_tcp = (struct tcphdr *)((uint8_t *)inner_ip + inner_len);
+	uint16_t sport = ntohs(inner_tcp->th_sport);
+	if (ntohl(inner_tcp->th_seq) != tr_tcp_seq(sport))
+		return (-1);
+
+	*dst_addr = inner_ip->ip_dst.s_addr;
+	return (sport);
+}
+
+/**
+ * Retourne le port source de la probe à laquelle répond un segment TCP de la
+ * destination (SYN-ACK ou RST), ou -1 s'il ne répond à aucune de nos probes.
+ */
+int
+get_tcp_reply_port(struct tcphdr *tcph, size_t tcp_len, struct tr_params *params)
+{
+	if (tcp_len < sizeof(struct tcphdr))
+		return (-1);
 
-		if (inner_icmp->icmp_seq != htons(current_port))
-			return (0);	
+	if (!(tcph->th_flags & (TH_SYN | TH_RST)) || !(tcph->th_flags & TH_ACK))
+		return (-1);
+
+	if (ntohs(tcph->th_sport) != params->port)
+		return (-1);
+
+	uint16_t dport = ntohs(tcph->th_dport);
+	if (ntohl(tcph->th_ack) - 1 != tr_tcp_seq(dport))
+		return (-1);
+
+	return (dport);
+}
+
+/**
+ * Port source des probes UDP du mode sans état, reconnaissable dans les
+ * réponses comme l'identifiant des probes ICMP.
+ */
+uint16_t
+tr_stateless_sport(void)
+{
+	return ((tr_ident() & 0x7FFF) | 0x8000);
+}
+
+/**
+ * Décode une réponse à une probe du mode sans état (voir tr_template_stateless):
+ * la probe et son heure d'envoi sont retrouvées dans l'en-tête cité, sans
+ * consulter l'état des probes envoyées. Retourne -1 si la réponse ne correspond
+ * à aucune de nos probes.
+ */
+int
+tr_stateless_decode(struct icmp *icmp, size_t icmp_len, struct tr_params *params, struct tr_stateless_id *id)
+{
+	if (icmp_len < ICMP_MINLEN)
+		return (-1);
 
-		return (1);
+	// Avec --mda, la checksum des probes ICMP identifie le flux (voir tr_template_stateless)
+	id->timed = params->protocol != TR_PROTO_ICMP || !(params->flags & TR_FLAG_MDA);
+
+	if (icmp->icmp_type == ICMP_ECHOREPLY)
+	{
+		if (params->protocol != TR_PROTO_ICMP || icmp->icmp_id != htons(tr_ident()))
+			return (-1);
+
+		/**
+		 * La destination renvoie le message avec un autre type: la checksum de
+		 * la probe est retrouvée en annulant ce changement (RFC 1624).
+		 */
+		uint16_t seq = ntohs(icmp->icmp_seq);
+		id->dst_addr = 0;
+		id->ttl = seq >> 8;
+		id->probe = seq & 0xFF;
+		id->sent = ntohs(cksum_update(icmp->icmp_cksum, htons(ICMP_ECHOREPLY << 8), htons(ICMP_ECHO << 8)));
+		return (0);
 	}
 
+	if (params->protocol == TR_PROTO_ICMP && icmp->icmp_type != ICMP_TIMXCEED)
+		return (-1);
+
+	if (icmp_len < ICMP_MINLEN + sizeof(struct ip))
+		return (-1);
+
+	struct ip *inner_ip = (struct ip *)(icmp->icmp_data);
+	size_t inner_len = inner_ip->ip_hl * 4;
+	// Seuls les 8 premiers octets du message sont garantis dans la citation
+	if (icmp_len < ICMP_MINLEN + inner_len + 8)
+		return (-1);
+
+	uint8_t *inner = (uint8_t *)inner_ip + inner_len;
+	if (params->protocol == TR_PROTO_UDP)
+	{
+		struct udphdr *inner_udp = (struct udphdr *)inner;
+
+		if (inner_ip->ip_p != IPPROTO_UDP || inner_udp->uh_sport != htons(tr_stateless_sport()))
+			return (-1);
+		id->sent = ntohs(inner_udp->uh_sum);
+	}
+	else
+	{
+		struct icmp *inner_icmp = (struct icmp *)inner;
+
+		if (inner_ip->ip_p != IPPROTO_ICMP || inner_icmp->icmp_type != ICMP_ECHO
+			|| inner_icmp->icmp_id != htons(tr_ident()))
+			return (-1);
+		id->sent = ntohs(inner_icmp->icmp_cksum);
+	}
+
+	uint16_t ip_id = ntohs(inner_ip->ip_id);
+	id->dst_addr = inner_ip->ip_dst.s_addr;
+	id->ttl = ip_id >> 8;
+	id->probe = ip_id & 0xFF;
 	return (0);
 }
 
+/**
+ * Retourne le port (ou le numéro de séquence en ICMP) de la probe ayant provoqué
+ * la réponse ICMP, ou -1 si la réponse ne correspond à aucune de nos probes.
+ * `dst_addr` reçoit la destination de la probe lorsqu'elle est citée dans la
+ * réponse, 0 lorsque la réponse provient de la destination elle-même.
+ */
 int
-is_valid_response(struct icmp *icmp, uint32_t current_port, struct tr_params *params)
+get_response_port(struct icmp *icmp, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr)
 {
+	if (icmp_len < ICMP_MINLEN)
+		return (-1);
+
 	switch (params->protocol)
 	{
 	case TR_PROTO_UDP:
-		return (is_valid_udp_response(icmp, current_port, params));
+		return (get_udp_response_port(icmp, icmp_len, params, dst_addr));
 	case TR_PROTO_ICMP:
-		return (is_valid_icmp_response(icmp, current_port, params));
+		return (get_icmp_response_port(icmp, icmp_len, params, dst_addr));
 	case TR_PROTO_TCP:
+		return (get_tcp_response_port(icmp, icmp_len, params, dst_addr));
 	case TR_PROTO_GRE:
 		tr_err("protocol response validation not implemented");
-		return (0);
+		return (-1);
 	}
-	return (0);
-}
\ No newline at end of file
+	return (-1);
+}
+
+/**
+ * Équivalent de get_response_port() pour les réponses ICMPv6. Le paquet cité
+ * commence par l'en-tête IPv6 de la probe, de taille fixe, les probes n'ayant
+ * pas d'en-tête d'extension. `dst_addr` reçoit l'identifiant de la destination
+ * citée (voir addrtab.c): une destination inconnue n'est pas celle d'une probe.
+ */
+int
+get_response_port6(struct icmp6_hdr *icmp6, size_t icmp_len, struct tr_params *params, uint32_t *dst_addr)
+{
+	if (icmp_len < sizeof(struct icmp6_hdr))
+		return (-1);
+
+	if (icmp6->icmp6_type == ICMP6_ECHO_REPLY)
+	{
+		if (params->protocol != TR_PROTO_ICMP || icmp6->icmp6_id != htons(tr_ident()))
+			return (-1);
+
+		// La destination est l'émetteur de la réponse, connu de l'appelant
+		*dst_addr = 0;
+		return (ntohs(icmp6->icmp6_seq));
+	}
+
+	if (icmp6->icmp6_type != ICMP6_TIME_EXCEEDED && (params->protocol != TR_PROTO_UDP || icmp6->icmp6_type != ICMP6_DST_UNREACH))
+		return (-1);
+
+	// Le message cite au moins les 8 premiers octets qui suivent l'en-tête IPv6
+	if (icmp_len < sizeof(struct icmp6_hdr) + sizeof(struct ip6_hdr) + 8)
+		return (-1);
+
+	struct ip6_hdr *inner_ip6 = (struct ip6_hdr *)(icmp6 + 1);
+	uint8_t *inner = (uint8_t *)(inner_ip6 + 1);
+	int port;
+
+	if (params->protocol == TR_PROTO_UDP)
+	{
+		struct udphdr *inner_udp = (struct udphdr *)inner;
+
+		if (inner_ip6->ip6_nxt != IPPROTO_UDP || (params->sport && inner_udp->uh_sport != htons(params->sport)))
+			return (-1);
+		port = ntohs(inner_udp->uh_dport);
+	}
+	else
+	{
+		struct icmp6_hdr *inner_icmp6 = (struct icmp6_hdr *)inner;
+
+		if (inner_ip6->ip6_nxt != IPPROTO_ICMPV6 || inner_icmp6->icmp6_type != ICMP6_ECHO_REQUEST
+			|| inner_icmp6->icmp6_id != htons(tr_ident()))
+			return (-1);
+		port = ntohs(inner_icmp6->icmp6_seq);
+	}
+
+	if ((*dst_addr = tr_addr_find(&inner_ip6->ip6_dst)) == 0)
+		return (-1);
+	return (port);
+}
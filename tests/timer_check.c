@@ -0,0 +1,129 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   timer_check.c                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/29 10:12:44 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/29 10:12:44 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * NOTE:
+ * Vérifie que la boucle principale, qui dort tr_timer_next() millisecondes
+ * avant chaque tr_timer_advance(), déclenche les timers à leur échéance exacte.
+ * Le premier cas est celui d'un timer de niveau 2 dont la cascade précède la
+ * première case non vide du niveau 1.
+ * Usage: ./timer_check
+ */
+
+#include "traceroute.h"
+#include "timer.h"
+
+struct check_timer {
+	struct tr_timer			timer;
+	struct tr_timer_wheel	*wheel;
+	uint64_t				fired;
+};
+
+static void
+on_expire(struct tr_timer *timer)
+{
+	struct check_timer *check = tr_container_of(timer, struct check_timer, timer);
+
+	check->fired = check->wheel->now;
+}
+
+static void
+check_add(struct tr_timer_wheel *wheel, struct check_timer *check, uint64_t expires)
+{
+	check->wheel = wheel;
+	check->fired = 0;
+	tr_timer_init(&check->timer, on_expire, NULL);
+	tr_timer_add(wheel, &check->timer, expires);
+}
+
+/**
+ * Avance la roue comme engine_run(), d'échéance en échéance.
+ */
+static void
+run_wheel(struct tr_timer_wheel *wheel)
+{
+	int64_t next;
+
+	while ((next = tr_timer_next(wheel)) >= 0)
+		tr_timer_advance(wheel, wheel->now + (next ? next : 1));
+}
+
+static int
+check_fired(const char *name, const struct check_timer *check, uint64_t expires)
+{
+	if (check->fired == expires)
+		return (0);
+	(void)fprintf(stderr, "%s: timer due at %llu fired at %llu\n", name,
+		(unsigned long long)expires, (unsigned long long)check->fired);
+	return (1);
+}
+
+static int
+check_cascade_first(void)
+{
+	struct tr_timer_wheel wheel;
+	struct check_timer a, b;
+	int res = 0;
+
+	tr_timer_wheel_init(&wheel, 0);
+	check_add(&wheel, &a, 4100);
+	tr_timer_advance(&wheel, 1000);
+	check_add(&wheel, &b, 5000);
+
+	// La cascade du niveau 2 à 4096 précède la case du niveau 1 à 4992
+	if (tr_timer_next(&wheel) != 3096)
+	{
+		(void)fprintf(stderr, "cascade: next deadline %lld, expected 3096\n", (long long)tr_timer_next(&wheel));
+		res = 1;
+	}
+	run_wheel(&wheel);
+	res |= check_fired("cascade", &a, 4100);
+	res |= check_fired("cascade", &b, 5000);
+	return (res);
+}
+
+/**
+ * Timers de durées variées, ajoutés à des instants variés: chacun doit être
+ * déclenché à son échéance.
+ */
+static int
+check_mixed(void)
+{
+	struct tr_timer_wheel wheel;
+	struct check_timer checks[64];
+	uint64_t expires[64];
+	uint32_t seed = 42;
+	int res = 0;
+
+	tr_timer_wheel_init(&wheel, 0);
+	for (int i = 0; i < 64; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		tr_timer_advance(&wheel, wheel.now + (seed >> 16) % 500);
+		seed = seed * 1103515245 + 12345;
+		expires[i] = wheel.now + 1 + (seed >> 8) % 300000;
+		check_add(&wheel, &checks[i], expires[i]);
+	}
+	run_wheel(&wheel);
+	for (int i = 0; i < 64; ++i)
+		res |= check_fired("mixed", &checks[i], expires[i]);
+	return (res);
+}
+
+int
+main(void)
+{
+	int res = check_cascade_first() | check_mixed();
+
+	(void)printf("%s\n", res ? "timer_check: FAILED" : "timer_check: OK");
+	return (res);
+}
@@ -0,0 +1,431 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   trarchive.c                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: mgama <mgama@student.42lyon.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/11/24 14:12:36 by mgama             #+#    #+#             */
+/*   Updated: 2025/11/24 14:12:36 by mgama            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * NOTE:
+ * Lecture des archives écrites par ft_traceroute --archive. Chaque archive est
+ * projetée en mémoire: les traces sont d'abord filtrées par destination et par
+ * date à partir de l'index, seuls les blocs retenus sont ensuite lus, et seule
+ * leur table d'adresses est parcourue pour le filtre par routeur.
+ * Usage: ./trarchive [-l] [-t target] [-a address] [-s start] [-e end] archive...
+ */
+
+#include "traceroute.h"
+#include "archive.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct filter {
+	const char	*target;
+	int			target_is_addr;
+	uint8_t		target_addr[TR_ARCHIVE_ADDRLEN];
+	int			has_hop;
+	uint8_t		hop_addr[TR_ARCHIVE_ADDRLEN];
+	uint64_t	start_us;
+	uint64_t	end_us;
+	int			list;
+};
+
+/**
+ * Vue sur une archive projetée en mémoire.
+ */
+struct archive {
+	const char						*path;
+	const uint8_t					*map;
+	size_t							size;
+	const struct tr_archive_header	*header;
+	/* Fin de la zone des blocs: début de l'index, ou fin du fichier sans index */
+	size_t							blocks_end;
+};
+
+static const char	*proto_names[] = {
+	[TR_PROTO_UDP] = "udp",
+	[TR_PROTO_ICMP] = "icmp",
+	[TR_PROTO_TCP] = "tcp",
+	[TR_PROTO_GRE] = "gre",
+};
+
+static const char	*stop_names[] = {
+	[TR_STOP_NONE] = "none",
+	[TR_STOP_REACHED] = "reached",
+	[TR_STOP_MAX_TTL] = "max ttl",
+	[TR_STOP_GAP] = "silent hops",
+	[TR_STOP_LOOP] = "routing loop",
+	[TR_STOP_STOP_SET] = "stop set",
+};
+
+static void
+usage(void)
+{
+	(void)fprintf(stderr, "Usage: trarchive [-l] [-t target] [-a address] [-s start] [-e end] archive...\n");
+	exit(64);
+}
+
+/**
+ * Adresse IPv4 ou IPv6 sur 16 octets, au format des archives.
+ */
+static int
+parse_addr(const char *str, uint8_t *out)
+{
+	struct in_addr in;
+
+	if (inet_pton(AF_INET6, str, out) == 1)
+		return (0);
+	if (inet_pton(AF_INET, str, &in) != 1)
+		return (-1);
+	memset(out, 0, 10);
+	out[10] = 0xFF;
+	out[11] = 0xFF;
+	memcpy(out + 12, &in, sizeof(in));
+	return (0);
+}
+
+static const char *
+format_addr(const uint8_t *addr, char *buf, size_t len)
+{
+	if (IN6_IS_ADDR_V4MAPPED((const struct in6_addr *)addr))
+		return (inet_ntop(AF_INET, addr + 12, buf, len));
+	return (inet_ntop(AF_INET6, addr, buf, len));
+}
+
+/**
+ * Date en secondes Unix, ou au format AAAA-MM-JJ[THH:MM:SS] en heure locale.
+ */
+static uint64_t
+parse_time(const char *str)
+{
+	struct tm tm;
+	char *end;
+
+	unsigned long long secs = strtoull(str, &end, 10);
+	if (*str && *end == '\0')
+		return (secs * 1000000);
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(str, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (end == NULL || *end)
+	{
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(str, "%Y-%m-%d", &tm);
+	}
+	if (end == NULL || *end)
+	{
+		(void)fprintf(stderr, "trarchive: invalid date: %s\n", str);
+		exit(64);
+	}
+	tm.tm_isdst = -1;
+	return ((uint64_t)mktime(&tm) * 1000000);
+}
+
+static void
+format_time(uint64_t us, char *buf, size_t len)
+{
+	time_t secs = us / 1000000;
+	struct tm tm;
+
+	(void)localtime_r(&secs, &tm);
+	(void)strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+/**
+ * Valide un bloc avant toute lecture: l'archive peut être tronquée ou corrompue.
+ */
+static const struct tr_archive_block *
+archive_block(const struct archive *ar, uint64_t offset)
+{
+	if (offset < sizeof(struct tr_archive_header) || offset > ar->blocks_end
+		|| ar->blocks_end - offset < sizeof(struct tr_archive_block) || offset % 8)
+		return (NULL);
+
+	const struct tr_archive_block *block = (const struct tr_archive_block *)(ar->map + offset);
+	if (block->magic != TR_ARCHIVE_BLOCK_MAGIC || block->size > ar->blocks_end - offset)
+		return (NULL);
+
+	uint64_t expected = sizeof(*block) + tr_archive_pad(block->hostlen)
+		+ (uint64_t)block->nrecords * sizeof(struct tr_archive_record) + (uint64_t)block->naddrs * TR_ARCHIVE_ADDRLEN;
+	if (expected != block->size)
+		return (NULL);
+	return (block);
+}
+
+static const struct tr_archive_record *
+block_records(const struct tr_archive_block *block)
+{
+	return ((const struct tr_archive_record *)((const uint8_t *)(block + 1) + tr_archive_pad(block->hostlen)));
+}
+
+static const uint8_t *
+block_addrs(const struct tr_archive_block *block)
+{
+	return ((const uint8_t *)(block_records(block) + block->nrecords));
+}
+
+static int
+block_has_hop(const struct tr_archive_block *block, const uint8_t *addr)
+{
+	const uint8_t *addrs = block_addrs(block);
+
+	for (uint32_t i = 0; i < block->naddrs; ++i)
+	{
+		if (memcmp(addrs + i * TR_ARCHIVE_ADDRLEN, addr, TR_ARCHIVE_ADDRLEN) == 0)
+			return (1);
+	}
+	return (0);
+}
+
+static void
+print_block(const struct tr_archive_block *block, int list)
+{
+	const struct tr_archive_record *records = block_records(block);
+	const uint8_t *addrs = block_addrs(block);
+	char date[32];
+	char dst[INET6_ADDRSTRLEN];
+	char addr[INET6_ADDRSTRLEN];
+
+	format_time(block->start_us, date, sizeof(date));
+	(void)format_addr(block->dst, dst, sizeof(dst));
+	uint32_t hops = block->nrecords ? records[block->nrecords - 1].ttl : 0;
+	const char *stop = block->stop < sizeof(stop_names) / sizeof(stop_names[0]) ? stop_names[block->stop] : "unknown";
+
+	(void)printf("%s  %s (%.*s)  %u hops, %s\n", date, dst, (int)block->hostlen, (const char *)(block + 1), hops, stop);
+	if (list)
+		return;
+
+	for (uint32_t i = 0; i < block->nrecords; ++i)
+	{
+		const struct tr_archive_record *record = &records[i];
+		uint16_t last = 0;
+
+		if (i == 0 || record->ttl != records[i - 1].ttl)
+			(void)printf("%2u  ", record->ttl);
+		else
+			last = records[i - 1].addr;
+
+		if (record->state == TR_ARCHIVE_REPLY && record->addr && record->addr <= block->naddrs)
+		{
+			if (record->addr != last)
+			{
+				if (last)
+					(void)printf("\n    ");
+				(void)printf("%s ", format_addr(addrs + (record->addr - 1) * TR_ARCHIVE_ADDRLEN, addr, sizeof(addr)));
+			}
+			(void)printf(" %.3f ms ", record->rtt_us / 1000.0);
+		}
+		else if (record->state == TR_ARCHIVE_ERROR)
+			(void)printf("! ");
+		else
+			(void)printf("* ");
+
+		if (i + 1 == block->nrecords || records[i + 1].ttl != record->ttl)
+			(void)printf("\n");
+	}
+}
+
+/**
+ * Applique les filtres à un bloc. Les critères portant sur l'index (date,
+ * adresse de destination) ont déjà été vérifiés lorsqu'il est disponible.
+ */
+static int
+block_matches(const struct tr_archive_block *block, const struct filter *filter)
+{
+	if (filter->target && !filter->target_is_addr)
+	{
+		size_t len = strlen(filter->target);
+		if (len != block->hostlen || memcmp(block + 1, filter->target, len) != 0)
+			return (0);
+	}
+	if (filter->has_hop && !block_has_hop(block, filter->hop_addr))
+		return (0);
+	return (1);
+}
+
+static int
+index_matches(const struct tr_archive_index *entry, const struct filter *filter)
+{
+	if (entry->end_us < filter->start_us || entry->start_us > filter->end_us)
+		return (0);
+	if (filter->target && filter->target_is_addr && memcmp(entry->dst, filter->target_addr, TR_ARCHIVE_ADDRLEN) != 0)
+		return (0);
+	return (1);
+}
+
+/**
+ * Parcourt les blocs à partir de l'index de fin de fichier, ou l'un après
+ * l'autre pour une archive dont l'écriture a été interrompue.
+ */
+static uint32_t
+archive_query(struct archive *ar, const struct filter *filter)
+{
+	const struct tr_archive_trailer *trailer = NULL;
+	uint32_t matches = 0;
+
+	// Tous les éléments d'une archive complète occupent un multiple de 8 octets
+	if (ar->size >= sizeof(struct tr_archive_header) + sizeof(*trailer) && ar->size % 8 == 0)
+		trailer = (const struct tr_archive_trailer *)(ar->map + ar->size - sizeof(*trailer));
+	// Les bornes sont vérifiées une à une: une somme de champs corrompus pourrait déborder
+	if (trailer && trailer->magic == TR_ARCHIVE_INDEX_MAGIC && trailer->index_offset >= sizeof(struct tr_archive_header)
+		&& trailer->index_offset <= ar->size - sizeof(*trailer)
+		&& trailer->count <= (ar->size - sizeof(*trailer) - trailer->index_offset) / sizeof(struct tr_archive_index)
+		&& trailer->index_offset + (uint64_t)trailer->count * sizeof(struct tr_archive_index) + sizeof(*trailer) == ar->size)
+	{
+		const struct tr_archive_index *index = (const struct tr_archive_index *)(ar->map + trailer->index_offset);
+
+		ar->blocks_end = trailer->index_offset;
+		// Seuls les blocs retenus par l'index sont lus
+		(void)madvise((void *)ar->map, ar->size, MADV_RANDOM);
+		for (uint32_t i = 0; i < trailer->count; ++i)
+		{
+			if (!index_matches(&index[i], filter))
+				continue;
+			const struct tr_archive_block *block = archive_block(ar, index[i].offset);
+			if (block == NULL)
+			{
+				(void)fprintf(stderr, "trarchive: %s: corrupted block at offset %llu\n", ar->path, (unsigned long long)index[i].offset);
+				continue;
+			}
+			if (!block_matches(block, filter))
+				continue;
+			print_block(block, filter->list);
+			matches++;
+		}
+		return (matches);
+	}
+
+	ar->blocks_end = ar->size;
+	uint64_t offset = sizeof(struct tr_archive_header);
+	const struct tr_archive_block *block;
+	while ((block = archive_block(ar, offset)) != NULL)
+	{
+		offset += block->size;
+		if (block->start_us > filter->end_us)
+			continue;
+		if (filter->target && filter->target_is_addr && memcmp(block->dst, filter->target_addr, TR_ARCHIVE_ADDRLEN) != 0)
+			continue;
+		// Sans index, la fin de la trace est l'heure d'envoi de sa dernière probe
+		uint64_t end_us = block->start_us;
+		const struct tr_archive_record *records = block_records(block);
+		for (uint32_t i = 0; i < block->nrecords; ++i)
+			end_us += records[i].delta_us;
+		if (end_us < filter->start_us || !block_matches(block, filter))
+			continue;
+		print_block(block, filter->list);
+		matches++;
+	}
+	if (offset != ar->size)
+		(void)fprintf(stderr, "trarchive: %s: no index, stopped at offset %llu\n", ar->path, (unsigned long long)offset);
+	return (matches);
+}
+
+static int
+archive_open(struct archive *ar, const char *path)
+{
+	struct stat st;
+
+	memset(ar, 0, sizeof(*ar));
+	ar->path = path;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		perror(path);
+		if (fd >= 0)
+			(void)close(fd);
+		return (-1);
+	}
+	ar->size = st.st_size;
+	if (ar->size < sizeof(struct tr_archive_header))
+	{
+		(void)fprintf(stderr, "trarchive: %s: not an archive\n", path);
+		(void)close(fd);
+		return (-1);
+	}
+	ar->map = mmap(NULL, ar->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	(void)close(fd);
+	if (ar->map == MAP_FAILED)
+	{
+		perror(path);
+		return (-1);
+	}
+
+	ar->header = (const struct tr_archive_header *)ar->map;
+	if (memcmp(ar->header->magic, TR_ARCHIVE_MAGIC, sizeof(ar->header->magic)) != 0
+		|| ar->header->version != TR_ARCHIVE_VERSION || ar->header->endian != TR_ARCHIVE_ENDIAN)
+	{
+		(void)fprintf(stderr, "trarchive: %s: not an archive, or written by another version or byte order\n", path);
+		(void)munmap((void *)ar->map, ar->size);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct filter filter;
+	int status = 0;
+	int ch;
+
+	memset(&filter, 0, sizeof(filter));
+	filter.end_us = UINT64_MAX;
+
+	while ((ch = getopt(argc, argv, "la:e:s:t:")) != -1)
+	{
+		switch (ch)
+		{
+		case 'l':
+			filter.list = 1;
+			break;
+		case 't':
+			filter.target = optarg;
+			filter.target_is_addr = parse_addr(optarg, filter.target_addr) == 0;
+			break;
+		case 'a':
+			if (parse_addr(optarg, filter.hop_addr))
+			{
+				(void)fprintf(stderr, "trarchive: invalid address: %s\n", optarg);
+				return (64);
+			}
+			filter.has_hop = 1;
+			break;
+		case 's':
+			filter.start_us = parse_time(optarg);
+			break;
+		case 'e':
+			filter.end_us = parse_time(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind >= argc)
+		usage();
+
+	for (int i = optind; i < argc; ++i)
+	{
+		struct archive ar;
+		if (archive_open(&ar, argv[i]))
+		{
+			status = 1;
+			continue;
+		}
+
+		const struct tr_archive_header *h = ar.header;
+		if (!filter.list)
+			(void)printf("# %s: IPv%u, %s, %u probes, ttl %u-%u, %u byte packets\n", argv[i], h->family,
+				h->protocol < sizeof(proto_names) / sizeof(proto_names[0]) && proto_names[h->protocol] ? proto_names[h->protocol] : "unknown",
+				h->nprobes, h->first_ttl, h->max_ttl, h->packet_len);
+		(void)archive_query(&ar, &filter);
+		(void)munmap((void *)ar.map, ar.size);
+	}
+	return (status);
+}